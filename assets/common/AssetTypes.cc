@@ -45,5 +45,11 @@ glm::vec3 Vec3ToGlm(const Vec3& vec) {
   return glm::vec3(vec.x(), vec.y(), vec.z());
 }
 
+glm::vec2 Vec2ToGlm(const Vec2f& vec) { return glm::vec2(vec.x(), vec.y()); }
+
+glm::vec3 Vec3ToGlm(const Vec3f& vec) {
+  return glm::vec3(vec.x(), vec.y(), vec.z());
+}
+
 }  // namespace assets
 }  // namespace mondradiko
@@ -21,6 +21,8 @@ namespace assets {
 static const size_t ASSET_REGISTRY_MAX_LUMPS = 256;
 static const size_t ASSET_LUMP_MAX_ASSETS = 4096;
 static const size_t ASSET_LUMP_MAX_SIZE = 48 * 1024 * 1024;  // 128 MiB
+static const size_t ASSET_LUMP_BLOCK_SIZE = 64 * 1024;        // 64 KiB
+static const size_t ASSET_ZSTD_DICTIONARY_MAX_SIZE = 112 * 1024;  // 112 KiB
 
 // TODO(marceline-cramer) AssetLump error handling
 enum class AssetResult {
@@ -42,6 +44,8 @@ const char* getAssetResultString(AssetResult);
 
 glm::vec2 Vec2ToGlm(const Vec2&);
 glm::vec3 Vec3ToGlm(const Vec3&);
+glm::vec2 Vec2ToGlm(const Vec2f&);
+glm::vec3 Vec3ToGlm(const Vec3f&);
 
 }  // namespace assets
 }  // namespace mondradiko
@@ -0,0 +1,475 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "assets/common/TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace mondradiko {
+namespace assets {
+
+// Interpolation weights for 4-bit BC7 indices, out of 64
+static const uint32_t BC7_WEIGHTS4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                          34, 38, 43, 47, 51, 55, 60, 64};
+
+size_t getTextureLevelSize(TextureFormat format, uint32_t width,
+                           uint32_t height) {
+  size_t blocks_x = (width + 3) / 4;
+  size_t blocks_y = (height + 3) / 4;
+
+  switch (format) {
+    case TextureFormat::BC7:
+    case TextureFormat::BC5:
+      return blocks_x * blocks_y * 16;
+    case TextureFormat::BC4:
+      return blocks_x * blocks_y * 8;
+    default:
+      return static_cast<size_t>(width) * height * 4;
+  }
+}
+
+// Copies a 4x4 block of RGBA8 texels, clamping to the level's edges
+static void readBlock(const uint8_t* rgba, uint32_t width, uint32_t height,
+                      uint32_t block_x, uint32_t block_y, uint8_t* texels) {
+  for (uint32_t y = 0; y < 4; y++) {
+    uint32_t source_y = std::min(block_y * 4 + y, height - 1);
+
+    for (uint32_t x = 0; x < 4; x++) {
+      uint32_t source_x = std::min(block_x * 4 + x, width - 1);
+      memcpy(texels + (y * 4 + x) * 4,
+             rgba + (static_cast<size_t>(source_y) * width + source_x) * 4, 4);
+    }
+  }
+}
+
+static void writeBlock(const uint8_t* texels, uint32_t width, uint32_t height,
+                       uint32_t block_x, uint32_t block_y, uint8_t* rgba) {
+  for (uint32_t y = 0; y < 4 && block_y * 4 + y < height; y++) {
+    for (uint32_t x = 0; x < 4 && block_x * 4 + x < width; x++) {
+      size_t target = static_cast<size_t>(block_y * 4 + y) * width +
+                      block_x * 4 + x;
+      memcpy(rgba + target * 4, texels + (y * 4 + x) * 4, 4);
+    }
+  }
+}
+
+void compressTextureLevel(TextureFormat format, const uint8_t* rgba,
+                          uint32_t width, uint32_t height,
+                          std::vector<uint8_t>* output) {
+  size_t offset = output->size();
+  output->resize(offset + getTextureLevelSize(format, width, height));
+
+  if (format == TextureFormat::Uncompressed) {
+    memcpy(output->data() + offset, rgba, output->size() - offset);
+    return;
+  }
+
+  uint8_t* block = output->data() + offset;
+  uint8_t texels[64];
+  uint8_t channel[16];
+
+  for (uint32_t block_y = 0; block_y < (height + 3) / 4; block_y++) {
+    for (uint32_t block_x = 0; block_x < (width + 3) / 4; block_x++) {
+      readBlock(rgba, width, height, block_x, block_y, texels);
+
+      switch (format) {
+        case TextureFormat::BC7: {
+          encodeBC7Block(texels, block);
+          block += 16;
+          break;
+        }
+
+        case TextureFormat::BC4: {
+          for (uint32_t i = 0; i < 16; i++) channel[i] = texels[i * 4];
+          encodeBC4Block(channel, block);
+          block += 8;
+          break;
+        }
+
+        case TextureFormat::BC5: {
+          for (uint32_t c = 0; c < 2; c++) {
+            for (uint32_t i = 0; i < 16; i++) channel[i] = texels[i * 4 + c];
+            encodeBC4Block(channel, block);
+            block += 8;
+          }
+
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+  }
+}
+
+void decompressTextureLevel(TextureFormat format, const uint8_t* data,
+                            uint32_t width, uint32_t height, uint8_t* rgba) {
+  if (format == TextureFormat::Uncompressed) {
+    memcpy(rgba, data, getTextureLevelSize(format, width, height));
+    return;
+  }
+
+  uint8_t texels[64];
+  uint8_t channel[16];
+
+  for (uint32_t block_y = 0; block_y < (height + 3) / 4; block_y++) {
+    for (uint32_t block_x = 0; block_x < (width + 3) / 4; block_x++) {
+      switch (format) {
+        case TextureFormat::BC7: {
+          decodeBC7Block(data, texels);
+          data += 16;
+          break;
+        }
+
+        case TextureFormat::BC4: {
+          decodeBC4Block(data, channel);
+          data += 8;
+
+          for (uint32_t i = 0; i < 16; i++) {
+            texels[i * 4 + 0] = channel[i];
+            texels[i * 4 + 1] = channel[i];
+            texels[i * 4 + 2] = channel[i];
+            texels[i * 4 + 3] = 255;
+          }
+
+          break;
+        }
+
+        case TextureFormat::BC5: {
+          for (uint32_t c = 0; c < 2; c++) {
+            decodeBC4Block(data, channel);
+            data += 8;
+            for (uint32_t i = 0; i < 16; i++) texels[i * 4 + c] = channel[i];
+          }
+
+          for (uint32_t i = 0; i < 16; i++) {
+            texels[i * 4 + 2] = 0;
+            texels[i * 4 + 3] = 255;
+          }
+
+          break;
+        }
+
+        default:
+          break;
+      }
+
+      writeBlock(texels, width, height, block_x, block_y, rgba);
+    }
+  }
+}
+
+// Packs a 128-bit block least significant bit first
+class BlockWriter {
+ public:
+  explicit BlockWriter(uint8_t* block) : block(block) { memset(block, 0, 16); }
+
+  void write(uint32_t value, uint32_t bit_count) {
+    for (uint32_t i = 0; i < bit_count; i++, bit++) {
+      if (value & (1u << i)) block[bit / 8] |= 1u << (bit % 8);
+    }
+  }
+
+ private:
+  uint8_t* block;
+  uint32_t bit = 0;
+};
+
+class BlockReader {
+ public:
+  explicit BlockReader(const uint8_t* block) : block(block) {}
+
+  uint32_t read(uint32_t bit_count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < bit_count; i++, bit++) {
+      if (block[bit / 8] & (1u << (bit % 8))) value |= 1u << i;
+    }
+    return value;
+  }
+
+ private:
+  const uint8_t* block;
+  uint32_t bit = 0;
+};
+
+static uint8_t interpolateBC7(uint32_t e0, uint32_t e1, uint32_t index) {
+  uint32_t weight = BC7_WEIGHTS4[index];
+  return static_cast<uint8_t>(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+}
+
+void encodeBC7Block(const uint8_t* texels, uint8_t* block) {
+  // Fit a line through the texels along their principal axis
+  float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (uint32_t i = 0; i < 16; i++) {
+    for (uint32_t c = 0; c < 4; c++) mean[c] += texels[i * 4 + c] / 16.0f;
+  }
+
+  float covariance[4][4] = {};
+  for (uint32_t i = 0; i < 16; i++) {
+    float d[4];
+    for (uint32_t c = 0; c < 4; c++) d[c] = texels[i * 4 + c] - mean[c];
+
+    for (uint32_t a = 0; a < 4; a++) {
+      for (uint32_t b = 0; b < 4; b++) covariance[a][b] += d[a] * d[b];
+    }
+  }
+
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (uint32_t iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (uint32_t a = 0; a < 4; a++) {
+      for (uint32_t b = 0; b < 4; b++) next[a] += covariance[a][b] * axis[b];
+    }
+
+    float length = std::sqrt(next[0] * next[0] + next[1] * next[1] +
+                             next[2] * next[2] + next[3] * next[3]);
+    if (length < 1e-6f) break;
+    for (uint32_t c = 0; c < 4; c++) axis[c] = next[c] / length;
+  }
+
+  float min_t = std::numeric_limits<float>::max();
+  float max_t = std::numeric_limits<float>::lowest();
+  for (uint32_t i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (uint32_t c = 0; c < 4; c++) {
+      t += (texels[i * 4 + c] - mean[c]) * axis[c];
+    }
+
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  float endpoints[2][4];
+  for (uint32_t c = 0; c < 4; c++) {
+    endpoints[0][c] = mean[c] + min_t * axis[c];
+    endpoints[1][c] = mean[c] + max_t * axis[c];
+  }
+
+  // Mode 6 stores 7-bit endpoints with one shared low bit each, so try
+  // every combination of the two low bits
+  uint32_t best_error = std::numeric_limits<uint32_t>::max();
+  uint32_t best_endpoints[2][4];
+  uint32_t best_pbits[2];
+  uint32_t best_indices[16];
+
+  auto try_endpoints = [&](const float endpoints[2][4]) {
+    for (uint32_t pbits = 0; pbits < 4; pbits++) {
+      uint32_t pbit[2] = {pbits & 1, pbits >> 1};
+      uint32_t quantized[2][4];
+
+      for (uint32_t e = 0; e < 2; e++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          float value = (endpoints[e][c] - pbit[e]) / 2.0f;
+          int32_t q = static_cast<int32_t>(std::round(value));
+          quantized[e][c] = std::clamp(q, 0, 127);
+        }
+      }
+
+      uint8_t palette[16][4];
+      for (uint32_t index = 0; index < 16; index++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          palette[index][c] =
+              interpolateBC7((quantized[0][c] << 1) | pbit[0],
+                             (quantized[1][c] << 1) | pbit[1], index);
+        }
+      }
+
+      uint32_t error = 0;
+      uint32_t indices[16];
+
+      for (uint32_t i = 0; i < 16; i++) {
+        uint32_t texel_error = std::numeric_limits<uint32_t>::max();
+
+        for (uint32_t index = 0; index < 16; index++) {
+          uint32_t index_error = 0;
+          for (uint32_t c = 0; c < 4; c++) {
+            int32_t d = static_cast<int32_t>(texels[i * 4 + c]) -
+                        static_cast<int32_t>(palette[index][c]);
+            index_error += d * d;
+          }
+
+          if (index_error < texel_error) {
+            texel_error = index_error;
+            indices[i] = index;
+          }
+        }
+
+        error += texel_error;
+      }
+
+      if (error < best_error) {
+        best_error = error;
+        memcpy(best_endpoints, quantized, sizeof(quantized));
+        memcpy(best_pbits, pbit, sizeof(pbit));
+        memcpy(best_indices, indices, sizeof(indices));
+      }
+    }
+  };
+
+  try_endpoints(endpoints);
+
+  // Refit the endpoints to the chosen indices by least squares
+  for (uint32_t iteration = 0; iteration < 2; iteration++) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float bx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (uint32_t i = 0; i < 16; i++) {
+      float b = BC7_WEIGHTS4[best_indices[i]] / 64.0f;
+      float a = 1.0f - b;
+      aa += a * a;
+      ab += a * b;
+      bb += b * b;
+
+      for (uint32_t c = 0; c < 4; c++) {
+        ax[c] += a * texels[i * 4 + c];
+        bx[c] += b * texels[i * 4 + c];
+      }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) break;
+
+    float refit[2][4];
+    for (uint32_t c = 0; c < 4; c++) {
+      refit[0][c] = (bb * ax[c] - ab * bx[c]) / determinant;
+      refit[1][c] = (aa * bx[c] - ab * ax[c]) / determinant;
+    }
+
+    try_endpoints(refit);
+  }
+
+  // The first index's high bit is implicitly zero
+  if (best_indices[0] & 8) {
+    for (uint32_t c = 0; c < 4; c++) {
+      std::swap(best_endpoints[0][c], best_endpoints[1][c]);
+    }
+
+    std::swap(best_pbits[0], best_pbits[1]);
+    for (uint32_t i = 0; i < 16; i++) best_indices[i] = 15 - best_indices[i];
+  }
+
+  BlockWriter writer(block);
+  writer.write(1 << 6, 7);
+
+  for (uint32_t c = 0; c < 4; c++) {
+    writer.write(best_endpoints[0][c], 7);
+    writer.write(best_endpoints[1][c], 7);
+  }
+
+  writer.write(best_pbits[0], 1);
+  writer.write(best_pbits[1], 1);
+
+  writer.write(best_indices[0], 3);
+  for (uint32_t i = 1; i < 16; i++) writer.write(best_indices[i], 4);
+}
+
+void decodeBC7Block(const uint8_t* block, uint8_t* texels) {
+  BlockReader reader(block);
+
+  if (reader.read(7) != 1 << 6) {
+    // Magenta, so unsupported blocks stand out
+    for (uint32_t i = 0; i < 16; i++) {
+      texels[i * 4 + 0] = 255;
+      texels[i * 4 + 1] = 0;
+      texels[i * 4 + 2] = 255;
+      texels[i * 4 + 3] = 255;
+    }
+
+    return;
+  }
+
+  uint32_t endpoints[2][4];
+  for (uint32_t c = 0; c < 4; c++) {
+    endpoints[0][c] = reader.read(7);
+    endpoints[1][c] = reader.read(7);
+  }
+
+  uint32_t pbit[2];
+  pbit[0] = reader.read(1);
+  pbit[1] = reader.read(1);
+
+  for (uint32_t e = 0; e < 2; e++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      endpoints[e][c] = (endpoints[e][c] << 1) | pbit[e];
+    }
+  }
+
+  for (uint32_t i = 0; i < 16; i++) {
+    uint32_t index = reader.read(i == 0 ? 3 : 4);
+
+    for (uint32_t c = 0; c < 4; c++) {
+      texels[i * 4 + c] =
+          interpolateBC7(endpoints[0][c], endpoints[1][c], index);
+    }
+  }
+}
+
+// Fills the eight-value BC4 palette for endpoint0 > endpoint1, or the
+// six-value palette with 0 and 255 otherwise
+static void getBC4Palette(uint32_t e0, uint32_t e1, uint8_t* palette) {
+  palette[0] = e0;
+  palette[1] = e1;
+
+  if (e0 > e1) {
+    for (uint32_t i = 1; i < 7; i++) {
+      palette[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+    }
+  } else {
+    for (uint32_t i = 1; i < 5; i++) {
+      palette[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+    }
+
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encodeBC4Block(const uint8_t* values, uint8_t* block) {
+  uint8_t min_value = *std::min_element(values, values + 16);
+  uint8_t max_value = *std::max_element(values, values + 16);
+
+  uint8_t palette[8];
+  getBC4Palette(max_value, min_value, palette);
+
+  uint64_t bits = static_cast<uint64_t>(max_value) |
+                  static_cast<uint64_t>(min_value) << 8;
+
+  for (uint32_t i = 0; i < 16; i++) {
+    uint32_t best_index = 0;
+    uint32_t best_error = std::numeric_limits<uint32_t>::max();
+
+    for (uint32_t index = 0; index < 8; index++) {
+      int32_t d = static_cast<int32_t>(values[i]) - palette[index];
+      if (static_cast<uint32_t>(d * d) < best_error) {
+        best_error = d * d;
+        best_index = index;
+      }
+    }
+
+    bits |= static_cast<uint64_t>(best_index) << (16 + i * 3);
+  }
+
+  for (uint32_t i = 0; i < 8; i++) block[i] = (bits >> (i * 8)) & 0xff;
+}
+
+void decodeBC4Block(const uint8_t* block, uint8_t* values) {
+  uint64_t bits = 0;
+  for (uint32_t i = 0; i < 8; i++) {
+    bits |= static_cast<uint64_t>(block[i]) << (i * 8);
+  }
+
+  uint8_t palette[8];
+  getBC4Palette(bits & 0xff, (bits >> 8) & 0xff, palette);
+
+  for (uint32_t i = 0; i < 16; i++) {
+    values[i] = palette[(bits >> (16 + i * 3)) & 7];
+  }
+}
+
+}  // namespace assets
+}  // namespace mondradiko
@@ -0,0 +1,43 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "types/assets/TextureAsset_generated.h"
+
+namespace mondradiko {
+namespace assets {
+
+/**
+ * @brief Block compression codecs for TextureAsset levels.
+ * The bundler compresses RGBA8 levels with these, and clients whose GPUs
+ * can't sample a format decompress them back to RGBA8. Only BC7 mode 6 is
+ * encoded, so only mode 6 is decoded.
+ *
+ * Decompressed BC4 levels are grayscale and decompressed BC5 levels have
+ * zero blue, matching the swizzles used to sample them on the GPU.
+ */
+
+// Size in bytes of one level; uncompressed levels are RGBA8
+size_t getTextureLevelSize(TextureFormat, uint32_t, uint32_t);
+
+// Appends a compressed RGBA8 level to the output
+void compressTextureLevel(TextureFormat, const uint8_t*, uint32_t, uint32_t,
+                          std::vector<uint8_t>*);
+
+// Writes a compressed level to an RGBA8 buffer
+void decompressTextureLevel(TextureFormat, const uint8_t*, uint32_t, uint32_t,
+                            uint8_t*);
+
+// Single 4x4 blocks; pixels are 16 RGBA8 texels or 16 single-channel values
+void encodeBC7Block(const uint8_t*, uint8_t*);
+void decodeBC7Block(const uint8_t*, uint8_t*);
+void encodeBC4Block(const uint8_t*, uint8_t*);
+void decodeBC4Block(const uint8_t*, uint8_t*);
+
+}  // namespace assets
+}  // namespace mondradiko
@@ -0,0 +1,55 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "assets/common/WorkerPool.h"
+
+#include "log/log.h"
+
+namespace mondradiko {
+
+WorkerPool::WorkerPool(uint32_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 1;
+  }
+
+  log_dbg_fmt("Starting worker pool with %u threads", thread_count);
+
+  for (uint32_t i = 0; i < thread_count; i++) {
+    workers.emplace_back(&WorkerPool::work, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    stopping = true;
+  }
+
+  jobs_available.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void WorkerPool::work() {
+  while (true) {
+    std::function<void()> job;
+
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+      // Finish any remaining jobs before stopping
+      if (jobs.empty()) return;
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    job();
+  }
+}
+
+}  // namespace mondradiko
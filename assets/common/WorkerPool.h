@@ -0,0 +1,59 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace mondradiko {
+
+/**
+ * @brief Fixed-size pool of threads running submitted jobs in FIFO order.
+ *
+ * Shared by the runtime and the bundler for asset I/O and (de)compression.
+ */
+class WorkerPool {
+ public:
+  // A thread count of 0 uses one thread per hardware thread
+  explicit WorkerPool(uint32_t);
+  ~WorkerPool();
+
+  uint32_t getThreadCount() const { return workers.size(); }
+
+  template <typename Job>
+  auto submit(Job&& job) -> std::future<std::invoke_result_t<Job>> {
+    using ResultType = std::invoke_result_t<Job>;
+
+    auto task = std::make_shared<std::packaged_task<ResultType()>>(
+        std::forward<Job>(job));
+    std::future<ResultType> result = task->get_future();
+
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs.emplace_back([task]() { (*task)(); });
+    }
+
+    jobs_available.notify_one();
+    return result;
+  }
+
+ private:
+  std::vector<std::thread> workers;
+
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_available;
+  std::deque<std::function<void()>> jobs;
+  bool stopping = false;
+
+  void work();
+};
+
+}  // namespace mondradiko
@@ -0,0 +1,84 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "core/cvars/CVarScope.h"
+#include "lib/include/toml_headers.h"
+
+namespace mondradiko {
+namespace benchmarks {
+
+// Keeps results alive so that the measured work isn't optimized out
+inline void consume(uint64_t value) {
+  static volatile uint64_t sink;
+  sink = sink + value;
+}
+
+/**
+ * @brief Times a callback over repeated runs.
+ *
+ * The callback is run once to warm caches, then repeatedly until at least
+ * min_seconds have passed. Returns the average seconds per run.
+ */
+template <typename Callback>
+double measure(Callback&& callback, double min_seconds = 0.25) {
+  using Clock = std::chrono::steady_clock;
+
+  callback();
+
+  uint64_t runs = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed;
+
+  do {
+    callback();
+    runs++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < min_seconds);
+
+  return elapsed / runs;
+}
+
+// Loads CVars from an inline TOML string instead of a config file
+inline void loadConfig(CVarScope* cvars, const char* config) {
+  std::istringstream config_stream(config);
+  cvars->loadConfig(toml::parse(config_stream, "benchmark.toml"));
+}
+
+// Creates an empty directory for bundles built by a benchmark
+inline std::filesystem::path makeScratchDirectory(const char* name) {
+  auto path = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  return path;
+}
+
+// Deterministic and cheap, so that runs are comparable
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state(seed) {}
+
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<uint32_t>(state);
+  }
+
+  float nextFloat() { return (next() >> 8) * (1.0f / 16777216.0f); }
+
+ private:
+  uint64_t state;
+};
+
+}  // namespace benchmarks
+}  // namespace mondradiko
@@ -0,0 +1,80 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <unordered_map>
+#include <vector>
+
+#include "benchmarks/Benchmark.h"
+#include "core/filesystem/AssetIndex.h"
+
+using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
+
+using BundleLookup =
+    std::unordered_map<assets::AssetId, assets::AssetBundle::AssetLookupEntry>;
+
+static const uint32_t ASSETS_PER_BUNDLE = 512;
+static const uint32_t LOOKUPS_PER_RUN = 1 << 16;
+
+// The per-bundle search that Filesystem used before AssetIndex
+static const assets::AssetBundle::AssetLookupEntry* findInBundles(
+    const std::vector<BundleLookup>& bundles, assets::AssetId id) {
+  // Later bundles take precedence
+  for (auto bundle = bundles.rbegin(); bundle != bundles.rend(); bundle++) {
+    auto iter = bundle->find(id);
+    if (iter != bundle->end()) return &iter->second;
+  }
+
+  return nullptr;
+}
+
+int main() {
+  printf("%8s %8s %18s %18s\n", "bundles", "assets", "index ns/lookup",
+         "bundles ns/lookup");
+
+  for (uint32_t bundle_count = 1; bundle_count <= 256; bundle_count *= 2) {
+    benchmarks::Random random(0x5EED + bundle_count);
+
+    assets::AssetIndex index;
+    std::vector<BundleLookup> bundles(bundle_count);
+    std::vector<assets::AssetId> ids;
+
+    for (uint32_t bundle = 0; bundle < bundle_count; bundle++) {
+      for (uint32_t i = 0; i < ASSETS_PER_BUNDLE; i++) {
+        // Every eighth asset reuses an earlier ID, like an override would
+        assets::AssetId id;
+        if (i % 8 == 0 && !ids.empty()) {
+          id = ids[random.next() % ids.size()];
+        } else {
+          id = static_cast<assets::AssetId>(random.next() | 1);
+          ids.push_back(id);
+        }
+
+        assets::AssetBundle::AssetLookupEntry location{0, i, 1};
+        index.insert(id, bundle, location);
+        bundles[bundle].emplace(id, location);
+      }
+    }
+
+    // Look assets up in a random order, like a scene load would
+    std::vector<assets::AssetId> lookups(LOOKUPS_PER_RUN);
+    for (auto& lookup : lookups) lookup = ids[random.next() % ids.size()];
+
+    double index_seconds = benchmarks::measure([&]() {
+      uint64_t found = 0;
+      for (auto id : lookups) found += index.find(id)->location.offset;
+      benchmarks::consume(found);
+    });
+
+    double bundles_seconds = benchmarks::measure([&]() {
+      uint64_t found = 0;
+      for (auto id : lookups) found += findInBundles(bundles, id)->offset;
+      benchmarks::consume(found);
+    });
+
+    printf("%8u %8zu %18.2f %18.2f\n", bundle_count, index.size(),
+           index_seconds * 1e9 / LOOKUPS_PER_RUN,
+           bundles_seconds * 1e9 / LOOKUPS_PER_RUN);
+  }
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <vector>
+
+#include "assets/common/WorkerPool.h"
+#include "benchmarks/Benchmark.h"
+#include "bundler/AssetBundleBuilder.h"
+#include "core/assets/AssetPool.h"
+#include "core/assets/PrefabAsset.h"
+#include "core/cvars/CVarScope.h"
+#include "core/filesystem/Filesystem.h"
+#include "log/log.h"
+#include "types/assets/SerializedAsset_generated.h"
+
+using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
+
+static const uint32_t PREFAB_COUNT = 4096;
+static const uint32_t OPERATIONS_PER_RUN = 1 << 16;
+
+static const char* BENCHMARK_CONFIG = R"(
+[filesystem]
+paranoid_verification = false
+worker_threads = 0
+
+[assets]
+cpu_budget = 1024
+gpu_budget = 1024
+eviction_delay = 8
+)";
+
+static std::vector<AssetId> buildPrefabBundle(
+    const std::filesystem::path& bundle_root, WorkerPool* workers) {
+  assets::AssetBundleBuilder builder(bundle_root);
+  builder.setWorkers(workers);
+  std::vector<AssetId> ids;
+
+  for (uint32_t i = 0; i < PREFAB_COUNT; i++) {
+    flatbuffers::FlatBufferBuilder fbb;
+
+    // Offset every prefab so that each one hashes to a unique ID
+    assets::TransformPrefab transform;
+    transform.mutable_position().mutate_x(i);
+    transform.mutable_orientation().mutate_w(1.0);
+
+    assets::PrefabAssetBuilder prefab(fbb);
+    prefab.add_transform(&transform);
+    auto prefab_offset = prefab.Finish();
+
+    assets::SerializedAssetBuilder asset(fbb);
+    asset.add_type(assets::AssetType::PrefabAsset);
+    asset.add_prefab(prefab_offset);
+    auto asset_offset = asset.Finish();
+
+    AssetId id;
+    if (builder.addAsset(&id, &fbb, asset_offset) !=
+        assets::AssetResult::Success) {
+      log_ftl("Failed to add benchmark prefab");
+    }
+
+    ids.push_back(id);
+  }
+
+  if (builder.buildBundle("registry.bin") !=
+      assets::AssetResult::Success) {
+    log_ftl("Failed to build benchmark bundle");
+  }
+
+  return ids;
+}
+
+int main() {
+  CVarScope cvars;
+  Filesystem::initCVars(&cvars);
+  AssetPool::initCVars(&cvars);
+  benchmarks::loadConfig(&cvars, BENCHMARK_CONFIG);
+
+  Filesystem fs(&cvars);
+
+  auto bundle_root =
+      benchmarks::makeScratchDirectory("mondradiko-benchmark-asset-pool");
+  std::vector<AssetId> ids = buildPrefabBundle(bundle_root, fs.getWorkers());
+  if (!fs.loadAssetBundle(bundle_root)) log_ftl("Failed to load bundle");
+
+  AssetPool asset_pool(&cvars, &fs);
+  asset_pool.initializeAssetType<PrefabAsset>(&asset_pool);
+
+  // Keep every prefab loaded so that each load() below is a cache hit
+  std::vector<AssetHandle<PrefabAsset>> handles;
+  handles.reserve(PREFAB_COUNT);
+  for (auto id : ids) handles.emplace_back(asset_pool.load<PrefabAsset>(id));
+
+  benchmarks::Random random(0x5EED);
+  std::vector<uint32_t> order(OPERATIONS_PER_RUN);
+  for (auto& index : order) index = random.next() % PREFAB_COUNT;
+
+  double load_seconds = benchmarks::measure([&]() {
+    uint64_t loaded = 0;
+    for (auto index : order) {
+      if (asset_pool.load<PrefabAsset>(ids[index])) loaded++;
+    }
+
+    benchmarks::consume(loaded);
+  });
+
+  double deref_seconds = benchmarks::measure([&]() {
+    uint64_t loaded = 0;
+    for (auto index : order) {
+      if (handles[index]) loaded++;
+    }
+
+    benchmarks::consume(loaded);
+  });
+
+  printf("%-24s %12s %12s\n", "operation", "ns/op", "Mop/s");
+  printf("%-24s %12.2f %12.2f\n", "load() cache hit",
+         load_seconds * 1e9 / OPERATIONS_PER_RUN,
+         OPERATIONS_PER_RUN / load_seconds * 1e-6);
+  printf("%-24s %12.2f %12.2f\n", "handle dereference",
+         deref_seconds * 1e9 / OPERATIONS_PER_RUN,
+         OPERATIONS_PER_RUN / deref_seconds * 1e-6);
+
+  handles.clear();
+  asset_pool.unloadAll();
+  std::filesystem::remove_all(bundle_root);
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <vector>
+
+#include "benchmarks/Benchmark.h"
+#include "core/assets/MeshAsset.h"
+#include "core/displays/HeadlessDisplay.h"
+#include "core/gpu/GpuBufferArena.h"
+#include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuUploader.h"
+#include "log/log.h"
+#include "types/assets/SerializedAsset_generated.h"
+
+using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
+
+static const uint32_t MESH_COUNT = 16;
+static const uint32_t MESH_GRID_SIZE = 128;
+
+// A flat grid with 32-bit indices, so that neither buffer is compacted
+static flatbuffers::DetachedBuffer buildGridMesh(uint32_t seed,
+                                                 size_t* data_size) {
+  flatbuffers::FlatBufferBuilder fbb;
+  benchmarks::Random random(seed);
+
+  std::vector<assets::MeshVertex> vertices;
+  for (uint32_t y = 0; y < MESH_GRID_SIZE; y++) {
+    for (uint32_t x = 0; x < MESH_GRID_SIZE; x++) {
+      assets::Vec3f position(x, random.nextFloat(), y);
+      assets::Vec3f normal(0.0, 1.0, 0.0);
+      assets::Vec3f color(1.0, 1.0, 1.0);
+      assets::Vec2f tex_coord(x, y);
+      vertices.emplace_back(position, normal, color, tex_coord);
+    }
+  }
+
+  std::vector<uint32_t> indices;
+  for (uint32_t y = 0; y + 1 < MESH_GRID_SIZE; y++) {
+    for (uint32_t x = 0; x + 1 < MESH_GRID_SIZE; x++) {
+      uint32_t corner = y * MESH_GRID_SIZE + x;
+      uint32_t below = corner + MESH_GRID_SIZE;
+      indices.insert(indices.end(), {corner, below, corner + 1, corner + 1,
+                                     below, below + 1});
+    }
+  }
+
+  *data_size = sizeof(assets::MeshVertex) * vertices.size() +
+               sizeof(uint32_t) * indices.size();
+
+  auto vertices_offset = fbb.CreateVectorOfStructs(vertices);
+  auto indices_offset = fbb.CreateVector(indices);
+
+  assets::MeshAssetBuilder mesh(fbb);
+  mesh.add_vertices(vertices_offset);
+  mesh.add_indices(indices_offset);
+  auto mesh_offset = mesh.Finish();
+
+  assets::SerializedAssetBuilder asset(fbb);
+  asset.add_type(assets::AssetType::MeshAsset);
+  asset.add_mesh(mesh_offset);
+  fbb.Finish(asset.Finish());
+
+  return fbb.Release();
+}
+
+// How MeshAsset::load() used to read meshes: one field at a time into
+// intermediate vectors, which are then uploaded
+static void loadConverted(
+    GpuInstance* gpu, GpuBufferArena* vertex_arena, GpuBufferArena* index_arena,
+    const assets::MeshAsset* mesh,
+    std::vector<GpuBufferArena::Allocation>* allocations) {
+  std::vector<MeshVertex> vertices(mesh->vertices()->size());
+
+  for (uint32_t i = 0; i < vertices.size(); i++) {
+    const assets::MeshVertex* vertex = mesh->vertices()->Get(i);
+
+    vertices[i].position = assets::Vec3ToGlm(vertex->position());
+    vertices[i].tex_coord = assets::Vec2ToGlm(vertex->tex_coord());
+    vertices[i].color = assets::Vec3ToGlm(vertex->color());
+    vertices[i].normal = assets::Vec3ToGlm(vertex->normal());
+  }
+
+  std::vector<MeshIndex> indices(mesh->indices()->size());
+
+  for (uint32_t i = 0; i < indices.size(); i++) {
+    indices[i] = mesh->indices()->Get(i);
+  }
+
+  size_t vertex_size = sizeof(MeshVertex) * vertices.size();
+  auto vertex_allocation = vertex_arena->allocate(vertex_size, 1);
+  gpu->uploader->writeBuffer(vertex_arena->getBuffer(vertex_allocation.block),
+                             vertex_allocation.offset, vertices.data(),
+                             vertex_size);
+
+  size_t index_size = sizeof(MeshIndex) * indices.size();
+  auto index_allocation = index_arena->allocate(index_size, 1);
+  gpu->uploader->writeBuffer(index_arena->getBuffer(index_allocation.block),
+                             index_allocation.offset, indices.data(),
+                             index_size);
+
+  allocations->push_back(vertex_allocation);
+  allocations->push_back(index_allocation);
+}
+
+int main() {
+  HeadlessDisplay display(64, 64);
+  GpuInstance gpu(&display);
+  if (!display.createSession(&gpu)) log_ftl("Failed to create session");
+
+  // Declared after the GPU so that they're destroyed first
+  GpuBufferArena vertex_arena(&gpu, 16 << 20,
+                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  GpuBufferArena index_arena(&gpu, 8 << 20, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  std::vector<flatbuffers::DetachedBuffer> buffers;
+  std::vector<const assets::SerializedAsset*> serialized;
+  size_t total_size = 0;
+
+  for (uint32_t i = 0; i < MESH_COUNT; i++) {
+    size_t data_size;
+    buffers.push_back(buildGridMesh(i, &data_size));
+    serialized.push_back(assets::GetSerializedAsset(buffers.back().data()));
+    total_size += data_size;
+  }
+
+  // Each run waits for its uploads, so both paths include the GPU copy
+  double direct_seconds = benchmarks::measure([&]() {
+    std::vector<MeshAsset*> meshes;
+
+    for (auto asset : serialized) {
+      MeshAsset* mesh = new MeshAsset(&gpu, &vertex_arena, &index_arena);
+      mesh->load(asset);
+      meshes.push_back(mesh);
+    }
+
+    gpu.uploader->flush();
+    gpu.uploader->waitIdle();
+
+    for (auto mesh : meshes) delete mesh;
+  });
+
+  double converted_seconds = benchmarks::measure([&]() {
+    std::vector<GpuBufferArena::Allocation> allocations;
+
+    for (auto asset : serialized) {
+      loadConverted(&gpu, &vertex_arena, &index_arena, asset->mesh(),
+                    &allocations);
+    }
+
+    gpu.uploader->flush();
+    gpu.uploader->waitIdle();
+
+    for (uint32_t i = 0; i < allocations.size(); i += 2) {
+      vertex_arena.free(allocations[i]);
+      index_arena.free(allocations[i + 1]);
+    }
+  });
+
+  double total_mb = total_size / (1024.0 * 1024.0);
+
+  printf("%u meshes, %.2f MiB of vertices and indices\n", MESH_COUNT,
+         total_mb);
+  printf("%-24s %12s %12s\n", "path", "ms/run", "MiB/s");
+  printf("%-24s %12.2f %12.2f\n", "direct (MeshAsset)",
+         direct_seconds * 1e3, total_mb / direct_seconds);
+  printf("%-24s %12.2f %12.2f\n", "converted per vertex",
+         converted_seconds * 1e3, total_mb / converted_seconds);
+
+  return 0;
+}
@@ -3,17 +3,30 @@
 
 #include "bundler/AssetBundleBuilder.h"
 
-#include <cstring>
+#include <algorithm>
 #include <fstream>
+#include <future>
 
+#include "assets/common/WorkerPool.h"
 #include "log/log.h"
-#include "lz4frame.h"  // NOLINT
 #include "types/assets/Registry_generated.h"
 #include "xxhash.h"  // NOLINT
+#include "zdict.h"   // NOLINT
 
 namespace mondradiko {
 namespace assets {
 
+// Bounds on the staged assets sampled to train Zstandard dictionaries;
+// dictionaries mostly help small assets, so large ones are truncated
+const size_t ZSTD_SAMPLES_MAX_SIZE = 100 * ASSET_ZSTD_DICTIONARY_MAX_SIZE;
+const size_t ZSTD_SAMPLE_MAX_SIZE = 128 * 1024;  // 128 KiB
+
+const size_t STAGED_READ_CHUNK_SIZE = 1024 * 1024;  // 1 MiB
+
+// Bounds the assets queued for lump writers across all open lumps; a single
+// asset larger than this is still queued once the writers have caught up
+const size_t LUMP_QUEUE_MAX_SIZE = 64 * 1024 * 1024;  // 64 MiB
+
 AssetBundleBuilder::AssetBundleBuilder(const std::filesystem::path& bundle_root)
     : bundle_root(bundle_root) {
   log_msg_fmt("Building asset bundle at %s", bundle_root.c_str());
@@ -22,8 +35,23 @@ AssetBundleBuilder::AssetBundleBuilder(const std::filesystem::path& bundle_root)
 AssetBundleBuilder::~AssetBundleBuilder() {
   log_dbg_fmt("Cleaning up asset bundle %s", bundle_root.c_str());
 
+  {
+    // Lumps may still be being written if the bundle was never built
+    std::unique_lock<std::mutex> lock(streams_mutex);
+    streams_drained.wait(lock, [this]() {
+      for (auto& lump : lumps) {
+        if (lump.stream != nullptr && lump.stream->scheduled) return false;
+      }
+
+      return true;
+    });
+  }
+
   for (auto& lump : lumps) {
-    delete[] lump.data;
+    if (lump.stream != nullptr) {
+      delete lump.stream->writer;
+      delete lump.stream;
+    }
   }
 }
 
@@ -31,83 +59,155 @@ AssetResult AssetBundleBuilder::addAsset(
     AssetId* id, flatbuffers::FlatBufferBuilder* fbb,
     flatbuffers::Offset<SerializedAsset> asset_offset) {
   fbb->Finish(asset_offset);
-  size_t asset_size = fbb->GetSize();
+  return addAsset(id, fbb->GetBufferPointer(), fbb->GetSize());
+}
 
+AssetResult AssetBundleBuilder::addAsset(AssetId* id, const uint8_t* asset_data,
+                                         size_t asset_size) {
   if (asset_size > ASSET_LUMP_MAX_SIZE) {
     log_err("Asset size exceeds max asset lump size");
     return AssetResult::BadSize;
   }
 
-  // Generate ID by hashing asset data
-  *id = static_cast<AssetId>(XXH3_64bits(fbb->GetBufferPointer(), asset_size));
+  *id = generateId(asset_data, asset_size);
 
   if (used_ids.find(*id) != used_ids.end()) {
     log_wrn_fmt("Attempted to build asset with duplicated ID 0x%0x", *id);
     return AssetResult::DuplicateAsset;
   }
 
-  if (lumps.size() == 0) {
-    lumps.resize(1);
-    allocateLump(&lumps[0]);
+  // Find the newest lump using the current compression method
+  uint32_t lump_index = lumps.size();
+
+  for (uint32_t i = lumps.size(); i > 0; i--) {
+    if (lumps[i - 1].target_compression == lump_compression) {
+      lump_index = i - 1;
+      break;
+    }
   }
 
-  uint32_t lump_index = lumps.size() - 1;
+  if (lump_index == lumps.size() ||
+      lumps[lump_index].total_size + asset_size > ASSET_LUMP_MAX_SIZE) {
+    // Nothing else will be added to a full lump, so finish writing it now
+    if (lump_index != lumps.size()) finishLump(&lumps[lump_index]);
 
-  if (lumps[lump_index].total_size + asset_size > ASSET_LUMP_MAX_SIZE) {
-    LumpToSave new_lump;
-    allocateLump(&new_lump);
-    lumps.push_back(new_lump);
-    lump_index++;
+    AssetResult result = allocateLump(&lump_index);
+    if (result != AssetResult::Success) return result;
   }
 
-  if (lumps[lump_index].compression_method != LumpCompressionMethod::None) {
-    log_err_fmt("Lump %d has already been compressed", lump_index);
+  auto& lump = lumps[lump_index];
+
+  if (lump.stream == nullptr) {
+    log_err_fmt("Lump %d has already been finished", lump_index);
     return AssetResult::BadContents;
   }
 
+  const char* asset_bytes = reinterpret_cast<const char*>(asset_data);
+
+  AssetResult result = queueWrite(lump.stream, asset_bytes, asset_size);
+  if (result != AssetResult::Success) return result;
+
+  if (lump.staged && dictionary_samples.size() < ZSTD_SAMPLES_MAX_SIZE) {
+    size_t sample_size = std::min(
+        {asset_size, ZSTD_SAMPLE_MAX_SIZE,
+         ZSTD_SAMPLES_MAX_SIZE - dictionary_samples.size()});
+    dictionary_samples.insert(dictionary_samples.end(), asset_bytes,
+                              asset_bytes + sample_size);
+    dictionary_sample_sizes.push_back(sample_size);
+  }
+
   AssetToSave new_asset;
   new_asset.id = *id;
   new_asset.size = asset_size;
-  lumps[lump_index].assets.push_back(new_asset);
-
-  memcpy(lumps[lump_index].data + lumps[lump_index].total_size,
-         fbb->GetBufferPointer(), asset_size);
+  lump.assets.push_back(new_asset);
 
-  lumps[lump_index].total_size += asset_size;
+  lump.total_size += asset_size;
   used_ids.emplace(*id);
 
   return AssetResult::Success;
 }
 
+AssetId AssetBundleBuilder::generateId(const uint8_t* asset_data,
+                                       size_t asset_size) {
+  return static_cast<AssetId>(XXH3_64bits(asset_data, asset_size));
+}
+
 AssetResult AssetBundleBuilder::addInitialPrefab(AssetId prefab) {
   initial_prefabs.push_back(prefab);
   return AssetResult::Success;
 }
 
 AssetResult AssetBundleBuilder::buildBundle(const char* registry_name) {
-  for (uint32_t lump_index = 0; lump_index < lumps.size(); lump_index++) {
-    auto& lump = lumps[lump_index];
-    auto lump_name = generateLumpName(lump_index);
-    auto lump_path = bundle_root / lump_name;
-    std::ofstream lump_file(lump_path.c_str(), std::ofstream::binary);
+  // Finish every open lump before waiting on any, so that they're flushed in
+  // parallel
+  for (auto& lump : lumps) finishLump(&lump);
 
-    // TODO(marceline-cramer) Lump compression configuration
-    compressLump(&lump);
+  {
+    AssetResult result = AssetResult::Success;
 
-    lump_file.write(reinterpret_cast<char*>(lump.data), lump.total_size);
+    for (auto& lump : lumps) {
+      AssetResult lump_result = collectLump(&lump);
+      if (lump_result != AssetResult::Success) result = lump_result;
+    }
 
-    lump_file.close();
+    if (result != AssetResult::Success) return result;
+  }
+
+  std::vector<uint8_t> dictionary;
+  ZSTD_CDict* zstd_dictionary = nullptr;
+
+  if (train_dictionary) {
+    trainDictionary(&dictionary);
+
+    if (dictionary.size() > 0) {
+      zstd_dictionary =
+          ZSTD_createCDict(dictionary.data(), dictionary.size(), zstd_level);
+    }
+  }
+
+  {
+    std::vector<std::future<AssetResult>> lump_jobs;
+    AssetResult result = AssetResult::Success;
+
+    // Staged lumps are independent, so each is compressed on its own worker
+    // thread
+    for (uint32_t lump_index = 0; lump_index < lumps.size(); lump_index++) {
+      if (!lumps[lump_index].staged) continue;
+
+      auto compress = [this, lump_index, zstd_dictionary]() {
+        return compressStagedLump(lump_index, zstd_dictionary);
+      };
+
+      if (workers != nullptr) {
+        lump_jobs.push_back(workers->submit(compress));
+      } else {
+        AssetResult lump_result = compress();
+        if (lump_result != AssetResult::Success) result = lump_result;
+      }
+    }
+
+    for (auto& lump_job : lump_jobs) {
+      AssetResult lump_result = lump_job.get();
+      if (lump_result != AssetResult::Success) result = lump_result;
+    }
+
+    if (zstd_dictionary != nullptr) ZSTD_freeCDict(zstd_dictionary);
+    if (result != AssetResult::Success) return result;
   }
 
   flatbuffers::FlatBufferBuilder fbb;
 
+  auto dictionary_offset = fbb.CreateVector(dictionary);
+
   std::vector<flatbuffers::Offset<LumpEntry>> lump_offsets;
 
   for (uint32_t lump_index = 0; lump_index < lumps.size(); lump_index++) {
     auto& lump = lumps[lump_index];
 
     log_dbg_fmt("Writing lump %d", lump_index);
-    log_dbg_fmt("Lump size: %lu", lump.total_size);
+    log_dbg_fmt("Lump size: %lu", lump.file_size);
+
+    auto block_offsets_offset = fbb.CreateVector(lump.block_offsets);
 
     AssetEntry* asset_entries;
     auto assets_offset = fbb.CreateUninitializedVectorOfStructs(
@@ -122,16 +222,19 @@ AssetResult AssetBundleBuilder::buildBundle(const char* registry_name) {
     LumpEntryBuilder lump_entry(fbb);
 
     {
-      LumpHash checksum =
-          static_cast<LumpHash>(XXH3_64bits(lump.data, lump.total_size));
-      log_dbg_fmt("Lump has checksum 0x%0lx", checksum);
+      log_dbg_fmt("Lump has checksum 0x%0lx", lump.checksum);
 
-      lump_entry.add_file_size(lump.total_size);
-      lump_entry.add_checksum(checksum);
+      lump_entry.add_file_size(lump.file_size);
+      lump_entry.add_checksum(lump.checksum);
       lump_entry.add_hash_method(LumpHashMethod::xxHash);
       lump_entry.add_compression_method(lump.compression_method);
       lump_entry.add_assets(assets_offset);
 
+      if (lump.compression_method == LumpCompressionMethod::LZ4Blocks) {
+        lump_entry.add_block_size(lump.block_size);
+        lump_entry.add_block_offsets(block_offsets_offset);
+      }
+
       lump_offsets.push_back(lump_entry.Finish());
     }
   }
@@ -146,6 +249,10 @@ AssetResult AssetBundleBuilder::buildBundle(const char* registry_name) {
   registry_builder.add_initial_prefabs(initial_prefabs_offset);
   registry_builder.add_lumps(lumps_offset);
 
+  if (dictionary.size() > 0) {
+    registry_builder.add_zstd_dictionary(dictionary_offset);
+  }
+
   fbb.Finish(registry_builder.Finish());
 
   auto registry_path = bundle_root / registry_name;
@@ -157,47 +264,222 @@ AssetResult AssetBundleBuilder::buildBundle(const char* registry_name) {
   return AssetResult::Success;
 }
 
-void AssetBundleBuilder::allocateLump(LumpToSave* new_lump) {
-  new_lump->compression_method = LumpCompressionMethod::None;
-  new_lump->total_size = 0;
-  new_lump->data = new char[ASSET_LUMP_MAX_SIZE];
-  new_lump->assets.resize(0);
+std::filesystem::path AssetBundleBuilder::getStagedPath(uint32_t lump_index) {
+  return bundle_root / (generateLumpName(lump_index) + ".staged");
 }
 
-void AssetBundleBuilder::compressLump(LumpToSave* lump) {
-  if (lump->compression_method != LumpCompressionMethod::None) {
-    log_err("Can't compress lump; lump is already compressed");
+AssetResult AssetBundleBuilder::allocateLump(uint32_t* lump_index) {
+  *lump_index = lumps.size();
+
+  LumpToSave new_lump;
+  new_lump.target_compression = lump_compression;
+  new_lump.staged =
+      train_dictionary && lump_compression == LumpCompressionMethod::Zstd;
+  new_lump.compression_method =
+      new_lump.staged ? LumpCompressionMethod::None : lump_compression;
+  new_lump.total_size = 0;
+  new_lump.assets.resize(0);
+  new_lump.file_size = 0;
+  new_lump.checksum = 0;
+  new_lump.block_size = 0;
+  new_lump.block_offsets.resize(0);
+
+  std::filesystem::path lump_path;
+  if (new_lump.staged) {
+    lump_path = getStagedPath(*lump_index);
+  } else {
+    lump_path = bundle_root / generateLumpName(*lump_index);
+  }
+
+  // Uncompressed lumps can be memory-mapped directly by the client
+  new_lump.stream = new LumpStream;
+  new_lump.stream->writer =
+      new LumpWriter(lump_path, new_lump.compression_method, zstd_level);
+
+  lumps.push_back(new_lump);
+  return AssetResult::Success;
+}
+
+AssetResult AssetBundleBuilder::queueWrite(LumpStream* stream,
+                                           const char* data, size_t size) {
+  if (workers == nullptr) {
+    bool success = stream->writer->write(data, size);
+    return success ? AssetResult::Success : AssetResult::BadFile;
+  }
+
+  // Copied because callers free their assets once they've been added
+  std::vector<char> chunk(data, data + size);
+
+  std::unique_lock<std::mutex> lock(streams_mutex);
+
+  // Wait for the workers to catch up, so that memory stays bounded however
+  // many lumps are open
+  streams_drained.wait(lock, [this, size]() {
+    return queued_size == 0 || queued_size + size <= LUMP_QUEUE_MAX_SIZE;
+  });
+
+  if (stream->failed) return AssetResult::BadFile;
+
+  stream->chunks.push_back(std::move(chunk));
+  queued_size += size;
+  scheduleStream(stream);
+
+  return AssetResult::Success;
+}
+
+void AssetBundleBuilder::finishLump(LumpToSave* lump) {
+  LumpStream* stream = lump->stream;
+  if (stream == nullptr) return;
+
+  if (workers == nullptr) {
+    if (!stream->finished && !stream->writer->finish()) stream->failed = true;
+    stream->finished = true;
     return;
   }
 
-  // TODO(marceline-cramer) More lump compression types?
-  log_dbg("Compressing lump with LZ4");
+  std::unique_lock<std::mutex> lock(streams_mutex);
+  if (stream->finishing) return;
+
+  // The writer is finished once everything queued before this is written
+  stream->finishing = true;
+  scheduleStream(stream);
+}
+
+AssetResult AssetBundleBuilder::collectLump(LumpToSave* lump) {
+  LumpStream* stream = lump->stream;
+  if (stream == nullptr) return AssetResult::Success;
+
+  {
+    std::unique_lock<std::mutex> lock(streams_mutex);
+    streams_drained.wait(lock, [stream]() {
+      return stream->finished && !stream->scheduled;
+    });
+  }
+
+  lump->file_size = stream->writer->getFileSize();
+  lump->checksum = stream->writer->getChecksum();
+  lump->block_size = stream->writer->getBlockSize();
+  lump->block_offsets = stream->writer->getBlockOffsets();
+
+  bool success = !stream->failed;
+
+  delete stream->writer;
+  delete stream;
+  lump->stream = nullptr;
+
+  return success ? AssetResult::Success : AssetResult::BadFile;
+}
+
+void AssetBundleBuilder::scheduleStream(LumpStream* stream) {
+  // Must be called with streams_mutex held
+  if (stream->scheduled) return;
+  stream->scheduled = true;
+
+  workers->submit([this, stream]() { drainStream(stream); });
+}
+
+void AssetBundleBuilder::drainStream(LumpStream* stream) {
+  std::unique_lock<std::mutex> lock(streams_mutex);
+
+  while (!stream->chunks.empty()) {
+    std::vector<char> chunk = std::move(stream->chunks.front());
+    stream->chunks.pop_front();
+    bool failed = stream->failed;
+
+    // Compression is the slow part, so it runs without holding the lock
+    lock.unlock();
+    bool success = failed || stream->writer->write(chunk.data(), chunk.size());
+    lock.lock();
+
+    if (!success) stream->failed = true;
+    queued_size -= chunk.size();
+    streams_drained.notify_all();
+  }
+
+  if (stream->finishing && !stream->finished) {
+    // Nothing is queued to a lump once it's finishing
+    lock.unlock();
+    bool success = stream->writer->finish();
+    lock.lock();
+
+    if (!success) stream->failed = true;
+    stream->finished = true;
+  }
+
+  stream->scheduled = false;
+  streams_drained.notify_all();
+}
+
+AssetResult AssetBundleBuilder::compressStagedLump(
+    uint32_t lump_index, const ZSTD_CDict* dictionary) {
+  log_zone;
+
+  auto& lump = lumps[lump_index];
+  auto staged_path = getStagedPath(lump_index);
+
+  log_dbg_fmt("Compressing lump %d with Zstandard level %d", lump_index,
+              zstd_level);
+
+  LumpWriter writer(bundle_root / generateLumpName(lump_index),
+                    LumpCompressionMethod::Zstd, zstd_level);
+  writer.setDictionary(dictionary);
+
+  std::ifstream staged_file(staged_path.c_str(), std::ifstream::binary);
+  std::vector<char> buffer(STAGED_READ_CHUNK_SIZE);
+
+  while (staged_file) {
+    staged_file.read(buffer.data(), buffer.size());
+    size_t bytes_read = staged_file.gcount();
+
+    if (bytes_read > 0 && !writer.write(buffer.data(), bytes_read)) {
+      return AssetResult::BadFile;
+    }
+  }
+
+  staged_file.close();
+
+  if (!writer.finish()) return AssetResult::BadFile;
+
+  std::error_code ec;
+  std::filesystem::remove(staged_path, ec);
+
+  lump.compression_method = LumpCompressionMethod::Zstd;
+  lump.file_size = writer.getFileSize();
+  lump.checksum = writer.getChecksum();
+
+  return AssetResult::Success;
+}
+
+void AssetBundleBuilder::trainDictionary(std::vector<uint8_t>* dictionary) {
+  log_zone;
+
+  if (dictionary_sample_sizes.size() == 0) {
+    dictionary->resize(0);
+    return;
+  }
 
-  LZ4F_preferences_t preferences;
-  memset(&preferences, 0, sizeof(preferences));
-  preferences.frameInfo.contentSize = lump->total_size;
-  preferences.compressionLevel = LZ4F_compressionLevel_max();
-  preferences.autoFlush = 1;
-  preferences.favorDecSpeed = 1;
+  log_dbg_fmt("Training Zstandard dictionary on %lu assets",
+              dictionary_sample_sizes.size());
 
-  size_t compressed_size =
-      LZ4F_compressFrameBound(lump->total_size, &preferences);
-  char* compressed_data = new char[compressed_size];
+  dictionary->resize(ASSET_ZSTD_DICTIONARY_MAX_SIZE);
+  size_t dictionary_size = ZDICT_trainFromBuffer(
+      dictionary->data(), dictionary->size(), dictionary_samples.data(),
+      dictionary_sample_sizes.data(), dictionary_sample_sizes.size());
 
-  size_t out_size =
-      LZ4F_compressFrame(compressed_data, compressed_size, lump->data,
-                         lump->total_size, &preferences);
+  // The samples aren't needed anymore
+  std::vector<char>().swap(dictionary_samples);
+  std::vector<size_t>().swap(dictionary_sample_sizes);
 
-  if (LZ4F_isError(out_size)) {
-    log_err_fmt("LZ4HC compression failed: %s", LZ4F_getErrorName(out_size));
+  if (ZDICT_isError(dictionary_size)) {
+    // Usually means there weren't enough samples, which is harmless
+    log_wrn_fmt("Skipping Zstandard dictionary: %s",
+                ZDICT_getErrorName(dictionary_size));
+    dictionary->resize(0);
     return;
   }
 
-  // TODO(marceline-cramer) Stream out to a file
-  delete[] lump->data;
-  lump->compression_method = LumpCompressionMethod::LZ4;
-  lump->total_size = out_size;
-  lump->data = compressed_data;
+  log_dbg_fmt("Trained Zstandard dictionary of %lu bytes", dictionary_size);
+  dictionary->resize(dictionary_size);
 }
 
 }  // namespace assets
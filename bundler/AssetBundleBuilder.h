@@ -3,16 +3,25 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <mutex>
 #include <unordered_set>
 #include <vector>
 
 #include "assets/common/AssetTypes.h"
+#include "bundler/LumpWriter.h"
 #include "lib/include/flatbuffers_headers.h"
 #include "types/assets/Registry_generated.h"
 #include "types/assets/SerializedAsset_generated.h"
+#include "zstd.h"  // NOLINT
 
 namespace mondradiko {
+
+// Forward declarations
+class WorkerPool;
+
 namespace assets {
 
 class AssetBundleBuilder {
@@ -22,31 +31,97 @@ class AssetBundleBuilder {
 
   AssetResult addAsset(AssetId*, flatbuffers::FlatBufferBuilder*,
                        flatbuffers::Offset<SerializedAsset>);
+  AssetResult addAsset(AssetId*, const uint8_t*, size_t);
   AssetResult addInitialPrefab(AssetId);
   AssetResult buildBundle(const char*);
 
+  // IDs are a hash of the serialized asset
+  static AssetId generateId(const uint8_t*, size_t);
+
+  // Sets the compression of lumps holding subsequently added assets
+  void setLumpCompression(LumpCompressionMethod method) {
+    lump_compression = method;
+  }
+
+  void setZstdLevel(int level) { zstd_level = level; }
+  void setTrainDictionary(bool train) { train_dictionary = train; }
+
+  // Lumps are compressed and written on these workers, which must outlive
+  // buildBundle(); without any, everything runs on the calling thread
+  void setWorkers(WorkerPool* pool) { workers = pool; }
+
  private:
   std::filesystem::path bundle_root;
+  WorkerPool* workers = nullptr;
+  LumpCompressionMethod lump_compression = LumpCompressionMethod::LZ4;
+  int zstd_level = ZSTD_CLEVEL_DEFAULT;
+  bool train_dictionary = false;
 
   struct AssetToSave {
     AssetId id;
     size_t size;
   };
 
+  // Feeds an open lump's writer from the worker pool. At most one job drains
+  // a stream at a time, so its chunks are written in order.
+  struct LumpStream {
+    LumpWriter* writer;
+
+    // Guarded by streams_mutex
+    std::deque<std::vector<char>> chunks;
+    bool scheduled = false;
+    bool finishing = false;
+    bool finished = false;
+    bool failed = false;
+  };
+
   struct LumpToSave {
+    LumpCompressionMethod target_compression;
     LumpCompressionMethod compression_method;
+
+    // Uncompressed size of all assets in the lump
     size_t total_size;
-    char* data;
+
+    // Open until the lump is full or the bundle is built
+    LumpStream* stream;
+
+    // Zstandard lumps are staged uncompressed until the dictionary is trained
+    bool staged;
 
     std::vector<AssetToSave> assets;
+
+    // Set once the lump's file is finished
+    size_t file_size;
+    LumpHash checksum;
+
+    // Only used by LZ4Blocks
+    uint32_t block_size;
+    std::vector<uint64_t> block_offsets;
   };
 
   std::vector<LumpToSave> lumps;
+
+  // Shared by every stream, so that queued chunks are bounded in total
+  std::mutex streams_mutex;
+  std::condition_variable streams_drained;
+  size_t queued_size = 0;
+
   std::unordered_set<AssetId> used_ids;
   std::vector<AssetId> initial_prefabs;
 
-  void allocateLump(LumpToSave*);
-  void compressLump(LumpToSave*);
+  // Bounded sample of staged assets to train the Zstandard dictionary on
+  std::vector<char> dictionary_samples;
+  std::vector<size_t> dictionary_sample_sizes;
+
+  std::filesystem::path getStagedPath(uint32_t);
+  AssetResult allocateLump(uint32_t*);
+  AssetResult queueWrite(LumpStream*, const char*, size_t);
+  void finishLump(LumpToSave*);
+  AssetResult collectLump(LumpToSave*);
+  void scheduleStream(LumpStream*);
+  void drainStream(LumpStream*);
+  AssetResult compressStagedLump(uint32_t, const ZSTD_CDict*);
+  void trainDictionary(std::vector<uint8_t>*);
 };
 
 }  // namespace assets
@@ -0,0 +1,164 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "bundler/BuildCache.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "assets/common/AssetTypes.h"
+#include "log/log.h"
+#include "types/assets/BuildCache_generated.h"
+#include "xxhash.h"  // NOLINT
+
+namespace mondradiko {
+
+const uint32_t SOURCE_HASH_CHUNK_SIZE = 1024 * 1024;  // 1 MiB
+
+BuildCache::BuildCache(const std::filesystem::path& cache_root)
+    : cache_root(cache_root) {
+  std::error_code ec;
+  std::filesystem::create_directories(cache_root, ec);
+
+  if (ec) {
+    log_wrn_fmt("Failed to create build cache %s", cache_root.c_str());
+  }
+}
+
+bool BuildCache::hashSources(
+    CacheKey* key, const std::string& asset_type, uint32_t converter_version,
+    uint32_t converter_options,
+    const std::vector<std::filesystem::path>& sources) {
+  XXH3_state_t* state = XXH3_createState();
+  XXH3_64bits_reset(state);
+
+  XXH3_64bits_update(state, asset_type.data(), asset_type.size());
+  XXH3_64bits_update(state, &converter_version, sizeof(converter_version));
+  XXH3_64bits_update(state, &converter_options, sizeof(converter_options));
+
+  std::vector<char> buffer(SOURCE_HASH_CHUNK_SIZE);
+  bool success = true;
+
+  for (const auto& source : sources) {
+    std::ifstream source_file(source.c_str(), std::ifstream::binary);
+
+    if (!source_file.is_open()) {
+      log_wrn_fmt("Failed to hash source file %s", source.c_str());
+      success = false;
+      break;
+    }
+
+    // Separate each file's contents from the next one's
+    auto source_name = source.filename().string();
+    XXH3_64bits_update(state, source_name.data(), source_name.size());
+
+    while (source_file) {
+      source_file.read(buffer.data(), buffer.size());
+      XXH3_64bits_update(state, buffer.data(), source_file.gcount());
+    }
+  }
+
+  *key = XXH3_64bits_digest(state);
+  XXH3_freeState(state);
+  return success;
+}
+
+bool BuildCache::load(CacheKey key, uint32_t converter_version,
+                      ConvertedAssets* converted) {
+  auto entry_path = getEntryPath(key);
+  if (!std::filesystem::exists(entry_path)) return false;
+
+  std::ifstream entry_file(entry_path.c_str(), std::ifstream::binary);
+
+  entry_file.seekg(0, std::ios::end);
+  std::streampos length = entry_file.tellg();
+  entry_file.seekg(0, std::ios::beg);
+
+  std::vector<char> entry_data(length);
+  entry_file.read(entry_data.data(), length);
+  entry_file.close();
+
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(entry_data.data()), entry_data.size());
+
+  if (!assets::VerifyBuildCacheEntryBuffer(verifier)) {
+    log_wrn_fmt("Ignoring invalid build cache entry %s", entry_path.c_str());
+    return false;
+  }
+
+  auto entry = assets::GetBuildCacheEntry(entry_data.data());
+
+  if (entry->version() != MONDRADIKO_ASSET_VERSION ||
+      entry->converter_version() != converter_version ||
+      entry->assets() == nullptr || entry->assets()->size() == 0) {
+    return false;
+  }
+
+  converted->resize(0);
+
+  for (auto cached_asset : *entry->assets()) {
+    if (cached_asset->data() == nullptr) return false;
+
+    converted->emplace_back(cached_asset->data()->begin(),
+                            cached_asset->data()->end());
+  }
+
+  return true;
+}
+
+void BuildCache::save(CacheKey key, uint32_t converter_version,
+                      const ConvertedAssets& converted) {
+  flatbuffers::FlatBufferBuilder fbb;
+
+  std::vector<flatbuffers::Offset<assets::CachedAsset>> cached_assets;
+
+  for (const auto& asset_data : converted) {
+    auto data_offset = fbb.CreateVector(asset_data);
+
+    assets::CachedAssetBuilder cached_asset(fbb);
+    cached_asset.add_data(data_offset);
+    cached_assets.push_back(cached_asset.Finish());
+  }
+
+  auto assets_offset = fbb.CreateVector(cached_assets);
+
+  assets::BuildCacheEntryBuilder entry(fbb);
+  entry.add_version(MONDRADIKO_ASSET_VERSION);
+  entry.add_converter_version(converter_version);
+  entry.add_assets(assets_offset);
+  fbb.Finish(entry.Finish());
+
+  // Write to a temporary file first so that interrupted builds never leave a
+  // partially written entry behind
+  auto entry_path = getEntryPath(key);
+  auto temp_path = entry_path;
+  temp_path += ".tmp" + std::to_string(temp_counter++);
+
+  std::ofstream entry_file(temp_path.c_str(), std::ofstream::binary);
+  entry_file.write(reinterpret_cast<char*>(fbb.GetBufferPointer()),
+                   fbb.GetSize());
+  entry_file.close();
+
+  std::error_code ec;
+
+  if (entry_file.fail()) {
+    log_wrn_fmt("Failed to write build cache entry %s", entry_path.c_str());
+    std::filesystem::remove(temp_path, ec);
+    return;
+  }
+
+  std::filesystem::rename(temp_path, entry_path, ec);
+
+  if (ec) {
+    log_wrn_fmt("Failed to write build cache entry %s", entry_path.c_str());
+    std::filesystem::remove(temp_path, ec);
+  }
+}
+
+std::filesystem::path BuildCache::getEntryPath(CacheKey key) {
+  char entry_name[32];
+  snprintf(entry_name, sizeof(entry_name), "%016lx.bin", key);
+  return cache_root / entry_name;
+}
+
+}  // namespace mondradiko
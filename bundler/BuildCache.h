@@ -0,0 +1,41 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace mondradiko {
+
+/**
+ * @brief Content-addressed cache of converted manifest entries.
+ * Entries are keyed by a hash of their source files, asset type,
+ * converter version and converter options, and hold every serialized asset
+ * the conversion added.
+ */
+class BuildCache {
+ public:
+  using CacheKey = uint64_t;
+  using ConvertedAssets = std::vector<std::vector<uint8_t>>;
+
+  explicit BuildCache(const std::filesystem::path&);
+
+  static bool hashSources(CacheKey*, const std::string&, uint32_t, uint32_t,
+                          const std::vector<std::filesystem::path>&);
+
+  bool load(CacheKey, uint32_t, ConvertedAssets*);
+  void save(CacheKey, uint32_t, const ConvertedAssets&);
+
+ private:
+  std::filesystem::path cache_root;
+
+  // Keeps temporary file names unique across worker threads
+  std::atomic<uint32_t> temp_counter = 0;
+
+  std::filesystem::path getEntryPath(CacheKey);
+};
+
+}  // namespace mondradiko
@@ -3,13 +3,20 @@
 
 #include "bundler/Bundler.h"
 
+#include <deque>
+#include <future>
 #include <string>
+#include <utility>
 
+#include "assets/common/WorkerPool.h"
 #include "bundler/ConverterInterface.h"
 #include "log/log.h"
 
 namespace mondradiko {
 
+// Assets added by the conversion running on this thread
+thread_local BuildCache::ConvertedAssets* current_conversion = nullptr;
+
 Bundler::Bundler(const std::filesystem::path& _manifest_path)
     : manifest_path(_manifest_path) {
   if (std::filesystem::is_directory(manifest_path)) {
@@ -34,14 +41,24 @@ Bundler::Bundler(const std::filesystem::path& _manifest_path)
 
 Bundler::~Bundler() {
   if (bundle_builder != nullptr) delete bundle_builder;
+  if (build_cache != nullptr) delete build_cache;
 }
 
 assets::AssetId Bundler::addAsset(
     ConverterInterface::AssetBuilder* fbb,
     ConverterInterface::AssetOffset asset_offset) {
-  assets::AssetId asset_id;
-  bundle_builder->addAsset(&asset_id, fbb, asset_offset);
-  return asset_id;
+  if (current_conversion == nullptr) {
+    log_ftl("Assets can only be added while converting a manifest entry");
+  }
+
+  fbb->Finish(asset_offset);
+  const uint8_t* asset_data = fbb->GetBufferPointer();
+  size_t asset_size = fbb->GetSize();
+
+  // Assets are added to the bundle later, in manifest order, so that the
+  // bundle's layout doesn't depend on which conversions finish first
+  current_conversion->emplace_back(asset_data, asset_data + asset_size);
+  return assets::AssetBundleBuilder::generateId(asset_data, asset_size);
 }
 
 void Bundler::addConverter(std::string file_format,
@@ -49,24 +66,114 @@ void Bundler::addConverter(std::string file_format,
   converters.emplace(file_format, converter);
 }
 
+assets::LumpCompressionMethod Bundler::parseCompression(
+    const std::string& compression) {
+  if (compression == "none") {
+    return assets::LumpCompressionMethod::None;
+  } else if (compression == "lz4") {
+    return assets::LumpCompressionMethod::LZ4;
+  } else if (compression == "lz4_blocks") {
+    return assets::LumpCompressionMethod::LZ4Blocks;
+  } else if (compression == "zstd") {
+    return assets::LumpCompressionMethod::Zstd;
+  }
+
+  log_ftl_fmt("Unrecognized lump compression %s", compression.c_str());
+  return assets::LumpCompressionMethod::None;
+}
+
+void Bundler::convertEntry(const ManifestEntry& entry,
+                           BuildCache::ConvertedAssets* converted) {
+  log_zone;
+
+  uint32_t converter_version = entry.converter->getVersion();
+  uint32_t converter_options = entry.converter->getOptions();
+
+  BuildCache::CacheKey cache_key;
+  bool cacheable = false;
+
+  if (build_cache != nullptr) {
+    std::vector<std::filesystem::path> sources{entry.path};
+    entry.converter->getDependencies(entry.path, &sources);
+
+    cacheable = BuildCache::hashSources(&cache_key, entry.type,
+                                        converter_version, converter_options,
+                                        sources);
+
+    if (cacheable &&
+        build_cache->load(cache_key, converter_version, converted)) {
+      log_dbg_fmt("Reusing cached %s asset %s", entry.type.c_str(),
+                  entry.path.c_str());
+      return;
+    }
+  }
+
+  log_dbg_fmt("Converting %s asset %s", entry.type.c_str(),
+              entry.path.c_str());
+
+  converted->resize(0);
+  current_conversion = converted;
+
+  try {
+    flatbuffers::FlatBufferBuilder fbb;
+    auto asset_offset = entry.converter->convert(&fbb, entry.path);
+    addAsset(&fbb, asset_offset);
+  } catch (...) {
+    current_conversion = nullptr;
+    throw;
+  }
+
+  current_conversion = nullptr;
+
+  if (cacheable) build_cache->save(cache_key, converter_version, *converted);
+}
+
 void Bundler::bundle() {
+  auto default_compression = assets::LumpCompressionMethod::LZ4;
+
+  if (manifest.contains("compression")) {
+    default_compression = parseCompression(
+        toml::find<std::string>(manifest, "compression"));
+  }
+
+  if (manifest.contains("zstd_level")) {
+    bundle_builder->setZstdLevel(toml::find<int>(manifest, "zstd_level"));
+  }
+
+  if (manifest.contains("zstd_dictionary")) {
+    bundle_builder->setTrainDictionary(
+        toml::find<bool>(manifest, "zstd_dictionary"));
+  }
+
   const auto assets = toml::find<toml::array>(manifest, "assets");
 
+  std::vector<ManifestEntry> entries;
+
   for (const auto& asset_table : assets) {
     const auto& asset = asset_table.as_table();
 
     const auto& asset_file = asset.at("file").as_string();
-    auto asset_path = source_root / asset_file.str;
 
-    std::string asset_type;
-    bool initial_prefab = false;
+    ManifestEntry entry;
+    entry.path = source_root / asset_file.str;
+    entry.compression = default_compression;
+    entry.initial_prefab = false;
 
     {
       auto iter = asset.find("type");
       if (iter != asset.end()) {
-        asset_type = iter->second.as_string().str;
+        entry.type = iter->second.as_string().str;
       } else {
-        asset_type = asset_path.extension().string().substr(1);
+        entry.type = entry.path.extension().string().substr(1);
+      }
+    }
+
+    {
+      // Assets (and their dependencies) are stored in lumps that use the
+      // requested compression
+      auto iter = asset.find("compression");
+      if (iter != asset.end()) {
+        entry.compression = parseCompression(iter->second.as_string().str);
       }
     }
 
@@ -74,36 +181,90 @@ void Bundler::bundle() {
       auto iter = asset.find("initial_prefab");
       if (iter != asset.end()) {
         if (asset.at("initial_prefab").as_boolean()) {
-          initial_prefab = true;
+          entry.initial_prefab = true;
         }
       }
     }
 
     {
-      log_dbg_fmt("Converting %s asset %s", asset_type.c_str(),
-                  asset_path.c_str());
-
-      // TODO(marceline-cramer) Converted asset caching
-      auto iter = converters.find(asset_type);
+      auto iter = converters.find(entry.type);
 
       if (iter == converters.end()) {
-        log_ftl_fmt("Couldn't find converter for %s", asset_type.c_str());
+        log_ftl_fmt("Couldn't find converter for %s", entry.type.c_str());
       }
 
-      flatbuffers::FlatBufferBuilder fbb;
-      auto asset_offset = iter->second->convert(&fbb, asset_path);
+      entry.converter = iter->second;
+    }
+
+    entries.push_back(entry);
+  }
+
+  if (cache_enabled && build_cache == nullptr) {
+    build_cache = new BuildCache(bundle_root / "bundler-cache");
+  }
+
+  // Declared before the worker pool so that it outlives any running jobs
+  std::vector<BuildCache::ConvertedAssets> converted(entries.size());
 
-      assets::AssetId asset_id;
-      bundle_builder->addAsset(&asset_id, &fbb, asset_offset);
-      log_inf_fmt("Added %s asset: 0x%0dx", asset_type.c_str(), asset_id);
+  WorkerPool workers(thread_count);
+  log_dbg_fmt("Bundling with %u threads", workers.getThreadCount());
 
-      if (initial_prefab) {
-        bundle_builder->addInitialPrefab(asset_id);
+  // Lumps are compressed on the same pool while the entries are converted
+  bundle_builder->setWorkers(&workers);
+
+  // Conversions only run this far ahead of the entry being added, so that
+  // converted outputs don't pile up while an earlier entry is still busy
+  const uint32_t max_conversions_in_flight = workers.getThreadCount() * 2;
+
+  std::deque<std::future<void>> conversions;
+  uint32_t next_conversion = 0;
+
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    while (next_conversion < entries.size() &&
+           next_conversion < i + max_conversions_in_flight) {
+      uint32_t index = next_conversion++;
+      conversions.push_back(
+          workers.submit([this, &entries, &converted, index]() {
+            convertEntry(entries[index], &converted[index]);
+          }));
+    }
+
+    // Rethrows any conversion errors
+    conversions.front().get();
+    conversions.pop_front();
+
+    const auto& entry = entries[i];
+    bundle_builder->setLumpCompression(entry.compression);
+
+    assets::AssetId asset_id = assets::AssetId::NullAsset;
+    for (const auto& asset_data : converted[i]) {
+      assets::AssetResult result = bundle_builder->addAsset(
+          &asset_id, asset_data.data(), asset_data.size());
+
+      if (result != assets::AssetResult::Success) {
+        log_ftl_fmt("Failed to add %s asset %s: %s", entry.type.c_str(),
+                    entry.path.c_str(), assets::getAssetResultString(result));
       }
     }
+
+    // The entry's own asset is added last
+    log_inf_fmt("Added %s asset: 0x%0dx", entry.type.c_str(), asset_id);
+
+    if (entry.initial_prefab) {
+      bundle_builder->addInitialPrefab(asset_id);
+    }
+
+    // Free converted assets as soon as they've been copied into lumps
+    BuildCache::ConvertedAssets().swap(converted[i]);
   }
 
-  bundle_builder->buildBundle("registry.bin");
+  assets::AssetResult result = bundle_builder->buildBundle("registry.bin");
+  bundle_builder->setWorkers(nullptr);
+
+  if (result != assets::AssetResult::Success) {
+    log_ftl_fmt("Failed to build bundle: %s",
+                assets::getAssetResultString(result));
+  }
 }
 
 }  // namespace mondradiko
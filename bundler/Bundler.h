@@ -6,8 +6,10 @@
 #include <filesystem>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "bundler/AssetBundleBuilder.h"
+#include "bundler/BuildCache.h"
 #include "bundler/ConverterInterface.h"
 #include "lib/include/toml_headers.h"
 #include "types/assets/SerializedAsset_generated.h"
@@ -19,11 +21,16 @@ class Bundler {
   explicit Bundler(const std::filesystem::path&);
   ~Bundler();
 
+  // Records an asset for the manifest entry being converted on this thread
   assets::AssetId addAsset(ConverterInterface::AssetBuilder*,
                            ConverterInterface::AssetOffset);
   void addConverter(std::string, const ConverterInterface*);
   void bundle();
 
+  // 0 uses one thread per hardware thread
+  void setThreadCount(uint32_t count) { thread_count = count; }
+  void setCacheEnabled(bool enabled) { cache_enabled = enabled; }
+
  private:
   std::filesystem::path manifest_path;
   std::filesystem::path source_root;
@@ -34,6 +41,21 @@ class Bundler {
   assets::AssetBundleBuilder* bundle_builder = nullptr;
 
   std::map<std::string, const ConverterInterface*> converters;
+
+  uint32_t thread_count = 0;
+  bool cache_enabled = true;
+  BuildCache* build_cache = nullptr;
+
+  struct ManifestEntry {
+    std::filesystem::path path;
+    std::string type;
+    const ConverterInterface* converter;
+    assets::LumpCompressionMethod compression;
+    bool initial_prefab;
+  };
+
+  assets::LumpCompressionMethod parseCompression(const std::string&);
+  void convertEntry(const ManifestEntry&, BuildCache::ConvertedAssets*);
 };
 
 }  // namespace mondradiko
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 
 #include "assets/common/AssetTypes.h"
 #include "bundler/AssetBundleBuilder.h"
@@ -22,7 +23,20 @@ class ConverterInterface {
   using AssetOffset = flatbuffers::Offset<assets::SerializedAsset>;
   using AssetBuilder = flatbuffers::FlatBufferBuilder;
 
+  // Called concurrently from the Bundler's worker threads
   virtual AssetOffset convert(AssetBuilder*, std::filesystem::path) const = 0;
+
+  // Bump whenever a converter's output changes, to invalidate cached
+  // conversions made by older versions
+  virtual uint32_t getVersion() const = 0;
+
+  // Bit flags of the options that change a converter's output, which are
+  // also part of the build cache key
+  virtual uint32_t getOptions() const { return 0; }
+
+  // Files other than the source file that a conversion reads
+  virtual void getDependencies(const std::filesystem::path&,
+                               std::vector<std::filesystem::path>*) const {}
 };
 
 }  // namespace mondradiko
@@ -0,0 +1,279 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "bundler/LumpWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "log/log.h"
+#include "lz4hc.h"  // NOLINT
+
+namespace mondradiko {
+namespace assets {
+
+// Input is fed to the compressors in chunks of this size, which bounds the
+// size of the output buffer
+const size_t LUMP_WRITE_CHUNK_SIZE = 64 * 1024;  // 64 KiB
+
+LumpWriter::LumpWriter(const std::filesystem::path& lump_path,
+                       LumpCompressionMethod compression_method,
+                       int zstd_level)
+    : lump_path(lump_path), compression_method(compression_method) {
+  lump_file.open(lump_path.c_str(), std::ofstream::binary);
+
+  if (!lump_file.is_open()) {
+    log_err_fmt("Failed to open lump %s for writing", lump_path.c_str());
+    failed = true;
+  }
+
+  hash_state = XXH3_createState();
+  XXH3_64bits_reset(hash_state);
+
+  switch (compression_method) {
+    case LumpCompressionMethod::LZ4: {
+      LZ4F_createCompressionContext(&lz4_context, LZ4F_VERSION);
+
+      // The content size isn't known up front, so the registry records it
+      memset(&lz4_preferences, 0, sizeof(lz4_preferences));
+      lz4_preferences.compressionLevel = LZ4F_compressionLevel_max();
+      lz4_preferences.autoFlush = 1;
+      lz4_preferences.favorDecSpeed = 1;
+
+      size_t out_size =
+          LZ4F_compressBound(LUMP_WRITE_CHUNK_SIZE, &lz4_preferences);
+      out_buffer.resize(std::max(out_size, size_t{LZ4F_HEADER_SIZE_MAX}));
+      break;
+    }
+
+    case LumpCompressionMethod::LZ4Blocks: {
+      block_size = ASSET_LUMP_BLOCK_SIZE;
+      block_buffer.reserve(block_size);
+      out_buffer.resize(LZ4_compressBound(block_size));
+      break;
+    }
+
+    case LumpCompressionMethod::Zstd: {
+      zstd_context = ZSTD_createCCtx();
+      ZSTD_CCtx_setParameter(zstd_context, ZSTD_c_compressionLevel,
+                             zstd_level);
+      out_buffer.resize(ZSTD_CStreamOutSize());
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+}
+
+LumpWriter::~LumpWriter() {
+  if (lz4_context != nullptr) LZ4F_freeCompressionContext(lz4_context);
+  if (zstd_context != nullptr) ZSTD_freeCCtx(zstd_context);
+  if (hash_state != nullptr) XXH3_freeState(hash_state);
+}
+
+void LumpWriter::setDictionary(const ZSTD_CDict* dictionary) {
+  if (started) {
+    log_err("Can't set a lump dictionary after writing has started");
+    return;
+  }
+
+  if (zstd_context != nullptr && dictionary != nullptr) {
+    ZSTD_CCtx_refCDict(zstd_context, dictionary);
+  }
+}
+
+bool LumpWriter::write(const char* data, size_t size) {
+  if (!begin()) return false;
+
+  while (size > 0 && !failed) {
+    size_t chunk_size = std::min(size, LUMP_WRITE_CHUNK_SIZE);
+    writeChunk(data, chunk_size);
+    data += chunk_size;
+    size -= chunk_size;
+  }
+
+  return !failed;
+}
+
+bool LumpWriter::finish() {
+  if (!begin()) return false;
+
+  switch (compression_method) {
+    case LumpCompressionMethod::LZ4: {
+      size_t out_size = LZ4F_compressEnd(lz4_context, out_buffer.data(),
+                                         out_buffer.size(), nullptr);
+
+      if (LZ4F_isError(out_size)) {
+        log_err_fmt("LZ4HC compression failed: %s",
+                    LZ4F_getErrorName(out_size));
+        failed = true;
+        break;
+      }
+
+      writeOut(out_buffer.data(), out_size);
+      break;
+    }
+
+    case LumpCompressionMethod::LZ4Blocks: {
+      compressBlock();
+      block_offsets.push_back(file_size);
+      break;
+    }
+
+    case LumpCompressionMethod::Zstd: {
+      ZSTD_inBuffer input{nullptr, 0, 0};
+      size_t remaining;
+
+      do {
+        ZSTD_outBuffer output{out_buffer.data(), out_buffer.size(), 0};
+        remaining =
+            ZSTD_compressStream2(zstd_context, &output, &input, ZSTD_e_end);
+
+        if (ZSTD_isError(remaining)) {
+          log_err_fmt("Zstandard compression failed: %s",
+                      ZSTD_getErrorName(remaining));
+          failed = true;
+          break;
+        }
+
+        writeOut(out_buffer.data(), output.pos);
+      } while (remaining > 0);
+
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  lump_file.close();
+
+  if (lump_file.fail()) {
+    log_err_fmt("Failed to write lump %s", lump_path.c_str());
+    failed = true;
+  }
+
+  checksum = static_cast<LumpHash>(XXH3_64bits_digest(hash_state));
+  return !failed;
+}
+
+bool LumpWriter::begin() {
+  if (failed) return false;
+  if (started) return true;
+  started = true;
+
+  if (compression_method == LumpCompressionMethod::LZ4) {
+    size_t header_size =
+        LZ4F_compressBegin(lz4_context, out_buffer.data(), out_buffer.size(),
+                           &lz4_preferences);
+
+    if (LZ4F_isError(header_size)) {
+      log_err_fmt("LZ4HC compression failed: %s",
+                  LZ4F_getErrorName(header_size));
+      failed = true;
+      return false;
+    }
+
+    writeOut(out_buffer.data(), header_size);
+  }
+
+  return !failed;
+}
+
+bool LumpWriter::writeChunk(const char* data, size_t size) {
+  switch (compression_method) {
+    case LumpCompressionMethod::LZ4: {
+      size_t out_size =
+          LZ4F_compressUpdate(lz4_context, out_buffer.data(),
+                              out_buffer.size(), data, size, nullptr);
+
+      if (LZ4F_isError(out_size)) {
+        log_err_fmt("LZ4HC compression failed: %s",
+                    LZ4F_getErrorName(out_size));
+        failed = true;
+        break;
+      }
+
+      writeOut(out_buffer.data(), out_size);
+      break;
+    }
+
+    case LumpCompressionMethod::LZ4Blocks: {
+      // Each block is compressed on its own, so that assets can be
+      // decompressed without decompressing the rest of the lump
+      while (size > 0 && !failed) {
+        size_t copy_size = std::min(size, block_size - block_buffer.size());
+        block_buffer.insert(block_buffer.end(), data, data + copy_size);
+        data += copy_size;
+        size -= copy_size;
+
+        if (block_buffer.size() == block_size) compressBlock();
+      }
+
+      break;
+    }
+
+    case LumpCompressionMethod::Zstd: {
+      ZSTD_inBuffer input{data, size, 0};
+
+      while (input.pos < input.size) {
+        ZSTD_outBuffer output{out_buffer.data(), out_buffer.size(), 0};
+        size_t result = ZSTD_compressStream2(zstd_context, &output, &input,
+                                             ZSTD_e_continue);
+
+        if (ZSTD_isError(result)) {
+          log_err_fmt("Zstandard compression failed: %s",
+                      ZSTD_getErrorName(result));
+          failed = true;
+          break;
+        }
+
+        writeOut(out_buffer.data(), output.pos);
+      }
+
+      break;
+    }
+
+    default: {
+      writeOut(data, size);
+      break;
+    }
+  }
+
+  return !failed;
+}
+
+bool LumpWriter::compressBlock() {
+  if (block_buffer.size() == 0) return true;
+
+  block_offsets.push_back(file_size);
+
+  int out_size = LZ4_compress_HC(block_buffer.data(), out_buffer.data(),
+                                 block_buffer.size(), out_buffer.size(),
+                                 LZ4HC_CLEVEL_MAX);
+
+  if (out_size <= 0) {
+    log_err_fmt("LZ4HC compression of block %lu failed",
+                block_offsets.size() - 1);
+    failed = true;
+    return false;
+  }
+
+  writeOut(out_buffer.data(), out_size);
+  block_buffer.clear();
+  return true;
+}
+
+void LumpWriter::writeOut(const char* data, size_t size) {
+  if (failed || size == 0) return;
+
+  lump_file.write(data, size);
+  XXH3_64bits_update(hash_state, data, size);
+  file_size += size;
+}
+
+}  // namespace assets
+}  // namespace mondradiko
@@ -0,0 +1,73 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "assets/common/AssetTypes.h"
+#include "lz4frame.h"  // NOLINT
+#include "xxhash.h"    // NOLINT
+#include "zstd.h"      // NOLINT
+
+namespace mondradiko {
+namespace assets {
+
+/**
+ * @brief Compresses lump contents straight into a lump file.
+ * Only a bounded amount of data is buffered at any time, and the file's
+ * checksum is computed incrementally as it's written.
+ */
+class LumpWriter {
+ public:
+  LumpWriter(const std::filesystem::path&, LumpCompressionMethod, int);
+  ~LumpWriter();
+
+  // Must be called before any data is written
+  void setDictionary(const ZSTD_CDict*);
+
+  bool write(const char*, size_t);
+  bool finish();
+
+  size_t getFileSize() const { return file_size; }
+  LumpHash getChecksum() const { return checksum; }
+
+  // Only used by LZ4Blocks
+  uint32_t getBlockSize() const { return block_size; }
+  const std::vector<uint64_t>& getBlockOffsets() const {
+    return block_offsets;
+  }
+
+ private:
+  std::filesystem::path lump_path;
+  LumpCompressionMethod compression_method;
+
+  std::ofstream lump_file;
+  size_t file_size = 0;
+  bool started = false;
+  bool failed = false;
+
+  XXH3_state_t* hash_state = nullptr;
+  LumpHash checksum = 0;
+
+  std::vector<char> out_buffer;
+
+  LZ4F_cctx* lz4_context = nullptr;
+  LZ4F_preferences_t lz4_preferences;
+
+  ZSTD_CCtx* zstd_context = nullptr;
+
+  uint32_t block_size = 0;
+  std::vector<char> block_buffer;
+  std::vector<uint64_t> block_offsets;
+
+  bool begin();
+  bool writeChunk(const char*, size_t);
+  bool compressBlock();
+  void writeOut(const char*, size_t);
+};
+
+}  // namespace assets
+}  // namespace mondradiko
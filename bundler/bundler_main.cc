@@ -18,6 +18,11 @@ using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
 
 struct BundlerArgs {
   std::string manifest_file;
+  uint32_t jobs = 0;
+  bool no_cache = false;
+  bool optimize_meshes = false;
+  bool compact_vertices = false;
+  bool compress_textures = false;
 
   int parse(int, const char * const[]);
 };
@@ -29,6 +34,16 @@ int BundlerArgs::parse(int argc, const char * const argv[]) {
 
   app.add_option("manifest_file", manifest_file, "bundler-manifest.toml")
     ->required()->check(CLI::ExistingFile);
+  app.add_option("-j,--jobs", jobs,
+                 "Number of worker threads (0 for one per hardware thread)",
+                 true);
+  app.add_flag("--no-cache", no_cache, "Convert every asset from scratch");
+  app.add_flag("--optimize-meshes", optimize_meshes,
+               "Weld and reorder mesh vertices and triangles for rendering");
+  app.add_flag("--compact-vertices", compact_vertices,
+               "Quantize mesh vertices to 20 bytes each");
+  app.add_flag("--compress-textures", compress_textures,
+               "Block-compress textures with BC4, BC5, or BC7");
 
   CLI11_PARSE(app, argc, argv);
   return -1;
@@ -45,12 +60,20 @@ int main(int argc, char* argv[]) {
 
   try {
     Bundler bundler(args.manifest_file);
+    bundler.setThreadCount(args.jobs);
+    bundler.setCacheEnabled(!args.no_cache);
 
     BinaryGltfConverter binary_gltf_converter(&bundler);
+    binary_gltf_converter.setOptimizeMeshes(args.optimize_meshes);
+    binary_gltf_converter.setCompactVertices(args.compact_vertices);
+    binary_gltf_converter.setCompressTextures(args.compress_textures);
     bundler.addConverter("glb", &binary_gltf_converter);
     bundler.addConverter("vrm", &binary_gltf_converter);
 
     TextGltfConverter text_gltf_converter(&bundler);
+    text_gltf_converter.setOptimizeMeshes(args.optimize_meshes);
+    text_gltf_converter.setCompactVertices(args.compact_vertices);
+    text_gltf_converter.setCompressTextures(args.compress_textures);
     bundler.addConverter("gltf", &text_gltf_converter);
 
     WasmConverter wasm_converter(&bundler);
@@ -7,6 +7,9 @@
 #include <vector>
 
 #include "bundler/Bundler.h"
+#include "bundler/prefab/MeshOptimizer.h"
+#include "bundler/prefab/MeshQuantizer.h"
+#include "bundler/prefab/TextureEncoder.h"
 #include "log/log.h"
 #include "types/assets/PrefabAsset_generated.h"
 
@@ -14,6 +17,14 @@ namespace mondradiko {
 
 GltfConverter::GltfConverter(Bundler *bundler) : _bundler(bundler) {}
 
+uint32_t GltfConverter::getOptions() const {
+  uint32_t options = 0;
+  if (_optimize_meshes) options |= OPTIMIZE_MESHES;
+  if (_compact_vertices) options |= COMPACT_VERTICES;
+  if (_compress_textures) options |= COMPRESS_TEXTURES;
+  return options;
+}
+
 GltfConverter::AssetOffset GltfConverter::_loadModel(AssetBuilder *fbb,
                                                      GltfModel model) const {
   std::vector<uint32_t> children;
@@ -103,41 +114,45 @@ assets::AssetId GltfConverter::_loadNode(GltfModel model, GltfNode node,
     const auto &mesh = model.meshes[node.mesh];
 
     for (const auto &primitive : mesh.primitives) {
-      assets::AssetId mesh_id = _loadPrimitive(model, primitive, node_scale);
+      // Primitives too large for 16-bit indices are split into several meshes
+      std::vector<assets::AssetId> mesh_ids;
+      _loadPrimitive(model, primitive, node_scale, &mesh_ids);
 
       const tinygltf::Material &material = model.materials[primitive.material];
       assets::AssetId material_id = _loadMaterial(model, material);
 
-      flatbuffers::FlatBufferBuilder fbb;
+      for (auto mesh_id : mesh_ids) {
+        flatbuffers::FlatBufferBuilder fbb;
 
-      assets::MeshRendererPrefab mesh_renderer;
-      mesh_renderer.mutate_mesh(mesh_id);
-      mesh_renderer.mutate_material(material_id);
+        assets::MeshRendererPrefab mesh_renderer;
+        mesh_renderer.mutate_mesh(mesh_id);
+        mesh_renderer.mutate_material(material_id);
 
-      assets::TransformPrefab transform;
-      transform.mutable_position().mutate_x(node_translation.x);
-      transform.mutable_position().mutate_y(node_translation.y);
-      transform.mutable_position().mutate_z(node_translation.z);
+        assets::TransformPrefab transform;
+        transform.mutable_position().mutate_x(node_translation.x);
+        transform.mutable_position().mutate_y(node_translation.y);
+        transform.mutable_position().mutate_z(node_translation.z);
 
-      transform.mutable_orientation().mutate_w(node_orientation.w);
-      transform.mutable_orientation().mutate_x(node_orientation.x);
-      transform.mutable_orientation().mutate_y(node_orientation.y);
-      transform.mutable_orientation().mutate_z(node_orientation.z);
+        transform.mutable_orientation().mutate_w(node_orientation.w);
+        transform.mutable_orientation().mutate_x(node_orientation.x);
+        transform.mutable_orientation().mutate_y(node_orientation.y);
+        transform.mutable_orientation().mutate_z(node_orientation.z);
 
-      assets::PrefabAssetBuilder prefab(fbb);
-      prefab.add_mesh_renderer(&mesh_renderer);
-      prefab.add_transform(&transform);
-      auto prefab_offset = prefab.Finish();
+        assets::PrefabAssetBuilder prefab(fbb);
+        prefab.add_mesh_renderer(&mesh_renderer);
+        prefab.add_transform(&transform);
+        auto prefab_offset = prefab.Finish();
 
-      assets::SerializedAssetBuilder asset(fbb);
-      asset.add_type(assets::AssetType::PrefabAsset);
-      asset.add_prefab(prefab_offset);
-      auto asset_offset = asset.Finish();
+        assets::SerializedAssetBuilder asset(fbb);
+        asset.add_type(assets::AssetType::PrefabAsset);
+        asset.add_prefab(prefab_offset);
+        auto asset_offset = asset.Finish();
 
-      assets::AssetId asset_id = _bundler->addAsset(&fbb, asset_offset);
-      log_dbg_fmt("Added primitive prefab 0x%0dx", mesh_id);
+        assets::AssetId asset_id = _bundler->addAsset(&fbb, asset_offset);
+        log_dbg_fmt("Added primitive prefab 0x%0dx", mesh_id);
 
-      children.push_back(static_cast<uint32_t>(asset_id));
+        children.push_back(static_cast<uint32_t>(asset_id));
+      }
     }
   }
 
@@ -208,9 +223,9 @@ class GltfAccessor {
   int stride;
 };
 
-assets::AssetId GltfConverter::_loadPrimitive(GltfModel model,
-                                              GltfPrimitive primitive,
-                                              glm::vec3 scale) const {
+void GltfConverter::_loadPrimitive(
+    GltfModel model, GltfPrimitive primitive, glm::vec3 scale,
+    std::vector<assets::AssetId> *mesh_ids) const {
   std::vector<assets::MeshVertex> vertices;
   std::vector<uint32_t> indices;
 
@@ -253,11 +268,11 @@ assets::AssetId GltfConverter::_loadPrimitive(GltfModel model,
       glm::vec3 normal = glm::normalize(
           glm::vec3(normal_raw[0], normal_raw[1], normal_raw[2]));
 
-      assets::Vec3 position_vec(position.x, position.y, position.z);
-      assets::Vec3 normal_vec(normal.x, normal.y, normal.z);
+      assets::Vec3f position_vec(position.x, position.y, position.z);
+      assets::Vec3f normal_vec(normal.x, normal.y, normal.z);
       // TODO(marceline-cramer) Read mesh vertex colors
-      assets::Vec3 color_vec(1.0, 1.0, 1.0);
-      assets::Vec2 tex_coord_vec(tex_coord[0], tex_coord[1]);
+      assets::Vec3f color_vec(1.0, 1.0, 1.0);
+      assets::Vec2f tex_coord_vec(tex_coord[0], tex_coord[1]);
 
       assets::MeshVertex vertex(position_vec, normal_vec, color_vec,
                                 tex_coord_vec);
@@ -306,28 +321,97 @@ assets::AssetId GltfConverter::_loadPrimitive(GltfModel model,
     }
   }
 
-  {
-    log_inf("Writing primitive mesh data");
+  if (_optimize_meshes) {
+    log_inf("Optimizing primitive mesh data");
+    optimizeMesh(&vertices, &indices);
+  }
 
-    flatbuffers::FlatBufferBuilder fbb;
+  if (vertices.size() <= MESH_INDEX16_MAX_VERTICES) {
+    mesh_ids->push_back(_writeMesh(vertices, indices));
+    return;
+  }
 
-    auto vertices_offset = fbb.CreateVectorOfStructs(vertices);
-    auto indices_offset = fbb.CreateVector(indices);
+  log_inf_fmt("Splitting primitive with %zu vertices", vertices.size());
 
-    assets::MeshAssetBuilder mesh_asset(fbb);
-    mesh_asset.add_vertices(vertices_offset);
-    mesh_asset.add_indices(indices_offset);
-    auto mesh_offset = mesh_asset.Finish();
+  std::vector<std::vector<assets::MeshVertex>> chunk_vertices;
+  std::vector<std::vector<uint32_t>> chunk_indices;
+  splitMesh(vertices, indices, MESH_INDEX16_MAX_VERTICES, &chunk_vertices,
+            &chunk_indices);
 
-    assets::SerializedAssetBuilder asset(fbb);
-    asset.add_type(assets::AssetType::MeshAsset);
-    asset.add_mesh(mesh_offset);
-    auto asset_offset = asset.Finish();
+  for (uint32_t i = 0; i < chunk_vertices.size(); i++) {
+    mesh_ids->push_back(_writeMesh(chunk_vertices[i], chunk_indices[i]));
+  }
+}
+
+assets::AssetId GltfConverter::_writeMesh(
+    const std::vector<assets::MeshVertex> &vertices,
+    const std::vector<uint32_t> &indices) const {
+  log_inf("Writing primitive mesh data");
+
+  flatbuffers::FlatBufferBuilder fbb;
 
-    assets::AssetId mesh_id = _bundler->addAsset(&fbb, asset_offset);
-    log_dbg_fmt("Added primitive mesh 0x%0dx", mesh_id);
-    return mesh_id;
+  flatbuffers::Offset<flatbuffers::Vector<const assets::MeshVertex *>>
+      vertices_offset;
+  flatbuffers::Offset<
+      flatbuffers::Vector<const assets::CompactMeshVertex *>>
+      compact_vertices_offset;
+  assets::Vec3 bounds_min;
+  assets::Vec3 bounds_max;
+  assets::Vec3 bounds_center;
+  float bounds_radius;
+  computeMeshBounds(vertices, &bounds_min, &bounds_max, &bounds_center,
+                    &bounds_radius);
+
+  if (_compact_vertices) {
+    std::vector<assets::CompactMeshVertex> compact_vertices;
+    quantizeVertices(vertices, &compact_vertices, &bounds_min, &bounds_max);
+    compact_vertices_offset = fbb.CreateVectorOfStructs(compact_vertices);
+  } else {
+    vertices_offset = fbb.CreateVectorOfStructs(vertices);
   }
+
+  // Primitive restart is disabled, so every 16-bit value is a valid index
+  bool use_indices16 = vertices.size() <= MESH_INDEX16_MAX_VERTICES;
+
+  flatbuffers::Offset<flatbuffers::Vector<uint32_t>> indices_offset;
+  flatbuffers::Offset<flatbuffers::Vector<uint16_t>> indices16_offset;
+
+  if (use_indices16) {
+    std::vector<uint16_t> indices16(indices.begin(), indices.end());
+    indices16_offset = fbb.CreateVector(indices16);
+  } else {
+    indices_offset = fbb.CreateVector(indices);
+  }
+
+  assets::MeshAssetBuilder mesh_asset(fbb);
+
+  if (use_indices16) {
+    mesh_asset.add_indices16(indices16_offset);
+  } else {
+    mesh_asset.add_indices(indices_offset);
+  }
+
+  if (_compact_vertices) {
+    mesh_asset.add_compact_vertices(compact_vertices_offset);
+  } else {
+    mesh_asset.add_vertices(vertices_offset);
+  }
+
+  mesh_asset.add_bounds_min(&bounds_min);
+  mesh_asset.add_bounds_max(&bounds_max);
+  mesh_asset.add_bounds_center(&bounds_center);
+  mesh_asset.add_bounds_radius(bounds_radius);
+
+  auto mesh_offset = mesh_asset.Finish();
+
+  assets::SerializedAssetBuilder asset(fbb);
+  asset.add_type(assets::AssetType::MeshAsset);
+  asset.add_mesh(mesh_offset);
+  auto asset_offset = asset.Finish();
+
+  assets::AssetId mesh_id = _bundler->addAsset(&fbb, asset_offset);
+  log_dbg_fmt("Added primitive mesh 0x%0dx", mesh_id);
+  return mesh_id;
 }
 
 // Helper function to load vectors
@@ -403,9 +487,26 @@ assets::AssetId GltfConverter::_loadImage(GltfModel model, GltfImage image,
   log_inf_fmt("Bits/channel:\t%d", image.bits);
   log_inf_fmt("Size:\t\t%dx%d", image.width, image.height);
 
-  auto data_offset =
-      fbb.CreateVector(reinterpret_cast<const uint8_t *>(image.image.data()),
-                       image.image.size());
+  // Only 8-bit RGBA images are mipmapped and compressed
+  bool encode = image.component == 4 && image.bits == 8 &&
+                image.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE &&
+                image.image.size() ==
+                    static_cast<size_t>(image.width) * image.height * 4;
+
+  assets::TextureFormat format = assets::TextureFormat::Uncompressed;
+  uint32_t mip_levels = 1;
+  flatbuffers::Offset<flatbuffers::Vector<uint8_t>> data_offset;
+
+  if (encode) {
+    std::vector<uint8_t> encoded;
+    encodeTexture(image.image.data(), image.width, image.height, srgb,
+                  _compress_textures, &format, &mip_levels, &encoded);
+    data_offset = fbb.CreateVector(encoded);
+  } else {
+    data_offset =
+        fbb.CreateVector(reinterpret_cast<const uint8_t *>(image.image.data()),
+                         image.image.size());
+  }
 
   assets::TextureAssetBuilder texture(fbb);
 
@@ -437,6 +538,8 @@ assets::AssetId GltfConverter::_loadImage(GltfModel model, GltfImage image,
   texture.add_height(image.height);
   texture.add_srgb(srgb);
   texture.add_data(data_offset);
+  texture.add_mip_levels(mip_levels);
+  texture.add_format(format);
   auto texture_offset = texture.Finish();
 
   assets::SerializedAssetBuilder asset(fbb);
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "bundler/ConverterInterface.h"
 #include "lib/include/tinygltf_headers.h"
 
@@ -12,9 +14,31 @@ class GltfConverter : public ConverterInterface {
  public:
   explicit GltfConverter(Bundler*);
 
+  // ConverterInterface implementation
+  uint32_t getVersion() const override { return 5; }
+  uint32_t getOptions() const override;
+
+  // Welds and reorders mesh data for the GPU's vertex cache and fetches
+  void setOptimizeMeshes(bool optimize) { _optimize_meshes = optimize; }
+
+  // Writes meshes in the compact, quantized vertex format
+  void setCompactVertices(bool compact) { _compact_vertices = compact; }
+
+  // Block-compresses every level of eligible textures
+  void setCompressTextures(bool compress) { _compress_textures = compress; }
+
  protected:
   Bundler* _bundler;
 
+  bool _optimize_meshes = false;
+  bool _compact_vertices = false;
+  bool _compress_textures = false;
+
+  // Option flags
+  static constexpr uint32_t OPTIMIZE_MESHES = 1 << 0;
+  static constexpr uint32_t COMPACT_VERTICES = 1 << 1;
+  static constexpr uint32_t COMPRESS_TEXTURES = 1 << 2;
+
   // Shorthand types for library objects
   using GltfModel = const tinygltf::Model&;
   using GltfScene = const tinygltf::Scene&;
@@ -27,7 +51,10 @@ class GltfConverter : public ConverterInterface {
   AssetOffset _loadModel(AssetBuilder*, GltfModel) const;
   assets::AssetId _loadScene(GltfModel, GltfScene) const;
   assets::AssetId _loadNode(GltfModel, GltfNode, glm::vec3) const;
-  assets::AssetId _loadPrimitive(GltfModel, GltfPrimitive, glm::vec3) const;
+  void _loadPrimitive(GltfModel, GltfPrimitive, glm::vec3,
+                      std::vector<assets::AssetId>*) const;
+  assets::AssetId _writeMesh(const std::vector<assets::MeshVertex>&,
+                             const std::vector<uint32_t>&) const;
   assets::AssetId _loadMaterial(GltfModel, GltfMaterial) const;
   assets::AssetId _loadTexture(GltfModel, GltfTextureInfo, bool) const;
   assets::AssetId _loadImage(GltfModel, GltfImage, bool) const;
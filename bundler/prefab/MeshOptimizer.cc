@@ -0,0 +1,259 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "bundler/prefab/MeshOptimizer.h"
+
+#include <cstring>
+#include <unordered_map>
+
+#include "log/log.h"
+#include "xxhash.h"  // NOLINT
+
+namespace mondradiko {
+
+void optimizeMesh(std::vector<assets::MeshVertex>* vertices,
+                  std::vector<uint32_t>* indices) {
+  log_zone;
+
+  if (indices->size() % 3 != 0) {
+    log_wrn("Skipping optimization of mesh that isn't a triangle list");
+    return;
+  }
+
+  for (auto index : *indices) {
+    if (index >= vertices->size()) {
+      log_ftl_fmt("Mesh index %u is out of range", index);
+    }
+  }
+
+  size_t vertex_count = vertices->size();
+  double acmr = calculateACMR(*indices, vertex_count);
+
+  weldVertices(vertices, indices);
+  optimizeVertexCache(indices, vertices->size());
+  optimizeVertexFetch(vertices, indices);
+
+  log_inf_fmt("Optimized mesh: %zu -> %zu vertices, ACMR %.3f -> %.3f",
+              vertex_count, vertices->size(), acmr,
+              calculateACMR(*indices, vertices->size()));
+}
+
+namespace {
+
+struct VertexHash {
+  size_t operator()(const assets::MeshVertex& vertex) const {
+    return XXH3_64bits(&vertex, sizeof(vertex));
+  }
+};
+
+struct VertexEqual {
+  bool operator()(const assets::MeshVertex& a,
+                  const assets::MeshVertex& b) const {
+    return memcmp(&a, &b, sizeof(assets::MeshVertex)) == 0;
+  }
+};
+
+}  // namespace
+
+void weldVertices(std::vector<assets::MeshVertex>* vertices,
+                  std::vector<uint32_t>* indices) {
+  std::unordered_map<assets::MeshVertex, uint32_t, VertexHash, VertexEqual>
+      unique_vertices;
+  unique_vertices.reserve(vertices->size());
+
+  std::vector<uint32_t> remap(vertices->size());
+  std::vector<assets::MeshVertex> welded;
+
+  for (uint32_t i = 0; i < vertices->size(); i++) {
+    const auto& vertex = (*vertices)[i];
+    auto result = unique_vertices.emplace(vertex, welded.size());
+    if (result.second) welded.push_back(vertex);
+    remap[i] = result.first->second;
+  }
+
+  for (auto& index : *indices) index = remap[index];
+  vertices->swap(welded);
+}
+
+void optimizeVertexCache(std::vector<uint32_t>* indices,
+                         uint32_t vertex_count) {
+  const uint32_t cache_size = MESH_VERTEX_CACHE_SIZE;
+  uint32_t triangle_count = indices->size() / 3;
+
+  // Triangles adjacent to each vertex, packed by vertex
+  std::vector<uint32_t> live_triangles(vertex_count, 0);
+  for (auto index : *indices) live_triangles[index]++;
+
+  std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangles[v];
+  }
+
+  std::vector<uint32_t> adjacency(indices->size());
+  {
+    std::vector<uint32_t> fill(adjacency_offsets.begin(),
+                               adjacency_offsets.end() - 1);
+    for (uint32_t i = 0; i < indices->size(); i++) {
+      uint32_t v = (*indices)[i];
+      adjacency[fill[v]++] = i / 3;
+    }
+  }
+
+  // A vertex is in the cache if it was last transformed within cache_size
+  // cache misses of the current time
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> dead_end;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  output.reserve(indices->size());
+
+  // Fan around one vertex at a time, moving on to whichever candidate is
+  // most likely to still be in the cache after its own fan is emitted
+  uint32_t scan_cursor = 0;
+  int64_t fanning = vertex_count > 0 ? 0 : -1;
+
+  while (fanning >= 0) {
+    candidates.clear();
+
+    uint32_t begin = adjacency_offsets[fanning];
+    uint32_t end = adjacency_offsets[fanning + 1];
+
+    for (uint32_t a = begin; a < end; a++) {
+      uint32_t triangle = adjacency[a];
+      if (emitted[triangle]) continue;
+      emitted[triangle] = true;
+
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t v = (*indices)[triangle * 3 + corner];
+        output.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live_triangles[v]--;
+
+        if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+      }
+    }
+
+    fanning = -1;
+    uint32_t best_score = 0;
+
+    for (auto v : candidates) {
+      if (live_triangles[v] == 0) continue;
+
+      // Prefer vertices that will stay cached while their fan is emitted
+      uint32_t score = 0;
+      if (time - cache_time[v] + 2 * live_triangles[v] <= cache_size) {
+        score = time - cache_time[v];
+      }
+
+      if (fanning < 0 || score > best_score) {
+        fanning = v;
+        best_score = score;
+      }
+    }
+
+    // Dead end: back up to a recently used vertex, or scan for any other
+    while (fanning < 0 && !dead_end.empty()) {
+      uint32_t v = dead_end.back();
+      dead_end.pop_back();
+      if (live_triangles[v] > 0) fanning = v;
+    }
+
+    while (fanning < 0 && scan_cursor < vertex_count) {
+      if (live_triangles[scan_cursor] > 0) fanning = scan_cursor;
+      scan_cursor++;
+    }
+  }
+
+  indices->swap(output);
+}
+
+void optimizeVertexFetch(std::vector<assets::MeshVertex>* vertices,
+                         std::vector<uint32_t>* indices) {
+  const uint32_t unused = ~0u;
+  std::vector<uint32_t> remap(vertices->size(), unused);
+  std::vector<assets::MeshVertex> reordered;
+  reordered.reserve(vertices->size());
+
+  for (auto& index : *indices) {
+    if (remap[index] == unused) {
+      remap[index] = reordered.size();
+      reordered.push_back((*vertices)[index]);
+    }
+
+    index = remap[index];
+  }
+
+  vertices->swap(reordered);
+}
+
+void splitMesh(const std::vector<assets::MeshVertex>& vertices,
+               const std::vector<uint32_t>& indices, uint32_t max_vertices,
+               std::vector<std::vector<assets::MeshVertex>>* chunk_vertices,
+               std::vector<std::vector<uint32_t>>* chunk_indices) {
+  chunk_vertices->resize(0);
+  chunk_indices->resize(0);
+
+  // Index of each vertex within the chunk that remap_chunk says it's in
+  std::vector<uint32_t> remap(vertices.size());
+  std::vector<uint32_t> remap_chunk(vertices.size(), ~0u);
+
+  for (uint32_t i = 0; i + 2 < indices.size(); i += 3) {
+    uint32_t chunk = chunk_vertices->size() - 1;
+
+    uint32_t new_vertices = 0;
+    if (chunk_vertices->size() > 0) {
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        if (remap_chunk[indices[i + corner]] != chunk) new_vertices++;
+      }
+    }
+
+    if (chunk_vertices->size() == 0 ||
+        chunk_vertices->back().size() + new_vertices > max_vertices) {
+      chunk_vertices->emplace_back();
+      chunk_indices->emplace_back();
+      chunk = chunk_vertices->size() - 1;
+    }
+
+    auto& chunk_vertex_list = chunk_vertices->back();
+    auto& chunk_index_list = chunk_indices->back();
+
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      uint32_t v = indices[i + corner];
+
+      if (remap_chunk[v] != chunk) {
+        remap_chunk[v] = chunk;
+        remap[v] = chunk_vertex_list.size();
+        chunk_vertex_list.push_back(vertices[v]);
+      }
+
+      chunk_index_list.push_back(remap[v]);
+    }
+  }
+
+  log_inf_fmt("Split mesh into %zu chunks", chunk_vertices->size());
+}
+
+double calculateACMR(const std::vector<uint32_t>& indices,
+                     uint32_t vertex_count) {
+  if (indices.size() < 3) return 0.0;
+
+  const uint32_t cache_size = MESH_VERTEX_CACHE_SIZE;
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  uint32_t misses = 0;
+
+  for (auto v : indices) {
+    if (time - cache_time[v] > cache_size) {
+      cache_time[v] = time++;
+      misses++;
+    }
+  }
+
+  return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+}  // namespace mondradiko
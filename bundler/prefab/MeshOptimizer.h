@@ -0,0 +1,45 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "types/assets/MeshAsset_generated.h"
+
+namespace mondradiko {
+
+// Size of the FIFO post-transform cache that meshes are optimized for
+const uint32_t MESH_VERTEX_CACHE_SIZE = 16;
+
+// Largest vertex count that can be addressed with 16-bit indices
+const uint32_t MESH_INDEX16_MAX_VERTICES = 1 << 16;
+
+/**
+ * @brief Runs every mesh optimization on a triangle list, in place.
+ * Logs the vertex counts and ACMR before and after optimizing.
+ */
+void optimizeMesh(std::vector<assets::MeshVertex>*, std::vector<uint32_t>*);
+
+// Merges bitwise-identical vertices and remaps the indices to them
+void weldVertices(std::vector<assets::MeshVertex>*, std::vector<uint32_t>*);
+
+// Reorders triangles for post-transform cache hits (Tipsify)
+void optimizeVertexCache(std::vector<uint32_t>*, uint32_t);
+
+// Reorders vertices by first use and drops unreferenced ones
+void optimizeVertexFetch(std::vector<assets::MeshVertex>*,
+                         std::vector<uint32_t>*);
+
+// Splits a triangle list into chunks of at most the given vertex count,
+// keeping triangles in order
+void splitMesh(const std::vector<assets::MeshVertex>&,
+               const std::vector<uint32_t>&, uint32_t,
+               std::vector<std::vector<assets::MeshVertex>>*,
+               std::vector<std::vector<uint32_t>>*);
+
+// Average cache miss ratio: transformed vertices per triangle
+double calculateACMR(const std::vector<uint32_t>&, uint32_t);
+
+}  // namespace mondradiko
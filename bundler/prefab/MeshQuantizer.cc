@@ -0,0 +1,111 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "bundler/prefab/MeshQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "lib/include/glm_headers.h"
+
+namespace mondradiko {
+
+static uint16_t quantizeUnorm16(float value) {
+  return static_cast<uint16_t>(
+      std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+static int16_t quantizeSnorm16(float value) {
+  return static_cast<int16_t>(
+      std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint8_t quantizeUnorm8(float value) {
+  return static_cast<uint8_t>(
+      std::round(glm::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// Projects a unit vector onto an octahedron, then unfolds it into a square
+static glm::vec2 encodeOctahedral(glm::vec3 normal) {
+  normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  glm::vec2 encoded(normal.x, normal.y);
+
+  if (normal.z < 0.0f) {
+    encoded.x = (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+    encoded.y = (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+  }
+
+  return encoded;
+}
+
+void computeMeshBounds(const std::vector<assets::MeshVertex>& vertices,
+                       assets::Vec3* bounds_min, assets::Vec3* bounds_max,
+                       assets::Vec3* bounds_center, float* bounds_radius) {
+  glm::vec3 min_position(std::numeric_limits<float>::max());
+  glm::vec3 max_position(std::numeric_limits<float>::lowest());
+
+  for (const auto& vertex : vertices) {
+    glm::vec3 position = assets::Vec3ToGlm(vertex.position());
+    min_position = glm::min(min_position, position);
+    max_position = glm::max(max_position, position);
+  }
+
+  if (vertices.size() == 0) {
+    min_position = glm::vec3(0.0);
+    max_position = glm::vec3(0.0);
+  }
+
+  glm::vec3 center = (min_position + max_position) * 0.5f;
+  float radius_squared = 0.0f;
+
+  for (const auto& vertex : vertices) {
+    glm::vec3 offset = assets::Vec3ToGlm(vertex.position()) - center;
+    radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+  }
+
+  *bounds_min = assets::Vec3(min_position.x, min_position.y, min_position.z);
+  *bounds_max = assets::Vec3(max_position.x, max_position.y, max_position.z);
+  *bounds_center = assets::Vec3(center.x, center.y, center.z);
+  *bounds_radius = std::sqrt(radius_squared);
+}
+
+void quantizeVertices(const std::vector<assets::MeshVertex>& vertices,
+                      std::vector<assets::CompactMeshVertex>* compact,
+                      assets::Vec3* bounds_min, assets::Vec3* bounds_max) {
+  assets::Vec3 bounds_center;
+  float bounds_radius;
+  computeMeshBounds(vertices, bounds_min, bounds_max, &bounds_center,
+                    &bounds_radius);
+
+  glm::vec3 min_position = assets::Vec3ToGlm(*bounds_min);
+  glm::vec3 max_position = assets::Vec3ToGlm(*bounds_max);
+
+  // Flat axes decode to the minimum no matter what is stored
+  glm::vec3 extent = max_position - min_position;
+  glm::vec3 inverse_extent(0.0);
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] > 0.0f) inverse_extent[axis] = 1.0f / extent[axis];
+  }
+
+  compact->resize(0);
+  compact->reserve(vertices.size());
+
+  for (const auto& vertex : vertices) {
+    glm::vec3 position =
+        (assets::Vec3ToGlm(vertex.position()) - min_position) * inverse_extent;
+    glm::vec2 normal =
+        encodeOctahedral(glm::normalize(assets::Vec3ToGlm(vertex.normal())));
+    glm::vec3 color = assets::Vec3ToGlm(vertex.color());
+    glm::vec2 tex_coord = assets::Vec2ToGlm(vertex.tex_coord());
+
+    compact->emplace_back(
+        quantizeUnorm16(position.x), quantizeUnorm16(position.y),
+        quantizeUnorm16(position.z), 0, quantizeSnorm16(normal.x),
+        quantizeSnorm16(normal.y), quantizeUnorm8(color.r),
+        quantizeUnorm8(color.g), quantizeUnorm8(color.b), 255,
+        glm::packHalf1x16(tex_coord.x), glm::packHalf1x16(tex_coord.y));
+  }
+}
+
+}  // namespace mondradiko
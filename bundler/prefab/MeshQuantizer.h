@@ -0,0 +1,29 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "types/assets/MeshAsset_generated.h"
+
+namespace mondradiko {
+
+/**
+ * @brief Computes the bounds of every vertex position.
+ * The bounding sphere is centered on the box, with the radius of the
+ * farthest vertex from that center.
+ */
+void computeMeshBounds(const std::vector<assets::MeshVertex>&, assets::Vec3*,
+                       assets::Vec3*, assets::Vec3*, float*);
+
+/**
+ * @brief Encodes vertices into the compact vertex format.
+ * Positions are normalized to the bounds of all vertices, which are
+ * returned so the runtime can decode them.
+ */
+void quantizeVertices(const std::vector<assets::MeshVertex>&,
+                      std::vector<assets::CompactMeshVertex>*, assets::Vec3*,
+                      assets::Vec3*);
+
+}  // namespace mondradiko
@@ -3,8 +3,10 @@
 
 #include "bundler/prefab/TextGltfConverter.h"
 
+#include <fstream>
 #include <string>
 
+#include "lib/third_party/json.hpp"
 #include "log/log.h"
 
 namespace mondradiko {
@@ -29,4 +31,34 @@ ConverterInterface::AssetOffset TextGltfConverter::convert(
   return _loadModel(fbb, gltf_model);
 }
 
+void TextGltfConverter::getDependencies(
+    const std::filesystem::path& model_path,
+    std::vector<std::filesystem::path>* dependencies) const {
+  std::ifstream model_file(model_path.c_str());
+  auto model_json = nlohmann::json::parse(model_file, nullptr, false);
+
+  if (model_json.is_discarded()) {
+    // convert() will report the error
+    return;
+  }
+
+  // External buffers and images are resolved relative to the model
+  for (const char* resource_type : {"buffers", "images"}) {
+    auto resources = model_json.find(resource_type);
+    if (resources == model_json.end() || !resources->is_array()) continue;
+
+    for (const auto& resource : *resources) {
+      auto uri = resource.find("uri");
+      if (uri == resource.end() || !uri->is_string()) continue;
+
+      std::string uri_string = uri->get<std::string>();
+
+      // Embedded data URIs are already covered by the model's hash
+      if (uri_string.rfind("data:", 0) == 0) continue;
+
+      dependencies->push_back(model_path.parent_path() / uri_string);
+    }
+  }
+}
+
 }  // namespace mondradiko
@@ -13,6 +13,8 @@ class TextGltfConverter : public GltfConverter {
 
   // ConverterInterface implementation
   AssetOffset convert(AssetBuilder*, std::filesystem::path) const final;
+  void getDependencies(const std::filesystem::path&,
+                       std::vector<std::filesystem::path>*) const final;
 };
 
 }  // namespace mondradiko
@@ -0,0 +1,121 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "bundler/prefab/TextureEncoder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "assets/common/TextureCompression.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+static float srgbToLinear(float value) {
+  if (value <= 0.04045f) return value / 12.92f;
+  return std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value) {
+  if (value <= 0.0031308f) return value * 12.92f;
+  return 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Averages each 2x2 footprint; sRGB color is averaged in linear space
+static void downsample(const std::vector<uint8_t>& source, uint32_t width,
+                       uint32_t height, bool srgb,
+                       std::vector<uint8_t>* target) {
+  uint32_t target_width = std::max(width / 2, 1u);
+  uint32_t target_height = std::max(height / 2, 1u);
+  target->resize(static_cast<size_t>(target_width) * target_height * 4);
+
+  float to_linear[256];
+  for (uint32_t i = 0; i < 256; i++) {
+    to_linear[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+  }
+
+  for (uint32_t y = 0; y < target_height; y++) {
+    for (uint32_t x = 0; x < target_width; x++) {
+      float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+      for (uint32_t dy = 0; dy < 2; dy++) {
+        uint32_t source_y = std::min(y * 2 + dy, height - 1);
+
+        for (uint32_t dx = 0; dx < 2; dx++) {
+          uint32_t source_x = std::min(x * 2 + dx, width - 1);
+          const uint8_t* texel =
+              &source[(static_cast<size_t>(source_y) * width + source_x) * 4];
+
+          for (uint32_t c = 0; c < 3; c++) sum[c] += to_linear[texel[c]];
+          sum[3] += texel[3] / 255.0f;
+        }
+      }
+
+      uint8_t* texel =
+          &(*target)[(static_cast<size_t>(y) * target_width + x) * 4];
+
+      for (uint32_t c = 0; c < 4; c++) {
+        float value = sum[c] / 4.0f;
+        if (srgb && c < 3) value = linearToSrgb(value);
+        texel[c] = static_cast<uint8_t>(
+            std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+      }
+    }
+  }
+}
+
+static assets::TextureFormat chooseFormat(const uint8_t* rgba, size_t texels,
+                                          bool srgb) {
+  // BC4 and BC5 have no sRGB variants
+  if (srgb) return assets::TextureFormat::BC7;
+
+  bool grayscale = true;
+  bool red_green = true;
+
+  for (size_t i = 0; i < texels; i++) {
+    const uint8_t* texel = rgba + i * 4;
+    if (texel[3] != 255) return assets::TextureFormat::BC7;
+    if (texel[0] != texel[1] || texel[0] != texel[2]) grayscale = false;
+    if (texel[2] != 0) red_green = false;
+  }
+
+  if (grayscale) return assets::TextureFormat::BC4;
+  if (red_green) return assets::TextureFormat::BC5;
+  return assets::TextureFormat::BC7;
+}
+
+void encodeTexture(const uint8_t* rgba, uint32_t width, uint32_t height,
+                   bool srgb, bool compress, assets::TextureFormat* format,
+                   uint32_t* mip_levels, std::vector<uint8_t>* data) {
+  log_zone;
+
+  if (compress) {
+    *format = chooseFormat(rgba, static_cast<size_t>(width) * height, srgb);
+  } else {
+    *format = assets::TextureFormat::Uncompressed;
+  }
+
+  std::vector<uint8_t> level(rgba,
+                             rgba + static_cast<size_t>(width) * height * 4);
+  std::vector<uint8_t> next_level;
+
+  *mip_levels = 0;
+  data->resize(0);
+
+  while (true) {
+    assets::compressTextureLevel(*format, level.data(), width, height, data);
+    (*mip_levels)++;
+
+    if (width == 1 && height == 1) break;
+
+    downsample(level, width, height, srgb, &next_level);
+    level.swap(next_level);
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+
+  log_inf_fmt("Encoded %u mip levels as %s (%zu bytes)", *mip_levels,
+              assets::EnumNameTextureFormat(*format), data->size());
+}
+
+}  // namespace mondradiko
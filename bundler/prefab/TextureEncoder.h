@@ -0,0 +1,23 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "types/assets/TextureAsset_generated.h"
+
+namespace mondradiko {
+
+/**
+ * @brief Generates the full mip chain of an RGBA8 image.
+ * If compression is requested, the format is chosen from the image's
+ * contents: BC4 for linear grayscale images, BC5 for linear images that
+ * only use red and green, and BC7 for everything else. Each level is
+ * appended to the output data, largest first.
+ */
+void encodeTexture(const uint8_t*, uint32_t, uint32_t, bool, bool,
+                   assets::TextureFormat*, uint32_t*, std::vector<uint8_t>*);
+
+}  // namespace mondradiko
@@ -13,6 +13,7 @@ class WasmConverter : public ConverterInterface {
 
   // ConverterInterface implementation
   AssetOffset convert(AssetBuilder*, std::filesystem::path) const final;
+  uint32_t getVersion() const final { return 1; }
 
  private:
   Bundler* _bundler;
@@ -16,6 +16,7 @@
 #include "core/filesystem/Filesystem.h"
 #include "core/gpu/GpuInstance.h"
 #include "core/network/NetworkClient.h"
+#include "core/renderer/CullPass.h"
 #include "core/renderer/MeshPass.h"
 #include "core/renderer/OverlayPass.h"
 #include "core/renderer/Renderer.h"
@@ -58,15 +59,17 @@ int ClientArgs::parse(int argc, const char * const argv[]) {
 bool g_interrupted = false;
 
 void run(const ClientArgs& args) {
-  Filesystem fs;
-  auto config = fs.loadToml(args.config_path);
+  auto config = Filesystem::loadToml(args.config_path);
 
   CVarScope cvars;
+  Filesystem::initCVars(&cvars);
   GlyphLoader::initCVars(&cvars);
   Renderer::initCVars(&cvars);
   NetworkClient::initCVars(&cvars);
+  World::initCVars(&cvars);
   cvars.loadConfig(config);
 
+  Filesystem fs(&cvars);
   for (auto bundle : args.bundle_paths) {
     fs.loadAssetBundle(bundle);
   }
@@ -80,14 +83,16 @@ void run(const ClientArgs& args) {
   }
 
   GlyphLoader glyphs(&cvars, &gpu);
-  World world(&fs, &gpu);
+  World world(&cvars, &fs, &gpu);
 
   Renderer renderer(&cvars, display.get(), &gpu);
   MeshPass mesh_pass(&renderer, &world);
+  CullPass cull_pass(cvars.getChild("renderer"), &renderer, &mesh_pass);
   OverlayPass overlay_pass(cvars.getChild("renderer"), &glyphs, &renderer,
                            &world);
 
   renderer.addRenderPass(&mesh_pass);
+  renderer.addRenderPass(&cull_pass);
   renderer.addRenderPass(&overlay_pass);
 
   UserInterface ui(&glyphs, &renderer);
@@ -21,10 +21,23 @@ class Asset {
 
   virtual bool isLoaded() const { return loaded; }
 
+  // Memory owned by this asset, counted against the AssetPool's budgets
+  size_t getCpuSize() const { return cpu_size; }
+  size_t getGpuSize() const { return gpu_size; }
+
+ protected:
+  // Set by load() implementations
+  size_t cpu_size = 0;
+  size_t gpu_size = 0;
+
  private:
   bool loaded = false;
   uint32_t ref_count = 0;
 
+  // Value of the owning AssetPool's clock when ref_count last reached zero
+  uint64_t released_at = 0;
+  const uint64_t* pool_clock = nullptr;
+
   template <class AssetType>
   friend class AssetHandle;
 
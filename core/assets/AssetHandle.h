@@ -4,46 +4,53 @@
 #pragma once
 
 #include "core/assets/Asset.h"
+#include "core/assets/AssetStorage.h"
 #include "log/log.h"
 
 namespace mondradiko {
 
+/**
+ * @brief Reference-counted reference to an asset in an AssetStorage slot.
+ * Handles are dereferenced through their slot's generation, so a handle
+ * outliving its asset (i.e. one unloaded by AssetPool::unloadAll()) reads
+ * as unloaded instead of pointing into a reused slot.
+ */
 template <class AssetType>
 class AssetHandle {
  public:
-  AssetHandle() : ptr(nullptr) {}
+  AssetHandle() : id(AssetId::NullAsset) {}
 
-  explicit AssetHandle(std::nullptr_t ptr) : id(AssetId::NullAsset), ptr(ptr) {}
+  explicit AssetHandle(std::nullptr_t) : id(AssetId::NullAsset) {}
 
-  explicit AssetHandle(AssetId id, AssetType* ptr) : id(id), ptr(ptr) {
+  explicit AssetHandle(AssetId id, const AssetStorage* storage, uint32_t slot,
+                       uint32_t generation)
+      : id(id), storage(storage), slot(slot), generation(generation) {
     _ref();
   }
 
   explicit AssetHandle(const AssetHandle<AssetType>& other) {
-    id = other.id;
-    ptr = other.ptr;
+    _copy(other);
     _ref();
   }
 
   explicit AssetHandle(AssetHandle<AssetType>&& other) {
-    id = other.id;
-    ptr = other.ptr;
-    _ref();
+    _copy(other);
+    other._reset();
   }
 
   AssetHandle<AssetType>& operator=(const AssetHandle<AssetType>& other) {
+    // Reference first in case other is this handle
+    other._ref();
     _unref();
-    id = other.id;
-    ptr = other.ptr;
-    _ref();
+    _copy(other);
     return *this;
   }
 
   AssetHandle<AssetType>& operator=(AssetHandle<AssetType>&& other) {
+    if (&other == this) return *this;
     _unref();
-    id = other.id;
-    ptr = other.ptr;
-    _ref();
+    _copy(other);
+    other._reset();
     return *this;
   }
 
@@ -55,7 +62,7 @@ class AssetHandle {
       log_err_fmt("Operating on unloaded %s", type_name);
     }
 
-    return ptr;
+    return _get();
   }
 
   operator bool() const { return isLoaded(); }
@@ -66,25 +73,54 @@ class AssetHandle {
   }
 
   bool isLoaded() const {
-    if (ptr != nullptr) return ptr->isLoaded();
+    AssetType* asset = _get();
+    if (asset != nullptr) return asset->isLoaded();
     return false;
   }
 
  private:
   AssetId id;
-  AssetType* ptr;
+  const AssetStorage* storage = nullptr;
+  uint32_t slot = 0;
+  uint32_t generation = 0;
+
+  AssetType* _get() const {
+    if (storage == nullptr) return nullptr;
+
+    // Each storage only holds assets of a single type
+    return static_cast<AssetType*>(storage->get(slot, generation));
+  }
 
-  void _ref() {
-    return;
-    if (ptr != nullptr) {
-      ptr->ref_count++;
+  void _copy(const AssetHandle<AssetType>& other) {
+    id = other.id;
+    storage = other.storage;
+    slot = other.slot;
+    generation = other.generation;
+  }
+
+  void _reset() {
+    id = AssetId::NullAsset;
+    storage = nullptr;
+  }
+
+  void _ref() const {
+    AssetType* asset = _get();
+
+    if (asset != nullptr) {
+      asset->ref_count++;
     }
   }
 
   void _unref() {
-    return;
-    if (ptr != nullptr) {
-      ptr->ref_count--;
+    AssetType* asset = _get();
+
+    if (asset != nullptr) {
+      asset->ref_count--;
+
+      // Start the asset's eviction timer
+      if (asset->ref_count == 0 && asset->pool_clock != nullptr) {
+        asset->released_at = *asset->pool_clock;
+      }
     }
   }
 };
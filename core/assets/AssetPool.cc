@@ -0,0 +1,414 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/assets/AssetPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "assets/common/WorkerPool.h"
+#include "core/cvars/CVarScope.h"
+#include "core/cvars/IntCVar.h"
+
+namespace mondradiko {
+
+void AssetPool::initCVars(CVarScope* cvars) {
+  CVarScope* assets = cvars->addChild("assets");
+
+  // Budgets are in MiB
+  assets->addValue<IntCVar>("cpu_budget", 16, 1 << 20);
+  assets->addValue<IntCVar>("gpu_budget", 16, 1 << 20);
+
+  // Measured in world updates
+  assets->addValue<IntCVar>("eviction_delay", 1, 1024);
+}
+
+AssetPool::AssetPool(const CVarScope* cvars, Filesystem* fs)
+    : cvars(cvars->getChild("assets")), fs(fs) {
+  cpu_budget = this->cvars->get<IntCVar>("cpu_budget") << 20;
+  gpu_budget = this->cvars->get<IntCVar>("gpu_budget") << 20;
+  eviction_delay = this->cvars->get<IntCVar>("eviction_delay");
+}
+
+AssetPool::~AssetPool() {
+  unloadAll();
+
+  for (auto storage : storages) {
+    if (storage != nullptr) delete storage;
+  }
+}
+
+void AssetPool::prioritize(AssetId id, double priority) {
+  std::unique_lock<std::mutex> lock(streaming_mutex);
+
+  auto iter = streaming.find(id);
+  if (iter == streaming.end()) return;
+
+  StreamingAsset& streaming_asset = iter->second;
+  if (priority <= streaming_asset.priority) return;
+  streaming_asset.priority = priority;
+
+  // Old queue entries are left behind and skipped once they're popped
+  switch (streaming_asset.state) {
+    case StreamState::Queued: {
+      read_queue.push({priority, id});
+      break;
+    }
+
+    case StreamState::Ready:
+    case StreamState::Failed: {
+      finalize_queue.push({priority, id});
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+void AssetPool::update() {
+  log_zone;
+
+  clock++;
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  while (true) {
+    AssetId id;
+    StreamingAsset streaming_asset;
+
+    {
+      std::unique_lock<std::mutex> lock(streaming_mutex);
+
+      bool found = false;
+      while (!finalize_queue.empty() && !found) {
+        StreamQueueEntry entry = finalize_queue.top();
+        finalize_queue.pop();
+
+        // Skip entries left behind by prioritize() or a previous stream
+        auto iter = streaming.find(entry.id);
+        if (iter == streaming.end()) continue;
+        if (iter->second.priority != entry.priority) continue;
+        if (iter->second.state != StreamState::Ready &&
+            iter->second.state != StreamState::Failed) {
+          continue;
+        }
+
+        id = entry.id;
+        streaming_asset = iter->second;
+        streaming.erase(iter);
+        found = true;
+      }
+
+      if (!found) break;
+    }
+
+    finalizeAsset(id, streaming_asset);
+
+    // Always finalize at least one asset so that streaming makes progress
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_time;
+    if (elapsed.count() >= finalize_budget) break;
+  }
+
+  collectGarbage();
+}
+
+void AssetPool::collectGarbage() {
+  if (!isOverBudget()) return;
+
+  log_zone;
+
+  // Lumps left over from bundle loads or evicted assets are the cheapest to
+  // reclaim, since no asset has to be reloaded
+  fs->evictUnusedLumps();
+  if (!isOverBudget()) return;
+
+  std::vector<std::pair<uint64_t, AssetId>> candidates;
+
+  for (auto& entry : pool) {
+    const Asset* asset = getAsset(entry.second);
+    if (!asset->loaded || asset->ref_count > 0) continue;
+    if (clock - asset->released_at <= eviction_delay) continue;
+    candidates.push_back({asset->released_at, entry.first});
+  }
+
+  // Least recently released first
+  std::sort(candidates.begin(), candidates.end());
+
+  for (const auto& candidate : candidates) {
+    if (!isOverBudget()) break;
+
+    auto iter = pool.find(candidate.second);
+    PoolEntry entry = iter->second;
+    pool.erase(iter);
+    evictAsset(candidate.second, entry);
+  }
+
+  // Evicting an asset may release others (i.e. a material's texture), which
+  // become candidates once the eviction delay has passed for them
+  if (isOverBudget()) {
+    log_dbg_fmt("Asset memory over budget (CPU %zu KiB, GPU %zu KiB)",
+                getCpuUsage() >> 10, gpu_usage >> 10);
+  }
+}
+
+void AssetPool::unloadAll() {
+  {
+    std::unique_lock<std::mutex> lock(streaming_mutex);
+
+    // Jobs still waiting on a worker will find nothing to read
+    read_queue = StreamQueue();
+    stream_ready.wait(lock, [this]() { return reads_in_flight == 0; });
+
+    // Read but unfinalized assets still hold their lumps
+    for (auto& streaming_asset : streaming) {
+      if (streaming_asset.second.state == StreamState::Ready) {
+        fs->releaseAsset(streaming_asset.second.location);
+      }
+    }
+
+    streaming.clear();
+    finalize_queue = StreamQueue();
+  }
+
+  // Free unreferenced assets first, since freeing an asset can release the
+  // assets it holds handles to
+  bool force = false;
+  while (!pool.empty()) {
+    bool freed_any = false;
+
+    for (auto iter = pool.begin(); iter != pool.end();) {
+      const Asset* asset = getAsset(iter->second);
+
+      if (asset->ref_count > 0 && !force) {
+        iter++;
+        continue;
+      }
+
+      AssetId id = iter->first;
+      PoolEntry entry = iter->second;
+      iter = pool.erase(iter);
+
+      if (asset->loaded) {
+        evictAsset(id, entry);
+      } else {
+        freeAsset(entry);
+      }
+
+      freed_any = true;
+    }
+
+    if (!freed_any) {
+      log_wrn_fmt("Unloading %zu assets that are still referenced",
+                  pool.size());
+      force = true;
+    }
+  }
+}
+
+bool AssetPool::createAsset(AssetId id, assets::AssetType type,
+                            const Filesystem::AssetLocation* location,
+                            PoolEntry* new_entry) {
+  uint32_t type_index = static_cast<uint32_t>(type);
+
+  if (storages.size() <= type_index || storages[type_index] == nullptr) {
+    log_err_fmt("Attempted to load unitialized asset type %s",
+                assets::EnumNameAssetType(type));
+    return false;
+  }
+
+  AssetStorage* storage = storages[type_index];
+
+  PoolEntry& entry = *new_entry;
+  entry.type = type;
+  entry.slot = storage->allocate();
+  entry.generation = storage->getGeneration(entry.slot);
+  if (location != nullptr) entry.location = *location;
+  pool.emplace(id, entry);
+
+  getAsset(entry)->pool_clock = &clock;
+  return true;
+}
+
+void AssetPool::freeAsset(const PoolEntry& entry) {
+  storages[static_cast<uint32_t>(entry.type)]->free(entry.slot);
+}
+
+void AssetPool::addUsage(const Asset* asset) {
+  cpu_usage += asset->getCpuSize();
+  gpu_usage += asset->getGpuSize();
+}
+
+void AssetPool::evictAsset(AssetId id, const PoolEntry& entry) {
+  log_dbg_fmt("Evicting asset 0x%0dx", id);
+
+  const Asset* asset = getAsset(entry);
+  cpu_usage -= asset->getCpuSize();
+  gpu_usage -= asset->getGpuSize();
+
+  fs->releaseAsset(entry.location);
+  freeAsset(entry);
+}
+
+bool AssetPool::isOverBudget() {
+  // Evicting assets frees their lumps, so the lumps are counted each time
+  size_t lump_usage = fs->getResidentLumpSize();
+  return cpu_usage + lump_usage > cpu_budget || gpu_usage > gpu_budget;
+}
+
+bool AssetPool::readAsset(AssetId id, assets::AssetType type,
+                          const assets::SerializedAsset** asset_data,
+                          Filesystem::AssetLocation* location) {
+  bool loaded_successfully = fs->loadAsset(asset_data, id, location);
+
+  if (loaded_successfully) {
+    if ((*asset_data)->type() != type) {
+      loaded_successfully = false;
+      fs->releaseAsset(*location);
+      log_err_fmt("SerializedAsset 0x%0lx does not have type %s as expected",
+                  id, assets::EnumNameAssetType(type));
+    }
+  }
+
+  if (!loaded_successfully) {
+    log_err_fmt("Failed to load asset 0x%0dx", id);
+  }
+
+  return loaded_successfully;
+}
+
+void AssetPool::queueAsset(AssetId id, assets::AssetType type, Asset* asset,
+                           double priority) {
+  {
+    std::unique_lock<std::mutex> lock(streaming_mutex);
+
+    StreamingAsset streaming_asset;
+    streaming_asset.asset = asset;
+    streaming_asset.type = type;
+    streaming_asset.priority = priority;
+    streaming_asset.state = StreamState::Queued;
+    streaming_asset.data = nullptr;
+    streaming.emplace(id, streaming_asset);
+
+    read_queue.push({priority, id});
+    reads_in_flight++;
+  }
+
+  // Each job reads whichever queued asset has the highest priority when it
+  // runs, not necessarily the one that submitted it
+  WorkerPool* workers = fs->getWorkers();
+  if (workers != nullptr) {
+    workers->submit([this]() { readNextAsset(); });
+  } else {
+    readNextAsset();
+  }
+}
+
+void AssetPool::readNextAsset() {
+  log_zone;
+
+  std::unique_lock<std::mutex> lock(streaming_mutex);
+
+  AssetId id = AssetId::NullAsset;
+  assets::AssetType type = assets::AssetType::None;
+
+  while (!read_queue.empty()) {
+    StreamQueueEntry entry = read_queue.top();
+    read_queue.pop();
+
+    auto iter = streaming.find(entry.id);
+    if (iter == streaming.end()) continue;
+    if (iter->second.priority != entry.priority) continue;
+    if (iter->second.state != StreamState::Queued) continue;
+
+    iter->second.state = StreamState::Reading;
+    id = entry.id;
+    type = iter->second.type;
+    break;
+  }
+
+  if (id != AssetId::NullAsset) {
+    lock.unlock();
+    const assets::SerializedAsset* asset_data = nullptr;
+    Filesystem::AssetLocation location;
+    bool success = readAsset(id, type, &asset_data, &location);
+    lock.lock();
+
+    StreamingAsset& streaming_asset = streaming.at(id);
+    streaming_asset.state = success ? StreamState::Ready : StreamState::Failed;
+    streaming_asset.data = asset_data;
+    streaming_asset.location = location;
+    finalize_queue.push({streaming_asset.priority, id});
+  }
+
+  reads_in_flight--;
+  stream_ready.notify_all();
+}
+
+void AssetPool::finishLoading(AssetId id) {
+  log_zone;
+
+  StreamingAsset streaming_asset;
+
+  {
+    std::unique_lock<std::mutex> lock(streaming_mutex);
+
+    auto iter = streaming.find(id);
+    if (iter == streaming.end()) return;
+
+    if (iter->second.state == StreamState::Queued) {
+      // Nobody has picked this asset up yet, so read it here
+      iter->second.state = StreamState::Reading;
+      assets::AssetType type = iter->second.type;
+
+      lock.unlock();
+      const assets::SerializedAsset* asset_data = nullptr;
+      Filesystem::AssetLocation location;
+      bool success = readAsset(id, type, &asset_data, &location);
+      lock.lock();
+
+      iter = streaming.find(id);
+      iter->second.state = success ? StreamState::Ready : StreamState::Failed;
+      iter->second.data = asset_data;
+      iter->second.location = location;
+    } else {
+      stream_ready.wait(lock, [this, id]() {
+        return streaming.at(id).state != StreamState::Reading;
+      });
+
+      iter = streaming.find(id);
+    }
+
+    // The finalize queue's entry is now stale and will be skipped
+    streaming_asset = iter->second;
+    streaming.erase(iter);
+  }
+
+  finalizeAsset(id, streaming_asset);
+}
+
+void AssetPool::finalizeAsset(AssetId id,
+                              const StreamingAsset& streaming_asset) {
+  if (streaming_asset.state != StreamState::Ready) {
+    // Leave the asset in the pool unloaded, so that its handles stay invalid
+    log_err_fmt("Failed to stream asset 0x%0dx", id);
+    return;
+  }
+
+  // Released against this location when the asset is evicted
+  pool.at(id).location = streaming_asset.location;
+
+  // Any assets this one loads asynchronously inherit its priority
+  double previous_priority = finalize_priority;
+  finalize_priority = streaming_asset.priority;
+
+  streaming_asset.asset->load(streaming_asset.data);
+  streaming_asset.asset->loaded = true;
+  addUsage(streaming_asset.asset);
+
+  finalize_priority = previous_priority;
+}
+
+}  // namespace mondradiko
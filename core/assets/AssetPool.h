@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <queue>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
@@ -10,12 +14,16 @@
 
 #include "core/assets/Asset.h"
 #include "core/assets/AssetHandle.h"
+#include "core/assets/AssetStorage.h"
 #include "core/filesystem/Filesystem.h"
 #include "lib/include/entt_headers.h"
 #include "log/log.h"
 
 namespace mondradiko {
 
+// Forward declarations
+class CVarScope;
+
 template <typename BaseAssetType>
 struct DummyAsset {
   BaseAssetType* dummy = nullptr;
@@ -23,99 +31,228 @@ struct DummyAsset {
 
 class AssetPool {
  public:
-  explicit AssetPool(Filesystem* fs) : fs(fs) {}
+  static void initCVars(CVarScope*);
 
-  ~AssetPool() { unloadAll(); }
+  AssetPool(const CVarScope*, Filesystem*);
+  ~AssetPool();
 
   template <typename AssetType, typename... Args>
   void initializeAssetType(Args&&... args) {
     uint32_t asset_type = static_cast<uint32_t>(AssetType::ASSET_TYPE);
     const char* type_name = assets::EnumNameAssetType(AssetType::ASSET_TYPE);
 
-    if (asset_type >= templates.size()) {
-      templates.resize(asset_type + 1, nullptr);
-    } else if (templates[asset_type]) {
+    if (asset_type >= storages.size()) {
+      storages.resize(asset_type + 1, nullptr);
+    } else if (storages[asset_type]) {
       log_err_fmt("Attempted to initialize %s pool twice", type_name);
       return;
     }
 
-    Asset* new_asset = new AssetType(args...);
-    templates[asset_type] = new_asset;
+    AssetType* template_asset = new AssetType(args...);
+    storages[asset_type] = AssetStorage::create(template_asset);
   }
 
+  /**
+   * @brief Loads an asset synchronously.
+   * If the asset is already streaming, waits for it and finalizes it now.
+   */
   template <typename AssetType>
   AssetHandle<AssetType> load(AssetId id) {
-    uint32_t asset_type = static_cast<uint32_t>(AssetType::ASSET_TYPE);
     const char* type_name = assets::EnumNameAssetType(AssetType::ASSET_TYPE);
 
     {  // Check if this asset already exists
       auto iter = pool.find(id);
 
       if (iter != pool.end()) {
-        AssetType* asset = dynamic_cast<AssetType*>(iter->second);
-
-        if (asset == nullptr) {
+        if (iter->second.type != AssetType::ASSET_TYPE) {
           log_err_fmt("Cached asset 0x%0lx does not have type %s as expected",
                       id, type_name);
           return AssetHandle<AssetType>(nullptr);
-        } else {
-          return AssetHandle<AssetType>(id, asset);
         }
-      }
-    }
-
-    if (templates.size() <= asset_type || templates[asset_type] == nullptr) {
-      log_err_fmt("Attempted to load unitialized asset type %s", type_name);
-      return AssetHandle<AssetType>(nullptr);
-    }
 
-    const assets::SerializedAsset* asset_data;
-    bool loaded_successfully = fs->loadAsset(&asset_data, id);
+        // Copied, since finishing the load may create other pool entries
+        PoolEntry entry = iter->second;
 
-    if (loaded_successfully) {
-      if (asset_data->type() != AssetType::ASSET_TYPE) {
-        loaded_successfully = false;
-        log_err_fmt("SerializedAsset 0x%0lx does not have type %s as expected",
-                    id, type_name);
+        if (!getAsset(entry)->loaded) finishLoading(id);
+        return makeHandle<AssetType>(id, entry);
       }
     }
 
-    if (!loaded_successfully) {
-      log_err_fmt("Failed to load asset 0x%0dx", id);
+    const assets::SerializedAsset* asset_data;
+    Filesystem::AssetLocation location;
+    if (!readAsset(id, AssetType::ASSET_TYPE, &asset_data, &location)) {
       return AssetHandle<AssetType>(nullptr);
     }
 
-    AssetType* template_asset = dynamic_cast<AssetType*>(templates[asset_type]);
-
-    if (template_asset == nullptr) {
-      log_err_fmt("Template asset for 0x%0lx does not have type %s as expected",
-                  id, type_name);
+    PoolEntry entry;
+    if (!createAsset(id, AssetType::ASSET_TYPE, &location, &entry)) {
+      fs->releaseAsset(location);
       return AssetHandle<AssetType>(nullptr);
     }
 
-    AssetType* new_asset = new AssetType(*template_asset);
+    Asset* new_asset = getAsset(entry);
     new_asset->load(asset_data);
     new_asset->loaded = true;
-    pool.emplace(id, new_asset);
+    addUsage(new_asset);
 
-    return AssetHandle<AssetType>(id, new_asset);
+    return makeHandle<AssetType>(id, entry);
   }
 
-  // TODO(marceline-cramer) Add garbage collecting method
+  /**
+   * @brief Starts streaming an asset in the background.
+   * The returned handle is not loaded until a later update() finalizes it.
+   * Assets with higher priority are read and finalized first.
+   */
+  template <typename AssetType>
+  AssetHandle<AssetType> loadAsync(AssetId id, double priority = 0.0) {
+    const char* type_name = assets::EnumNameAssetType(AssetType::ASSET_TYPE);
+
+    // Dependencies of an asset being finalized are at least as urgent
+    if (priority < finalize_priority) priority = finalize_priority;
 
-  void unloadAll() {
-    for (auto& asset : pool) {
-      delete asset.second;
+    {  // Check if this asset already exists
+      auto iter = pool.find(id);
+
+      if (iter != pool.end()) {
+        if (iter->second.type != AssetType::ASSET_TYPE) {
+          log_err_fmt("Cached asset 0x%0lx does not have type %s as expected",
+                      id, type_name);
+          return AssetHandle<AssetType>(nullptr);
+        }
+
+        if (!getAsset(iter->second)->loaded) prioritize(id, priority);
+        return makeHandle<AssetType>(id, iter->second);
+      }
     }
 
-    pool.clear();
+    PoolEntry entry;
+    if (!createAsset(id, AssetType::ASSET_TYPE, nullptr, &entry)) {
+      return AssetHandle<AssetType>(nullptr);
+    }
+
+    queueAsset(id, AssetType::ASSET_TYPE, getAsset(entry), priority);
+
+    return makeHandle<AssetType>(id, entry);
   }
 
+  // Raises the priority of a streaming asset
+  void prioritize(AssetId, double);
+
+  // Finalizes streamed assets on the calling thread until the budget runs out,
+  // then collects garbage
+  void update();
+
+  void setFinalizeBudget(double seconds) { finalize_budget = seconds; }
+
+  // Evicts the least recently released assets until memory use is in budget
+  void collectGarbage();
+
+  void unloadAll();
+
+  // Includes the lumps that loaded assets were read from
+  size_t getCpuUsage() const { return cpu_usage + fs->getResidentLumpSize(); }
+  size_t getGpuUsage() const { return gpu_usage; }
+
  private:
+  const CVarScope* cvars;
   Filesystem* fs;
 
-  std::vector<Asset*> templates;
-  std::unordered_map<AssetId, Asset*> pool;
+  //
+  // Memory budget
+  //
+  size_t cpu_budget;
+  size_t gpu_budget;
+  size_t cpu_usage = 0;
+  size_t gpu_usage = 0;
+
+  // Counts calls to update(); unreferenced assets are only evicted once this
+  // has advanced past eviction_delay, so frames in flight can finish with them
+  uint64_t clock = 0;
+  uint64_t eviction_delay;
+
+  //
+  // Asset storage
+  //
+  struct PoolEntry {
+    assets::AssetType type;
+    uint32_t slot;
+    uint32_t generation;
+
+    // Set once the asset has been read
+    Filesystem::AssetLocation location;
+  };
+
+  // Indexed by AssetType
+  std::vector<AssetStorage*> storages;
+  std::unordered_map<AssetId, PoolEntry> pool;
+
+  Asset* getAsset(const PoolEntry& entry) const {
+    return storages[static_cast<uint32_t>(entry.type)]->get(entry.slot,
+                                                            entry.generation);
+  }
+
+  // Pool entries are only created for their storage's type, so the handle
+  // never needs a type check
+  template <typename AssetType>
+  AssetHandle<AssetType> makeHandle(AssetId id, const PoolEntry& entry) const {
+    const AssetStorage* storage = storages[static_cast<uint32_t>(entry.type)];
+    return AssetHandle<AssetType>(id, storage, entry.slot, entry.generation);
+  }
+
+  // Allocates an unloaded asset and adds it to the pool; the location may be
+  // null if the asset hasn't been read yet
+  bool createAsset(AssetId, assets::AssetType,
+                   const Filesystem::AssetLocation*, PoolEntry*);
+  void freeAsset(const PoolEntry&);
+
+  void addUsage(const Asset*);
+  void evictAsset(AssetId, const PoolEntry&);
+  bool isOverBudget();
+
+  bool readAsset(AssetId, assets::AssetType, const assets::SerializedAsset**,
+                 Filesystem::AssetLocation*);
+
+  //
+  // Asset streaming
+  //
+  enum class StreamState { Queued, Reading, Ready, Failed };
+
+  struct StreamingAsset {
+    Asset* asset;
+    assets::AssetType type;
+    double priority;
+    StreamState state;
+    const assets::SerializedAsset* data;
+    Filesystem::AssetLocation location;
+  };
+
+  struct StreamQueueEntry {
+    double priority;
+    AssetId id;
+
+    bool operator<(const StreamQueueEntry& other) const {
+      return priority < other.priority;
+    }
+  };
+
+  // Entries whose priority no longer matches their StreamingAsset are stale
+  // and skipped when popped
+  using StreamQueue = std::priority_queue<StreamQueueEntry>;
+
+  std::mutex streaming_mutex;
+  std::condition_variable stream_ready;
+  std::unordered_map<AssetId, StreamingAsset> streaming;
+  StreamQueue read_queue;
+  StreamQueue finalize_queue;
+  uint32_t reads_in_flight = 0;
+
+  double finalize_budget = 0.002;  // 2 ms
+  double finalize_priority = -std::numeric_limits<double>::infinity();
+
+  void queueAsset(AssetId, assets::AssetType, Asset*, double);
+  void readNextAsset();
+  void finishLoading(AssetId);
+  void finalizeAsset(AssetId, const StreamingAsset&);
 };
 
 }  // namespace mondradiko
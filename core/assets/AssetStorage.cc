@@ -0,0 +1,71 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/assets/AssetStorage.h"
+
+#include "log/log.h"
+
+namespace mondradiko {
+
+AssetStorage::AssetStorage(Asset* template_asset, size_t asset_size,
+                           size_t asset_align, CopyFunction copy_asset)
+    : template_asset(template_asset),
+      slot_align(asset_align),
+      copy_asset(copy_asset) {
+  // Round each slot up so that every slot in a chunk stays aligned
+  slot_size = (asset_size + asset_align - 1) / asset_align * asset_align;
+}
+
+AssetStorage::~AssetStorage() {
+  if (getLiveCount() > 0) {
+    log_err_fmt("Destroying asset storage with %zu live assets",
+                getLiveCount());
+  }
+
+  for (auto chunk : chunks) {
+    ::operator delete(chunk, std::align_val_t(slot_align));
+  }
+
+  if (template_asset != nullptr) delete template_asset;
+}
+
+uint32_t AssetStorage::allocate() {
+  uint32_t slot_index;
+
+  if (free_slots.size() > 0) {
+    slot_index = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    slot_index = slots.size();
+
+    if (slot_index % SLOTS_PER_CHUNK == 0) {
+      chunks.push_back(::operator new(slot_size * SLOTS_PER_CHUNK,
+                                      std::align_val_t(slot_align)));
+    }
+
+    slots.push_back({nullptr, 0});
+  }
+
+  char* chunk = static_cast<char*>(chunks[slot_index / SLOTS_PER_CHUNK]);
+  void* memory = chunk + (slot_index % SLOTS_PER_CHUNK) * slot_size;
+
+  slots[slot_index].asset = copy_asset(memory, template_asset);
+  return slot_index;
+}
+
+void AssetStorage::free(uint32_t slot_index) {
+  Slot& slot = slots[slot_index];
+
+  if (slot.asset == nullptr) {
+    log_err_fmt("Freeing empty asset slot %u", slot_index);
+    return;
+  }
+
+  slot.asset->~Asset();
+  slot.asset = nullptr;
+  slot.generation++;
+
+  free_slots.push_back(slot_index);
+}
+
+}  // namespace mondradiko
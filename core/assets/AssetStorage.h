@@ -0,0 +1,72 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "core/assets/Asset.h"
+
+namespace mondradiko {
+
+/**
+ * @brief Slot allocator holding every asset of a single AssetType.
+ * Assets are copy-constructed from a template asset into fixed-size slots,
+ * which are allocated in chunks so that asset pointers are stable. Each
+ * slot's generation is incremented when it is freed, so that stale
+ * references to a reused slot can be detected.
+ */
+class AssetStorage {
+ public:
+  using CopyFunction = Asset* (*)(void*, const Asset*);
+
+  template <typename AssetType>
+  static AssetStorage* create(AssetType* template_asset) {
+    return new AssetStorage(
+        template_asset, sizeof(AssetType), alignof(AssetType),
+        [](void* memory, const Asset* source) -> Asset* {
+          return new (memory)
+              AssetType(*static_cast<const AssetType*>(source));
+        });
+  }
+
+  AssetStorage(Asset*, size_t, size_t, CopyFunction);
+  ~AssetStorage();
+
+  // Copies the template asset into a free slot and returns its index
+  uint32_t allocate();
+  void free(uint32_t);
+
+  Asset* get(uint32_t slot, uint32_t generation) const {
+    if (slot >= slots.size()) return nullptr;
+    if (slots[slot].generation != generation) return nullptr;
+    return slots[slot].asset;
+  }
+
+  uint32_t getGeneration(uint32_t slot) const {
+    return slots[slot].generation;
+  }
+
+  size_t getLiveCount() const { return slots.size() - free_slots.size(); }
+
+ private:
+  static constexpr uint32_t SLOTS_PER_CHUNK = 64;
+
+  Asset* template_asset;
+  size_t slot_size;
+  size_t slot_align;
+  CopyFunction copy_asset;
+
+  struct Slot {
+    Asset* asset;
+    uint32_t generation;
+  };
+
+  std::vector<Slot> slots;
+  std::vector<uint32_t> free_slots;
+  std::vector<void*> chunks;
+};
+
+}  // namespace mondradiko
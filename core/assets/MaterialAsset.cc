@@ -14,7 +14,8 @@ namespace mondradiko {
 void MaterialAsset::load(const assets::SerializedAsset* asset) {
   const assets::MaterialAsset* material = asset->material();
 
-  albedo_texture = asset_pool->load<TextureAsset>(material->albedo_texture());
+  albedo_texture =
+      asset_pool->loadAsync<TextureAsset>(material->albedo_texture());
 
   const assets::Vec3* albedo_factor = material->albedo_factor();
   uniform.albedo_factor = glm::vec4(albedo_factor->x(), albedo_factor->y(),
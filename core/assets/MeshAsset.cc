@@ -3,12 +3,13 @@
 
 #include "core/assets/MeshAsset.h"
 
-#include <vector>
+#include <limits>
 
 #include "types/assets/MeshAsset_generated.h"
 #include "core/assets/Asset.h"
 #include "core/gpu/GpuBuffer.h"
 #include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuUploader.h"
 #include "log/log.h"
 
 namespace mondradiko {
@@ -16,38 +17,113 @@ namespace mondradiko {
 void MeshAsset::load(const assets::SerializedAsset* asset) {
   const assets::MeshAsset* mesh = asset->mesh();
 
-  std::vector<MeshVertex> vertices(mesh->vertices()->size());
-  std::vector<MeshIndex> indices(mesh->indices()->size());
+  // Every vertex and index format is stored in the same layout that the GPU
+  // reads, so each buffer is copied once, straight out of the lump
+  static_assert(sizeof(MeshVertex) == sizeof(assets::MeshVertex),
+                "MeshVertex must match its serialized layout");
+  static_assert(sizeof(CompactMeshVertex) == sizeof(assets::CompactMeshVertex),
+                "CompactMeshVertex must match its serialized layout");
 
-  for (uint32_t i = 0; i < vertices.size(); i++) {
-    const assets::MeshVertex* vertex = mesh->vertices()->Get(i);
+  const void* vertex_data;
+  size_t vertex_size;
 
-    vertices[i].position = assets::Vec3ToGlm(vertex->position());
-    vertices[i].tex_coord = assets::Vec2ToGlm(vertex->tex_coord());
-    vertices[i].color = assets::Vec3ToGlm(vertex->color());
-    vertices[i].normal = assets::Vec3ToGlm(vertex->normal());
+  if (mesh->compact_vertices() != nullptr) {
+    const auto* vertices = mesh->compact_vertices();
+    vertex_data = vertices->data();
+    vertex_size = sizeof(CompactMeshVertex) * vertices->size();
+    compact_vertices = true;
+  } else {
+    const auto* vertices = mesh->vertices();
+    vertex_data = vertices->data();
+    vertex_size = sizeof(MeshVertex) * vertices->size();
   }
 
-  for (uint32_t i = 0; i < indices.size(); i++) {
-    indices[i] = mesh->indices()->Get(i);
+  if (mesh->bounds_min() != nullptr && mesh->bounds_max() != nullptr) {
+    bounds_min = assets::Vec3ToGlm(*mesh->bounds_min());
+    bounds_max = assets::Vec3ToGlm(*mesh->bounds_max());
+  } else if (compact_vertices) {
+    // Undecoded compact positions are normalized
+    bounds_min = glm::vec3(0.0);
+    bounds_max = glm::vec3(1.0);
+  } else if (mesh->vertices()->size() > 0) {
+    // Bundles from before bounds were written
+    bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    bounds_max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    for (const auto* vertex : *mesh->vertices()) {
+      glm::vec3 position = assets::Vec3ToGlm(vertex->position());
+      bounds_min = glm::min(bounds_min, position);
+      bounds_max = glm::max(bounds_max, position);
+    }
+  }
+
+  if (compact_vertices) {
+    position_offset = bounds_min;
+    position_scale = bounds_max - bounds_min;
+  }
+
+  if (mesh->bounds_center() != nullptr) {
+    bounds_center = assets::Vec3ToGlm(*mesh->bounds_center());
+    bounds_radius = mesh->bounds_radius();
+  } else {
+    bounds_center = (bounds_min + bounds_max) * 0.5f;
+    bounds_radius = glm::distance(bounds_center, bounds_max);
   }
 
-  size_t vertex_size = sizeof(MeshVertex) * vertices.size();
-  vertex_buffer =
-      new GpuBuffer(gpu, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-  vertex_buffer->writeData(vertices.data());
+  const void* index_data;
+  size_t index_size;
+
+  if (mesh->indices16() != nullptr) {
+    const auto* indices = mesh->indices16();
+    index_data = indices->data();
+    index_count = indices->size();
+    index_size = sizeof(uint16_t) * index_count;
+    index_type = VK_INDEX_TYPE_UINT16;
+  } else {
+    const auto* indices = mesh->indices();
+    index_data = indices->data();
+    index_count = indices->size();
+    index_size = sizeof(MeshIndex) * index_count;
+    index_type = VK_INDEX_TYPE_UINT32;
+  }
 
-  size_t index_size = sizeof(indices[0]) * indices.size();
-  index_buffer =
-      new GpuBuffer(gpu, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-  index_buffer->writeData(indices.data());
+  // Offsets are aligned to whole elements so that draws can address them
+  size_t vertex_stride =
+      compact_vertices ? sizeof(CompactMeshVertex) : sizeof(MeshVertex);
+  size_t index_stride =
+      index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(MeshIndex);
 
-  index_count = indices.size();
+  // Empty ranges aren't backed by any block, so there's nothing to upload
+  vertex_allocation = vertex_arena->allocate(vertex_size, vertex_stride);
+  vertex_offset = vertex_allocation.offset / vertex_stride;
+  if (vertex_size > 0) {
+    gpu->uploader->writeBuffer(getVertexBuffer(), vertex_allocation.offset,
+                               vertex_data, vertex_size);
+  }
+
+  index_allocation = index_arena->allocate(index_size, index_stride);
+  first_index = index_allocation.offset / index_stride;
+  if (index_size > 0) {
+    gpu->uploader->writeBuffer(getIndexBuffer(), index_allocation.offset,
+                               index_data, index_size);
+  }
+
+  gpu_size = vertex_size + index_size;
 }
 
 MeshAsset::~MeshAsset() {
-  if (vertex_buffer != nullptr) delete vertex_buffer;
-  if (index_buffer != nullptr) delete index_buffer;
+  vertex_arena->free(vertex_allocation);
+  index_arena->free(index_allocation);
+}
+
+GpuBuffer* MeshAsset::getVertexBuffer() const {
+  if (vertex_allocation.size == 0) return nullptr;
+  return vertex_arena->getBuffer(vertex_allocation.block);
+}
+
+GpuBuffer* MeshAsset::getIndexBuffer() const {
+  if (index_allocation.size == 0) return nullptr;
+  return index_arena->getBuffer(index_allocation.block);
 }
 
 }  // namespace mondradiko
@@ -7,6 +7,7 @@
 #include <cstddef>
 
 #include "core/assets/AssetPool.h"
+#include "core/gpu/GpuBufferArena.h"
 #include "core/gpu/GpuPipeline.h"
 #include "lib/include/glm_headers.h"
 #include "lib/include/vulkan_headers.h"
@@ -15,7 +16,6 @@ namespace mondradiko {
 
 // Forward declarations
 class GpuInstance;
-class GpuBuffer;
 
 struct MeshVertex {
   glm::vec3 position;
@@ -41,6 +41,34 @@ struct MeshVertex {
   }
 };
 
+// Matches the layout of assets::CompactMeshVertex, and is decoded by
+// shaders/compact_mesh.vert
+struct CompactMeshVertex {
+  uint16_t position[4];
+  int16_t normal[2];
+  uint8_t color[4];
+  uint16_t tex_coord[2];
+
+  static GpuPipeline::VertexBindings getVertexBindings() {
+    // VkVertexInputBindingDescription{binding, stride, inputRate}
+    return {
+      { 0, sizeof(CompactMeshVertex), VK_VERTEX_INPUT_RATE_VERTEX },
+    };
+  }
+
+  static GpuPipeline::AttributeDescriptions getAttributeDescriptions() {
+    // VkVertexInputAttributeDescription{location, binding, format, offset}
+    return {
+      { 0, 0, VK_FORMAT_R16G16B16A16_UNORM,
+        offsetof(CompactMeshVertex, position) },
+      { 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactMeshVertex, normal) },
+      { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactMeshVertex, color) },
+      { 3, 0, VK_FORMAT_R16G16_SFLOAT,
+        offsetof(CompactMeshVertex, tex_coord) },
+    };
+  }
+};
+
 using MeshIndex = uint32_t;
 
 class MeshAsset : public Asset {
@@ -48,16 +76,42 @@ class MeshAsset : public Asset {
   DECL_ASSET_TYPE(assets::AssetType::MeshAsset);
 
   // Asset lifetime implementation
-  explicit MeshAsset(GpuInstance* gpu) : gpu(gpu) {}
+  MeshAsset(GpuInstance* gpu, GpuBufferArena* vertex_arena,
+            GpuBufferArena* index_arena)
+      : gpu(gpu), vertex_arena(vertex_arena), index_arena(index_arena) {}
   void load(const assets::SerializedAsset*) final;
   ~MeshAsset();
 
-  GpuBuffer* vertex_buffer = nullptr;
-  GpuBuffer* index_buffer = nullptr;
-  size_t index_count = 0;
+  // Vertices and indices are sub-allocated from shared arena blocks, so
+  // draws offset into whichever blocks are bound. Null for empty meshes.
+  GpuBuffer* getVertexBuffer() const;
+  GpuBuffer* getIndexBuffer() const;
+  uint32_t getVertexBlock() const { return vertex_allocation.block; }
+  uint32_t getIndexBlock() const { return index_allocation.block; }
+  int32_t vertex_offset = 0;
+  uint32_t first_index = 0;
+  uint32_t index_count = 0;
+  VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+
+  // Compact vertex positions are normalized to the mesh's bounds, so they
+  // are decoded as position_offset + position * position_scale
+  bool compact_vertices = false;
+  glm::vec3 position_offset = glm::vec3(0.0);
+  glm::vec3 position_scale = glm::vec3(1.0);
+
+  // Local-space bounds of every vertex position, used for culling
+  glm::vec3 bounds_min = glm::vec3(0.0);
+  glm::vec3 bounds_max = glm::vec3(0.0);
+  glm::vec3 bounds_center = glm::vec3(0.0);
+  float bounds_radius = 0.0f;
 
  private:
   GpuInstance* gpu;
+  GpuBufferArena* vertex_arena;
+  GpuBufferArena* index_arena;
+
+  GpuBufferArena::Allocation vertex_allocation;
+  GpuBufferArena::Allocation index_allocation;
 };
 
 }  // namespace mondradiko
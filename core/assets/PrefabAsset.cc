@@ -31,6 +31,9 @@ void PrefabAsset::load(const assets::SerializedAsset* asset) {
   for (auto& child : prefab->children) {
     children.push_back(asset_pool->load<PrefabAsset>(child));
   }
+
+  cpu_size = sizeof(assets::PrefabAssetT) +
+             sizeof(AssetHandle<PrefabAsset>) * children.size();
 }
 
 PrefabAsset::~PrefabAsset() {
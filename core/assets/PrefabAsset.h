@@ -29,7 +29,7 @@ class PrefabAsset : public Asset {
  private:
   AssetPool* asset_pool;
 
-  assets::PrefabAssetT* prefab;
+  assets::PrefabAssetT* prefab = nullptr;
   std::vector<AssetHandle<PrefabAsset>> children;
 };
 
@@ -53,6 +53,9 @@ void ScriptAsset::load(const assets::SerializedAsset* asset) {
 
   wasm_byte_vec_delete(&module_data);
 
+  // The compiled module's size is opaque, so estimate it by the source's
+  cpu_size = script->data()->size();
+
   if (scripts->handleError(module_error, nullptr)) {
     log_ftl("Failed to compile module");
   }
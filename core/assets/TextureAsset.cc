@@ -3,8 +3,12 @@
 
 #include "core/assets/TextureAsset.h"
 
+#include <vector>
+
+#include "assets/common/TextureCompression.h"
 #include "core/gpu/GpuImage.h"
 #include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuUploader.h"
 #include "log/log.h"
 #include "types/assets/TextureAsset_generated.h"
 
@@ -14,6 +18,9 @@ void TextureAsset::load(const assets::SerializedAsset* asset) {
   const assets::TextureAsset* texture = asset->texture();
 
   VkFormat texture_format;
+  VkComponentMapping components = {
+      VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
 
   // TODO(marceline-cramer) Support all texture types
 
@@ -25,20 +32,130 @@ void TextureAsset::load(const assets::SerializedAsset* asset) {
     log_ftl("Unsupported component type");
   }
 
-  if (texture->srgb()) {
-    texture_format = VK_FORMAT_R8G8B8A8_SRGB;
-  } else {
-    texture_format = VK_FORMAT_R8G8B8A8_UNORM;
+  assets::TextureFormat format = texture->format();
+
+  switch (format) {
+    case assets::TextureFormat::Uncompressed: {
+      if (texture->srgb()) {
+        texture_format = VK_FORMAT_R8G8B8A8_SRGB;
+      } else {
+        texture_format = VK_FORMAT_R8G8B8A8_UNORM;
+      }
+
+      break;
+    }
+
+    case assets::TextureFormat::BC7: {
+      if (texture->srgb()) {
+        texture_format = VK_FORMAT_BC7_SRGB_BLOCK;
+      } else {
+        texture_format = VK_FORMAT_BC7_UNORM_BLOCK;
+      }
+
+      break;
+    }
+
+    case assets::TextureFormat::BC4: {
+      texture_format = VK_FORMAT_BC4_UNORM_BLOCK;
+      components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R,
+                    VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE};
+      break;
+    }
+
+    case assets::TextureFormat::BC5: {
+      texture_format = VK_FORMAT_BC5_UNORM_BLOCK;
+      components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+                    VK_COMPONENT_SWIZZLE_ZERO, VK_COMPONENT_SWIZZLE_ONE};
+      break;
+    }
+
+    default: {
+      log_ftl_fmt("Unsupported texture format %s",
+                  assets::EnumNameTextureFormat(format));
+    }
+  }
+
+  uint32_t width = texture->width();
+  uint32_t height = texture->height();
+  uint32_t mip_levels = texture->mip_levels();
+
+  if (mip_levels == 0) {
+    log_ftl("Texture has no mip levels");
+  }
+
+  // Levels are tightly packed, largest first
+  std::vector<size_t> level_offsets(mip_levels);
+  size_t data_size = 0;
+
+  for (uint32_t level = 0; level < mip_levels; level++) {
+    uint32_t level_width = width >> level;
+    uint32_t level_height = height >> level;
+    if (level_width == 0) level_width = 1;
+    if (level_height == 0) level_height = 1;
+
+    level_offsets[level] = data_size;
+    data_size += assets::getTextureLevelSize(format, level_width, level_height);
+  }
+
+  if (texture->data()->size() != data_size) {
+    log_ftl_fmt("Texture data is %u bytes, expected %zu",
+                texture->data()->size(), data_size);
+  }
+
+  const uint8_t* level_data = texture->data()->data();
+
+  // Decompress on the CPU if the GPU can't sample this format
+  std::vector<uint8_t> decompressed;
+  if (format != assets::TextureFormat::Uncompressed) {
+    std::vector<VkFormat> format_options = {texture_format};
+    VkFormat supported_format;
+
+    if (!gpu->findSupportedFormat(&format_options, VK_IMAGE_TILING_OPTIMAL,
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
+                                  &supported_format)) {
+      log_dbg_fmt("Decompressing unsupported %s texture",
+                  assets::EnumNameTextureFormat(format));
+
+      size_t decompressed_size = 0;
+      for (uint32_t level = 0; level < mip_levels; level++) {
+        uint32_t level_width = width >> level;
+        uint32_t level_height = height >> level;
+        if (level_width == 0) level_width = 1;
+        if (level_height == 0) level_height = 1;
+
+        size_t level_size =
+            static_cast<size_t>(level_width) * level_height * 4;
+        decompressed.resize(decompressed_size + level_size);
+        assets::decompressTextureLevel(
+            format, level_data + level_offsets[level], level_width,
+            level_height, decompressed.data() + decompressed_size);
+
+        level_offsets[level] = decompressed_size;
+        decompressed_size += level_size;
+      }
+
+      if (texture->srgb()) {
+        texture_format = VK_FORMAT_R8G8B8A8_SRGB;
+      } else {
+        texture_format = VK_FORMAT_R8G8B8A8_UNORM;
+      }
+
+      components = {
+          VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+          VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+      level_data = decompressed.data();
+      data_size = decompressed_size;
+    }
   }
 
   image =
-      new GpuImage(gpu, texture_format, texture->width(), texture->height(),
+      new GpuImage(gpu, texture_format, width, height, mip_levels, components,
                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                    VMA_MEMORY_USAGE_GPU_ONLY);
 
-  image->transitionLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  image->writeData(texture->data()->data());
-  image->transitionLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  gpu->uploader->writeImage(image, level_data, data_size, level_offsets);
+
+  gpu_size = data_size;
 }
 
 TextureAsset::~TextureAsset() {
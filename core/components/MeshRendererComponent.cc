@@ -11,8 +11,15 @@ void MeshRendererComponent::refresh(AssetPool* asset_pool) {
   auto mesh_id = static_cast<AssetId>(_data.mesh_asset());
   auto material_id = static_cast<AssetId>(_data.material_asset());
 
-  mesh_asset = asset_pool->load<MeshAsset>(mesh_id);
-  material_asset = asset_pool->load<MaterialAsset>(material_id);
+  mesh_asset = asset_pool->loadAsync<MeshAsset>(mesh_id);
+  material_asset = asset_pool->loadAsync<MaterialAsset>(material_id);
+}
+
+void MeshRendererComponent::prioritize(AssetPool* asset_pool,
+                                       double priority) const {
+  asset_pool->prioritize(static_cast<AssetId>(_data.mesh_asset()), priority);
+  asset_pool->prioritize(static_cast<AssetId>(_data.material_asset()),
+                         priority);
 }
 
 // Template specialization to build UpdateComponents event
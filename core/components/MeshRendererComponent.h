@@ -31,6 +31,9 @@ class MeshRendererComponent
   // Component implementation
   void refresh(AssetPool*) final;
 
+  // Raises the streaming priority of this renderer's assets
+  void prioritize(AssetPool*, double) const;
+
   bool isLoaded() const { return getMeshAsset() && getMaterialAsset(); }
 
   const AssetHandle<MeshAsset>& getMeshAsset() const { return mesh_asset; }
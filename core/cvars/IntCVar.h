@@ -0,0 +1,35 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "core/cvars/CVarValueInterface.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+class IntCVar : public CVarValueInterface {
+ public:
+  IntCVar(int64_t min_val, int64_t max_val)
+      : min_val(min_val), max_val(max_val) {}
+
+  operator int64_t() const { return value; }
+
+ protected:
+  int64_t min_val;
+  int64_t max_val;
+  int64_t value;
+
+  // CVarValueInterface implementation
+  bool loadConfig(const toml::value& config) final {
+    value = config.as_integer();
+    if (value < min_val || value > max_val) {
+      log_err_fmt("Value is outside of range [%ld - %ld]", min_val, max_val);
+      return false;
+    }
+
+    return true;
+  }
+};
+
+}  // namespace mondradiko
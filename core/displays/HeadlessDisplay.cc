@@ -0,0 +1,109 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/displays/HeadlessDisplay.h"
+
+#include "core/displays/HeadlessViewport.h"
+#include "core/gpu/GpuInstance.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+HeadlessDisplay::HeadlessDisplay(uint32_t image_width, uint32_t image_height)
+    : image_width(image_width), image_height(image_height) {
+  log_zone;
+}
+
+HeadlessDisplay::~HeadlessDisplay() { log_zone; }
+
+bool HeadlessDisplay::getVulkanRequirements(VulkanRequirements* requirements) {
+  log_zone;
+
+  requirements->min_api_version = VK_MAKE_VERSION(1, 0, 0);
+  requirements->max_api_version = VK_MAKE_VERSION(1, 2, 0);
+  requirements->instance_extensions.resize(0);
+  requirements->device_extensions.resize(0);
+
+  return true;
+}
+
+bool HeadlessDisplay::getVulkanDevice(VkInstance instance,
+                                      VkPhysicalDevice* physical_device) {
+  log_zone;
+
+  uint32_t device_count = 0;
+  vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+  std::vector<VkPhysicalDevice> devices(device_count);
+  vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+  // Restrict the loader's ICDs (i.e. with VK_ICD_FILENAMES) to choose a device
+  if (device_count == 0) {
+    log_err("Could not find suitable Vulkan physical device.");
+    return false;
+  }
+
+  *physical_device = devices[0];
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(*physical_device, &properties);
+  log_inf_fmt("Rendering headless on %s", properties.deviceName);
+
+  return true;
+}
+
+bool HeadlessDisplay::createSession(GpuInstance* _gpu) {
+  log_zone;
+
+  gpu = _gpu;
+
+  std::vector<VkFormat> depth_format_options = {VK_FORMAT_D32_SFLOAT,
+                                                VK_FORMAT_D32_SFLOAT_S8_UINT,
+                                                VK_FORMAT_D24_UNORM_S8_UINT};
+
+  if (!gpu->findSupportedFormat(&depth_format_options, VK_IMAGE_TILING_OPTIMAL,
+                                VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                &depth_format)) {
+    log_err("Failed to find supported depth format.");
+    return false;
+  }
+
+  return true;
+}
+
+void HeadlessDisplay::destroySession() {
+  log_zone;
+
+  if (gpu == nullptr) return;
+  vkDeviceWaitIdle(gpu->device);
+
+  if (main_viewport != nullptr) delete main_viewport;
+  main_viewport = nullptr;
+}
+
+void HeadlessDisplay::pollEvents(DisplayPollEventsInfo* poll_info) {
+  log_zone;
+
+  if (main_viewport == nullptr) {
+    main_viewport = new HeadlessViewport(gpu, this, poll_info->renderer);
+  }
+
+  poll_info->should_quit = false;
+  poll_info->should_run = true;
+}
+
+void HeadlessDisplay::beginFrame(DisplayBeginFrameInfo* frame_info) {
+  log_zone;
+
+  frame_info->should_render = main_viewport != nullptr;
+}
+
+void HeadlessDisplay::acquireViewports(std::vector<Viewport*>* viewports) {
+  log_zone;
+
+  viewports->resize(1);
+  viewports->at(0) = main_viewport;
+}
+
+void HeadlessDisplay::endFrame(DisplayBeginFrameInfo* frame_info) { log_zone; }
+
+}  // namespace mondradiko
@@ -0,0 +1,55 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "core/displays/DisplayInterface.h"
+
+namespace mondradiko {
+
+// Forward declarations
+class GpuInstance;
+class HeadlessViewport;
+
+/**
+ * @brief Renders to offscreen images instead of a window or an XR runtime.
+ * Lets benchmarks and tests run on any Vulkan device, including software
+ * implementations like lavapipe.
+ */
+class HeadlessDisplay : public DisplayInterface {
+ public:
+  HeadlessDisplay(uint32_t, uint32_t);
+  ~HeadlessDisplay();
+
+  bool getVulkanRequirements(VulkanRequirements*) final;
+  bool getVulkanDevice(VkInstance, VkPhysicalDevice*) final;
+  bool createSession(GpuInstance*) final;
+  void destroySession() final;
+
+  VkFormat getSwapchainFormat() final { return VK_FORMAT_R8G8B8A8_UNORM; }
+  VkImageLayout getFinalLayout() final {
+    // Nothing presents the images, so leave them ready to be read back
+    return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  }
+  VkFormat getDepthFormat() final { return depth_format; }
+
+  void pollEvents(DisplayPollEventsInfo*) final;
+  void beginFrame(DisplayBeginFrameInfo*) final;
+  void acquireViewports(std::vector<Viewport*>*) final;
+  void endFrame(DisplayBeginFrameInfo*) final;
+
+  uint32_t image_width;
+  uint32_t image_height;
+
+  VkFormat depth_format;
+
+  // Created by the first pollEvents()
+  HeadlessViewport* main_viewport = nullptr;
+
+ private:
+  GpuInstance* gpu = nullptr;
+};
+
+}  // namespace mondradiko
@@ -0,0 +1,97 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/displays/HeadlessViewport.h"
+
+#include "core/displays/HeadlessDisplay.h"
+#include "core/gpu/GpuImage.h"
+#include "core/gpu/GpuInstance.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+// Matches the renderer's frames in flight
+const uint32_t HEADLESS_IMAGE_COUNT = 2;
+
+HeadlessViewport::HeadlessViewport(GpuInstance* gpu, HeadlessDisplay* display,
+                                   Renderer* renderer)
+    : Viewport(display, gpu, renderer),
+      gpu(gpu),
+      display(display),
+      renderer(renderer) {
+  log_zone;
+
+  color_images.resize(HEADLESS_IMAGE_COUNT);
+  _images.resize(HEADLESS_IMAGE_COUNT);
+
+  for (uint32_t i = 0; i < HEADLESS_IMAGE_COUNT; i++) {
+    color_images[i] = new GpuImage(
+        gpu, display->getSwapchainFormat(), display->image_width,
+        display->image_height,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    _images[i].image = color_images[i]->image;
+  }
+
+  _image_width = display->image_width;
+  _image_height = display->image_height;
+  _createImages();
+
+  camera_position = glm::vec3(0.0);
+  camera_orientation = glm::quat(1.0, 0.0, 0.0, 0.0);
+}
+
+HeadlessViewport::~HeadlessViewport() {
+  log_zone;
+
+  vkDeviceWaitIdle(gpu->device);
+
+  _destroyImages();
+
+  for (auto image : color_images) {
+    if (image != nullptr) delete image;
+  }
+}
+
+void HeadlessViewport::writeUniform(ViewportUniform* uniform) {
+  log_zone;
+
+  uniform->view = glm::inverse(glm::translate(glm::mat4(1.0), camera_position) *
+                               glm::mat4(camera_orientation));
+
+  uniform->projection = glm::perspective(
+      glm::radians(80.0f),
+      static_cast<float>(_image_width) / static_cast<float>(_image_height),
+      0.01f, 1000.0f);
+
+  // Fix GLM matrix to work with Vulkan
+  uniform->projection[1][1] *= -1.0;
+
+  uniform->position = camera_position;
+}
+
+void HeadlessViewport::setCamera(const glm::vec3& position,
+                                 const glm::quat& orientation) {
+  camera_position = position;
+  camera_orientation = orientation;
+}
+
+VkSemaphore HeadlessViewport::_acquireImage(uint32_t* image_index) {
+  log_zone;
+
+  acquire_image_index++;
+  if (acquire_image_index >= color_images.size()) {
+    acquire_image_index = 0;
+  }
+
+  // Images are only reused after the renderer fences their frame
+  *image_index = acquire_image_index;
+  return VK_NULL_HANDLE;
+}
+
+void HeadlessViewport::_releaseImage(uint32_t current_image_index,
+                                     VkSemaphore on_render_finished) {
+  log_zone;
+}
+
+}  // namespace mondradiko
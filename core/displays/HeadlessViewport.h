@@ -0,0 +1,47 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "core/displays/Viewport.h"
+
+namespace mondradiko {
+
+// Forward declarations
+class GpuImage;
+class GpuInstance;
+class HeadlessDisplay;
+class Renderer;
+
+class HeadlessViewport : public Viewport {
+ public:
+  HeadlessViewport(GpuInstance*, HeadlessDisplay*, Renderer*);
+  ~HeadlessViewport();
+
+  // Viewport implementation
+  void writeUniform(ViewportUniform*) final;
+  bool isSignalRequired() final { return false; }
+
+  // The camera looks down -Z when unrotated
+  void setCamera(const glm::vec3&, const glm::quat&);
+
+ private:
+  GpuInstance* gpu;
+  HeadlessDisplay* display;
+  Renderer* renderer;
+
+  // Viewport implementation
+  VkSemaphore _acquireImage(uint32_t*) final;
+  void _releaseImage(uint32_t, VkSemaphore) final;
+
+  // One per frame in flight, like a swapchain
+  std::vector<GpuImage*> color_images;
+  uint32_t acquire_image_index = 0;
+
+  glm::vec3 camera_position;
+  glm::quat camera_orientation;
+};
+
+}  // namespace mondradiko
@@ -35,6 +35,7 @@ void Viewport::beginRenderPass(VkCommandBuffer command_buffer,
 
   vkCmdBeginRenderPass(command_buffer, &render_pass_info,
                        VK_SUBPASS_CONTENTS_INLINE);
+  _depth_rendered = true;
 
   VkViewport viewport{};
   viewport.x = 0;
@@ -53,9 +54,21 @@ void Viewport::beginRenderPass(VkCommandBuffer command_buffer,
 }
 
 void Viewport::_createImages() {
-  _depth_image = new GpuImage(
-      gpu, display->getDepthFormat(), _image_width, _image_height,
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+  // Sampled to build occlusion culling pyramids, if the format allows it
+  VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+  VkFormatProperties depth_properties;
+  vkGetPhysicalDeviceFormatProperties(
+      gpu->physical_device, display->getDepthFormat(), &depth_properties);
+  if (depth_properties.optimalTilingFeatures &
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+    depth_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+
+  _depth_image =
+      new GpuImage(gpu, display->getDepthFormat(), _image_width, _image_height,
+                   depth_usage, VMA_MEMORY_USAGE_GPU_ONLY);
+  _depth_rendered = false;
 
   for (uint32_t i = 0; i < _images.size(); i++) {
     VkImageViewCreateInfo view_info{};
@@ -73,6 +73,18 @@ class Viewport {
    */
   virtual void writeUniform(ViewportUniform*) = 0;
 
+  /**
+   * @brief Gets the depth attachment, which holds the last rendered frame's
+   * depth when read before this frame's render pass.
+   */
+  GpuImage* getDepthImage() { return _depth_image; }
+
+  /**
+   * @brief Tests if the depth image has been rendered to since its creation,
+   * leaving it in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL.
+   */
+  bool hasRenderedDepth() { return _depth_rendered; }
+
   /**
    * @brief Tests if a Viewport requires signaling for finished renders.
    * Useful for SDL, for example, which should only present on a queue when
@@ -154,6 +166,7 @@ class Viewport {
   Renderer* renderer;
 
   GpuImage* _depth_image;
+  bool _depth_rendered = false;
   uint32_t _current_image_index = 0;
 };
 
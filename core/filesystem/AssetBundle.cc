@@ -3,10 +3,17 @@
 
 #include "core/filesystem/AssetBundle.h"
 
+#include <sys/stat.h>
+
 #include <cstring>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
 
+#include "assets/common/WorkerPool.h"
 #include "log/log.h"
+#include "types/assets/LumpVerification_generated.h"
 #include "types/assets/Registry_generated.h"
 
 namespace mondradiko {
@@ -19,17 +26,20 @@ AssetBundle::~AssetBundle() {
   for (const auto& cached_lump : lump_cache) {
     if (cached_lump.lump) delete cached_lump.lump;
   }
+
+  if (zstd_dictionary != nullptr) ZSTD_freeDDict(zstd_dictionary);
 }
 
-AssetResult AssetBundle::loadRegistry(const char* registry_name) {
+AssetResult AssetBundle::loadRegistry(const char* registry_name,
+                                      bool paranoid, WorkerPool* workers) {
   std::vector<char> registry_data;
   const Registry* registry = nullptr;
 
+  auto registry_path = bundle_root / registry_name;
+
   {
     log_zone_named("Load and validate registry file");
 
-    auto registry_path = bundle_root / registry_name;
-
     log_msg_fmt("Opening asset bundle at %s", registry_path.c_str());
 
     if (!std::filesystem::exists(registry_path)) {
@@ -76,6 +86,19 @@ AssetResult AssetBundle::loadRegistry(const char* registry_name) {
     }
   }
 
+  if (registry->zstd_dictionary() != nullptr) {
+    log_zone_named("Load Zstandard dictionary");
+
+    if (registry->zstd_dictionary()->size() > ASSET_ZSTD_DICTIONARY_MAX_SIZE) {
+      log_err("Zstandard dictionary exceeds max size");
+      return AssetResult::BadSize;
+    }
+
+    // Digested once here, then shared read-only by every lump
+    zstd_dictionary = ZSTD_createDDict(registry->zstd_dictionary()->data(),
+                                       registry->zstd_dictionary()->size());
+  }
+
   {
     log_zone_named("Load initial prefabs");
 
@@ -92,6 +115,7 @@ AssetResult AssetBundle::loadRegistry(const char* registry_name) {
 
     uint32_t lump_count = registry->lumps()->size();
     lump_cache.resize(lump_count, {/*.lump=*/nullptr});
+    lump_mutexes = std::vector<std::mutex>(lump_count);
 
     for (uint32_t lump_index = 0; lump_index < lump_count; lump_index++) {
       const LumpEntry* lump_entry = registry->lumps()->Get(lump_index);
@@ -131,36 +155,35 @@ AssetResult AssetBundle::loadRegistry(const char* registry_name) {
       }
 
       lump_cache[lump_index].lump = nullptr;
+      lump_cache[lump_index].live_assets = 0;
+      lump_cache[lump_index].resident_size = 0;
       lump_cache[lump_index].file_size = lump_entry->file_size();
       lump_cache[lump_index].hash_method = lump_entry->hash_method();
       lump_cache[lump_index].checksum = lump_entry->checksum();
       lump_cache[lump_index].compression_method =
           lump_entry->compression_method();
+
+      lump_cache[lump_index].content_size = asset_offset;
+      lump_cache[lump_index].block_size = lump_entry->block_size();
+      lump_cache[lump_index].block_offsets.resize(0);
+
+      if (lump_entry->block_offsets() != nullptr) {
+        lump_cache[lump_index].block_offsets.assign(
+            lump_entry->block_offsets()->begin(),
+            lump_entry->block_offsets()->end());
+      }
     }
   }
 
   {
     log_zone_named("Build and validate lump cache");
 
-    for (uint32_t i = 0; i < lump_cache.size(); i++) {
-      auto lump_file = generateLumpName(i);
-      auto lump_path = bundle_root / lump_file;
-
-      if (!std::filesystem::exists(lump_path)) {
-        return AssetResult::FileNotFound;
-      }
+    auto verification_path = registry_path;
+    verification_path.replace_filename(registry_path.stem().string() +
+                                       "_verification.bin");
 
-      auto& cached_lump = lump_cache[i];
-      AssetLump lump(lump_path);
-
-      if (!lump.assertFileSize(cached_lump.file_size)) {
-        return AssetResult::BadSize;
-      }
-
-      if (!lump.assertHash(cached_lump.hash_method, cached_lump.checksum)) {
-        return AssetResult::InvalidChecksum;
-      }
-    }
+    AssetResult result = loadLumps(verification_path, paranoid, workers);
+    if (result != AssetResult::Success) return result;
   }
 
   return AssetResult::Success;
@@ -183,31 +206,293 @@ bool AssetBundle::isAssetRegistered(AssetId id) {
 }
 
 bool AssetBundle::loadAsset(const SerializedAsset** asset, AssetId id) {
+  auto iter = asset_lookup.find(id);
+
+  if (iter == asset_lookup.end()) {
+    log_err_fmt("Asset 0x%0dx is not in bundle %s", id, bundle_root.c_str());
+    return false;
+  }
+
+  return loadAsset(asset, iter->second);
+}
+
+bool AssetBundle::loadAsset(const SerializedAsset** asset,
+                            const AssetLookupEntry& stored_asset) {
   // TODO(marceline-cramer) Better error checking and logging
 
-  auto stored_asset = asset_lookup.find(id)->second;
   auto lump_index = stored_asset.lump_index;
 
   auto& cached_lump = lump_cache[lump_index];
+  std::unique_lock<std::mutex> lock(lump_mutexes[lump_index]);
 
+  // Lumps are verified and loaded by loadRegistry(), but are freed again by
+  // releaseAsset() once all of their assets are
   if (cached_lump.lump == nullptr) {
-    cached_lump.lump =
-        new AssetLump(bundle_root / generateLumpName(lump_index));
+    log_zone_named("Reload evicted lump");
+    cached_lump.lump = createLump(lump_index);
+    cached_lump.lump->decompress(cached_lump.compression_method);
+  }
+
+  bool success = cached_lump.lump->loadAsset(asset, stored_asset.offset,
+                                             stored_asset.size);
+
+  // Reloading and block decoding both grow the lump
+  updateResidentSize(&cached_lump);
+
+  if (!success) return false;
+
+  cached_lump.live_assets++;
+  return true;
+}
+
+void AssetBundle::releaseAsset(const AssetLookupEntry& stored_asset) {
+  auto& cached_lump = lump_cache[stored_asset.lump_index];
+  std::unique_lock<std::mutex> lock(lump_mutexes[stored_asset.lump_index]);
+
+  if (cached_lump.live_assets == 0) {
+    log_err_fmt("Lump %u of %s has no live assets to release",
+                stored_asset.lump_index, bundle_root.c_str());
+    return;
+  }
+
+  cached_lump.live_assets--;
+
+  if (cached_lump.live_assets == 0 && cached_lump.lump != nullptr) {
+    log_dbg_fmt("Evicting lump %u of %s", stored_asset.lump_index,
+                bundle_root.c_str());
+    delete cached_lump.lump;
+    cached_lump.lump = nullptr;
+    updateResidentSize(&cached_lump);
+  }
+}
+
+void AssetBundle::evictUnusedLumps() {
+  for (uint32_t i = 0; i < lump_cache.size(); i++) {
+    // A lump that's locked is being loaded from, so it isn't unused
+    std::unique_lock<std::mutex> lock(lump_mutexes[i], std::try_to_lock);
+    if (!lock.owns_lock()) continue;
+
+    auto& cached_lump = lump_cache[i];
+    if (cached_lump.lump == nullptr || cached_lump.live_assets > 0) continue;
+
+    log_dbg_fmt("Evicting unused lump %u of %s", i, bundle_root.c_str());
+    delete cached_lump.lump;
+    cached_lump.lump = nullptr;
+    updateResidentSize(&cached_lump);
+  }
+}
+
+size_t AssetBundle::getResidentSize() const { return resident_size; }
+
+void AssetBundle::updateResidentSize(LumpCacheEntry* cached_lump) {
+  size_t lump_size = 0;
+  if (cached_lump->lump != nullptr) {
+    lump_size = cached_lump->lump->getResidentSize();
+  }
+
+  resident_size += lump_size;
+  resident_size -= cached_lump->resident_size;
+  cached_lump->resident_size = lump_size;
+}
+
+AssetLump* AssetBundle::createLump(uint32_t lump_index) {
+  const auto& cached_lump = lump_cache[lump_index];
+
+  AssetLump* lump = new AssetLump(bundle_root / generateLumpName(lump_index));
+  lump->setContentSize(cached_lump.content_size);
+
+  if (cached_lump.compression_method == LumpCompressionMethod::LZ4Blocks) {
+    lump->setBlockIndex(cached_lump.block_size, cached_lump.block_offsets);
+  }
+
+  if (cached_lump.compression_method == LumpCompressionMethod::Zstd) {
+    lump->setDictionary(zstd_dictionary);
+  }
 
-    if (!cached_lump.lump->assertFileSize(cached_lump.file_size)) {
-      return false;
+  return lump;
+}
+
+AssetResult AssetBundle::loadLumps(
+    const std::filesystem::path& verification_path, bool paranoid,
+    WorkerPool* workers) {
+  log_zone;
+
+  std::vector<char> verification_data;
+  const LumpVerification* verification = nullptr;
+
+  if (paranoid) {
+    log_inf("Paranoid lump verification; rehashing all lumps");
+  } else if (std::filesystem::exists(verification_path)) {
+    std::ifstream verification_file(verification_path.c_str(),
+                                    std::ifstream::binary);
+
+    verification_file.seekg(0, std::ios::end);
+    std::streampos length = verification_file.tellg();
+    verification_file.seekg(0, std::ios::beg);
+
+    verification_data.resize(length);
+    verification_file.read(verification_data.data(), length);
+    verification_file.close();
+
+    flatbuffers::Verifier verifier(
+        reinterpret_cast<const uint8_t*>(verification_data.data()),
+        verification_data.size());
+
+    if (VerifyLumpVerificationBuffer(verifier)) {
+      verification = GetLumpVerification(verification_data.data());
+
+      if (verification->version() != MONDRADIKO_ASSET_VERSION ||
+          verification->lumps() == nullptr ||
+          verification->lumps()->size() != lump_cache.size()) {
+        log_inf("Lump verification cache is out of date");
+        verification = nullptr;
+      }
+    } else {
+      log_wrn_fmt("Ignoring invalid lump verification cache %s",
+                  verification_path.c_str());
     }
+  }
 
-    if (!cached_lump.lump->assertHash(cached_lump.hash_method,
-                                      cached_lump.checksum)) {
-      return false;
+  bool verification_changed = paranoid || verification == nullptr;
+
+  std::vector<bool> needs_hash(lump_cache.size(), true);
+
+  for (uint32_t i = 0; i < lump_cache.size(); i++) {
+    auto lump_file = generateLumpName(i);
+    auto lump_path = bundle_root / lump_file;
+    auto& cached_lump = lump_cache[i];
+
+    struct stat lump_stat;
+    if (stat(lump_path.c_str(), &lump_stat) != 0) {
+      return AssetResult::FileNotFound;
     }
 
-    cached_lump.lump->decompress(cached_lump.compression_method);
+    if (static_cast<size_t>(lump_stat.st_size) != cached_lump.file_size) {
+      log_err_fmt(
+          "Lump size assertion failed (expected 0x%08x bytes, got 0x%08x)",
+          cached_lump.file_size, lump_stat.st_size);
+      return AssetResult::BadSize;
+    }
+
+    cached_lump.modified_time =
+        static_cast<int64_t>(lump_stat.st_mtim.tv_sec) * 1000000000 +
+        lump_stat.st_mtim.tv_nsec;
+    cached_lump.inode = lump_stat.st_ino;
+
+    if (verification != nullptr) {
+      const VerifiedLump* verified = verification->lumps()->Get(i);
+
+      if (verified->path() != nullptr &&
+          verified->path()->str() == lump_file &&
+          verified->file_size() == cached_lump.file_size &&
+          verified->modified_time() == cached_lump.modified_time &&
+          verified->inode() == cached_lump.inode &&
+          verified->checksum() == cached_lump.checksum) {
+        log_dbg_fmt("Lump %s is unchanged; skipping hash", lump_file.c_str());
+        needs_hash[i] = false;
+      }
+    }
+
+    if (needs_hash[i]) verification_changed = true;
+  }
+
+  std::vector<std::future<AssetResult>> lump_results;
+
+  for (uint32_t i = 0; i < lump_cache.size(); i++) {
+    auto& cached_lump = lump_cache[i];
+    bool hash_lump = needs_hash[i];
+
+    // Each job only touches its own lump cache entry
+    lump_results.push_back(workers->submit([this, &cached_lump, i,
+                                            hash_lump]() {
+      log_zone_named("Load lump");
+
+      AssetLump* lump = createLump(i);
+
+      if (hash_lump &&
+          !lump->assertHash(cached_lump.hash_method, cached_lump.checksum)) {
+        delete lump;
+        return AssetResult::InvalidChecksum;
+      }
+
+      lump->decompress(cached_lump.compression_method);
+      cached_lump.lump = lump;
+      updateResidentSize(&cached_lump);
+      return AssetResult::Success;
+    }));
+  }
+
+  // Wait for every job, even after a failure, since they reference lump_cache
+  AssetResult result = AssetResult::Success;
+
+  for (auto& lump_result : lump_results) {
+    AssetResult job_result = lump_result.get();
+    if (result == AssetResult::Success) result = job_result;
   }
 
-  return cached_lump.lump->loadAsset(asset, stored_asset.offset,
-                                     stored_asset.size);
+  if (result != AssetResult::Success) return result;
+
+  if (verification_changed) saveVerification(verification_path);
+
+  return AssetResult::Success;
+}
+
+void AssetBundle::saveVerification(
+    const std::filesystem::path& verification_path) {
+  log_zone;
+
+  flatbuffers::FlatBufferBuilder fbb;
+
+  std::vector<flatbuffers::Offset<VerifiedLump>> verified_lumps;
+
+  for (uint32_t i = 0; i < lump_cache.size(); i++) {
+    const auto& cached_lump = lump_cache[i];
+
+    auto path_offset = fbb.CreateString(generateLumpName(i));
+
+    VerifiedLumpBuilder verified_lump(fbb);
+    verified_lump.add_path(path_offset);
+    verified_lump.add_file_size(cached_lump.file_size);
+    verified_lump.add_modified_time(cached_lump.modified_time);
+    verified_lump.add_inode(cached_lump.inode);
+    verified_lump.add_checksum(cached_lump.checksum);
+    verified_lumps.push_back(verified_lump.Finish());
+  }
+
+  auto lumps_offset = fbb.CreateVector(verified_lumps);
+
+  LumpVerificationBuilder verification(fbb);
+  verification.add_version(MONDRADIKO_ASSET_VERSION);
+  verification.add_lumps(lumps_offset);
+  fbb.Finish(verification.Finish());
+
+  // Write to a temporary file first so that other processes opening this
+  // bundle never see a partially written cache
+  auto temp_path = verification_path;
+  temp_path += ".tmp";
+
+  {
+    std::ofstream verification_file(temp_path.c_str(), std::ofstream::binary);
+    verification_file.write(reinterpret_cast<char*>(fbb.GetBufferPointer()),
+                            fbb.GetSize());
+    verification_file.close();
+
+    if (verification_file.fail()) {
+      // Bundles may be read-only, so this is not an error
+      log_wrn_fmt("Failed to write lump verification cache %s",
+                  verification_path.c_str());
+      std::error_code ec;
+      std::filesystem::remove(temp_path, ec);
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_path, verification_path, ec);
+  if (ec) {
+    log_wrn_fmt("Failed to write lump verification cache %s",
+                verification_path.c_str());
+  }
 }
 
 }  // namespace assets
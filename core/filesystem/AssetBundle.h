@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -11,6 +13,10 @@
 #include "core/filesystem/AssetLump.h"
 
 namespace mondradiko {
+
+// Forward declarations
+class WorkerPool;
+
 namespace assets {
 
 class AssetBundle {
@@ -18,35 +24,78 @@ class AssetBundle {
   explicit AssetBundle(const std::filesystem::path&);
   ~AssetBundle();
 
-  AssetResult loadRegistry(const char*);
+  struct AssetLookupEntry {
+    uint32_t lump_index;
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  using AssetLookup = std::unordered_map<AssetId, AssetLookupEntry>;
+
+  AssetResult loadRegistry(const char*, bool, WorkerPool*);
 
   void getChecksums(std::vector<LumpHash>&);
   void getInitialPrefabs(std::vector<AssetId>&);
+  const AssetLookup& getAssetLookup() const { return asset_lookup; }
   bool isAssetRegistered(AssetId);
+
+  // These may be called from any thread once loadRegistry() returns
   bool loadAsset(const SerializedAsset**, AssetId);
+  bool loadAsset(const SerializedAsset**, const AssetLookupEntry&);
+
+  // Called once for every successful loadAsset() when the asset is freed
+  void releaseAsset(const AssetLookupEntry&);
+
+  // Frees lumps that no loaded asset references; they're reloaded on demand
+  void evictUnusedLumps();
+  size_t getResidentSize() const;
 
  private:
   std::filesystem::path bundle_root;
 
   std::vector<AssetId> initial_prefabs;
 
-  struct AssetLookupEntry {
-    uint32_t lump_index;
-    uint32_t offset;
-    uint32_t size;
-  };
-
-  std::unordered_map<AssetId, AssetLookupEntry> asset_lookup;
+  AssetLookup asset_lookup;
 
   struct LumpCacheEntry {
     AssetLump* lump;
     size_t file_size;
+
+    // Number of loaded assets still referencing this lump
+    uint32_t live_assets;
+
+    // This lump's share of resident_size
+    size_t resident_size;
+
     LumpCompressionMethod compression_method;
     LumpHashMethod hash_method;
     LumpHash checksum;
+
+    // Uncompressed size and block index of block-compressed lumps
+    size_t content_size;
+    uint32_t block_size;
+    std::vector<uint64_t> block_offsets;
+
+    // File metadata used to key the verification cache
+    int64_t modified_time;
+    uint64_t inode;
   };
 
   std::vector<LumpCacheEntry> lump_cache;
+
+  // One per lump_cache entry, guarding its lump and live_assets, so that
+  // decoding one lump doesn't block loads from the others
+  std::vector<std::mutex> lump_mutexes;
+
+  // Kept up to date under the lump locks, so it's read without them
+  std::atomic<size_t> resident_size = 0;
+  void updateResidentSize(LumpCacheEntry*);
+
+  ZSTD_DDict* zstd_dictionary = nullptr;
+
+  AssetLump* createLump(uint32_t);
+  AssetResult loadLumps(const std::filesystem::path&, bool, WorkerPool*);
+  void saveVerification(const std::filesystem::path&);
 };
 
 }  // namespace assets
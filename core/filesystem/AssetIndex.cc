@@ -0,0 +1,78 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/filesystem/AssetIndex.h"
+
+#include <utility>
+
+#include "log/log.h"
+
+namespace mondradiko {
+namespace assets {
+
+static const uint32_t ASSET_INDEX_INITIAL_SLOT_BITS = 10;
+
+AssetIndex::AssetIndex() : slot_bits(ASSET_INDEX_INITIAL_SLOT_BITS) {
+  slots.resize(size_t(1) << slot_bits, {AssetId::NullAsset});
+}
+
+bool AssetIndex::insert(AssetId id, uint32_t bundle_index,
+                        const AssetBundle::AssetLookupEntry& location) {
+  if (id == AssetId::NullAsset) {
+    log_wrn("Can't index asset with null ID");
+    return false;
+  }
+
+  // Keep the load factor at or below 1/2
+  if ((entry_count + 1) * 2 > slots.size()) grow();
+
+  size_t slot = findSlot(id);
+  bool replaced = slots[slot].id == id;
+
+  if (!replaced) entry_count++;
+
+  slots[slot].id = id;
+  slots[slot].bundle_index = bundle_index;
+  slots[slot].location = location;
+
+  return replaced;
+}
+
+const AssetIndex::Entry* AssetIndex::find(AssetId id) const {
+  if (id == AssetId::NullAsset) return nullptr;
+
+  const Entry& entry = slots[findSlot(id)];
+  if (entry.id != id) return nullptr;
+  return &entry;
+}
+
+size_t AssetIndex::findSlot(AssetId id) const {
+  // Fibonacci hashing: the multiply carries every bit of the ID into the
+  // high bits, so those are used instead of the low bits
+  uint32_t hash = static_cast<uint32_t>(id) * 0x9E3779B1u;
+
+  size_t mask = slots.size() - 1;
+  size_t slot = hash >> (32 - slot_bits);
+
+  // Terminates because the table is never full
+  while (slots[slot].id != AssetId::NullAsset && slots[slot].id != id) {
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+void AssetIndex::grow() {
+  slot_bits++;
+
+  std::vector<Entry> old_slots(size_t(1) << slot_bits, {AssetId::NullAsset});
+  std::swap(slots, old_slots);
+
+  for (const auto& entry : old_slots) {
+    if (entry.id == AssetId::NullAsset) continue;
+    slots[findSlot(entry.id)] = entry;
+  }
+}
+
+}  // namespace assets
+}  // namespace mondradiko
@@ -0,0 +1,49 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "assets/common/AssetTypes.h"
+#include "core/filesystem/AssetBundle.h"
+
+namespace mondradiko {
+namespace assets {
+
+/**
+ * @brief Open-addressing hash table locating assets across every bundle.
+ *
+ * Uses linear probing over a power-of-two table kept at most half full, so
+ * a lookup is usually a single cache line no matter how many bundles are
+ * loaded. AssetId::NullAsset marks empty slots.
+ */
+class AssetIndex {
+ public:
+  struct Entry {
+    AssetId id;
+    uint32_t bundle_index;
+    AssetBundle::AssetLookupEntry location;
+  };
+
+  AssetIndex();
+
+  // Returns true if an existing entry for the asset was replaced
+  bool insert(AssetId, uint32_t, const AssetBundle::AssetLookupEntry&);
+  const Entry* find(AssetId) const;
+
+  size_t size() const { return entry_count; }
+
+ private:
+  std::vector<Entry> slots;
+  size_t entry_count = 0;
+
+  // log2 of slots.size()
+  uint32_t slot_bits;
+
+  size_t findSlot(AssetId) const;
+  void grow();
+};
+
+}  // namespace assets
+}  // namespace mondradiko
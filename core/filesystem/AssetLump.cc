@@ -3,10 +3,16 @@
 
 #include "core/filesystem/AssetLump.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <fstream>
 #include <vector>
 
 #include "log/log.h"
+#include "lz4.h"       // NOLINT
 #include "lz4frame.h"  // NOLINT
 #include "xxhash.h"    // NOLINT
 
@@ -16,6 +22,8 @@ namespace assets {
 const uint32_t ASSET_LOAD_CHUNK_SIZE = 4 * 1024;  // 4 KiB
 static_assert(ASSET_LOAD_CHUNK_SIZE >= LZ4F_HEADER_SIZE_MAX);
 
+const uint32_t ASSET_HASH_CHUNK_SIZE = 1024 * 1024;  // 1 MiB
+
 AssetLump::AssetLump(const std::filesystem::path& lump_path)
     : lump_path(lump_path) {
   log_zone;
@@ -26,7 +34,11 @@ AssetLump::~AssetLump() {
   log_zone;
   log_dbg_fmt("Unloading lump %s", lump_path.c_str());
 
-  if (loaded_data) delete[] loaded_data;
+  if (mapped) {
+    munmap(loaded_data, loaded_size);
+  } else if (loaded_data) {
+    delete[] loaded_data;
+  }
 }
 
 bool AssetLump::assertFileSize(size_t check_size) {
@@ -57,14 +69,16 @@ bool AssetLump::assertHash(LumpHashMethod hash_method, LumpHash checksum) {
     case LumpHashMethod::xxHash: {
       log_inf("Hashing lump with xxHash");
 
-      char buffer[ASSET_LOAD_CHUNK_SIZE];
+      std::vector<char> buffer(ASSET_HASH_CHUNK_SIZE);
       XXH3_state_t* hash_state = XXH3_createState();
       XXH3_64bits_reset(hash_state);
 
       while (!lump_file.eof()) {
-        lump_file.read(buffer, sizeof(buffer));
+        lump_file.read(buffer.data(), buffer.size());
         auto bytes_read = lump_file.gcount();
-        if (bytes_read) XXH3_64bits_update(hash_state, buffer, bytes_read);
+        if (bytes_read) {
+          XXH3_64bits_update(hash_state, buffer.data(), bytes_read);
+        }
       }
 
       computed_hash = static_cast<LumpHash>(XXH3_64bits_digest(hash_state));
@@ -97,6 +111,20 @@ bool AssetLump::assertHash(LumpHashMethod hash_method, LumpHash checksum) {
   }
 }
 
+void AssetLump::setContentSize(size_t new_content_size) {
+  content_size = new_content_size;
+}
+
+void AssetLump::setBlockIndex(uint32_t new_block_size,
+                              const std::vector<uint64_t>& new_block_offsets) {
+  block_size = new_block_size;
+  block_offsets = new_block_offsets;
+}
+
+void AssetLump::setDictionary(const ZSTD_DDict* dictionary) {
+  zstd_dictionary = dictionary;
+}
+
 void AssetLump::decompress(LumpCompressionMethod compression_method) {
   if (loaded_data) return;
   log_zone;
@@ -128,10 +156,12 @@ void AssetLump::decompress(LumpCompressionMethod compression_method) {
                       LZ4F_getErrorName(result));
         }
 
+        // Streamed frames leave out their content size
         loaded_size = frame_info.contentSize;
+        if (loaded_size == 0) loaded_size = content_size;
 
-        if (loaded_size == 0) {
-          log_ftl("LZ4 compressed lump must contain content size");
+        if (loaded_size == 0 || loaded_size > ASSET_LUMP_MAX_SIZE) {
+          log_ftl("LZ4 compressed lump has an invalid content size");
         }
 
         loaded_data = new char[loaded_size];
@@ -179,11 +209,85 @@ void AssetLump::decompress(LumpCompressionMethod compression_method) {
       break;
     }
 
+    case LumpCompressionMethod::LZ4Blocks: {
+      if (block_size == 0 || block_offsets.size() < 2 ||
+          block_offsets.back() != file_size) {
+        log_err_fmt("Lump %s has an invalid block index", lump_path.c_str());
+        break;
+      }
+
+      // Keep the compressed blocks around, preferably without reading them
+      if (!mapFile(file_size)) {
+        loaded_size = file_size;
+        loaded_data = new char[loaded_size];
+        lump_file.read(loaded_data, loaded_size);
+      }
+
+      log_dbg_fmt("Loaded %lu LZ4 blocks from lump %s",
+                  block_offsets.size() - 1, lump_path.c_str());
+      block_compressed = true;
+      break;
+    }
+
+    case LumpCompressionMethod::Zstd: {
+      log_inf_fmt("Decompressing lump %s with Zstandard", lump_path.c_str());
+
+      std::vector<char> compressed(file_size);
+      lump_file.read(compressed.data(), compressed.size());
+
+      uint64_t frame_size =
+          ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+
+      if (frame_size == ZSTD_CONTENTSIZE_ERROR) {
+        log_err("Zstandard compressed lump has an invalid frame");
+        break;
+      }
+
+      // Streamed frames leave out their content size
+      if (frame_size != ZSTD_CONTENTSIZE_UNKNOWN) content_size = frame_size;
+
+      if (content_size == 0 || content_size > ASSET_LUMP_MAX_SIZE) {
+        log_err("Zstandard compressed lump has an invalid content size");
+        break;
+      }
+
+      ZSTD_DCtx* context = ZSTD_createDCtx();
+      char* decompressed_data = new char[content_size];
+      size_t result;
+
+      if (zstd_dictionary != nullptr) {
+        result = ZSTD_decompress_usingDDict(
+            context, decompressed_data, content_size, compressed.data(),
+            compressed.size(), zstd_dictionary);
+      } else {
+        result = ZSTD_decompressDCtx(context, decompressed_data, content_size,
+                                     compressed.data(), compressed.size());
+      }
+
+      ZSTD_freeDCtx(context);
+
+      if (ZSTD_isError(result)) {
+        log_err_fmt("Zstandard decompression failed: %s",
+                    ZSTD_getErrorName(result));
+        delete[] decompressed_data;
+        break;
+      }
+
+      loaded_size = result;
+      loaded_data = decompressed_data;
+      break;
+    }
+
     default: {
       log_wrn("Unrecognized lump compression method");
     }
 
     case LumpCompressionMethod::None: {
+      if (mapFile(file_size)) {
+        log_dbg_fmt("Mapped lump %s directly from disk", lump_path.c_str());
+        break;
+      }
+
       log_dbg_fmt("Loading lump %s directly from disk", lump_path.c_str());
 
       loaded_size = file_size;
@@ -196,15 +300,62 @@ void AssetLump::decompress(LumpCompressionMethod compression_method) {
   lump_file.close();
 }
 
+bool AssetLump::mapFile(size_t file_size) {
+  log_zone;
+
+  // mmap() can't create empty mappings
+  if (file_size == 0) return false;
+
+  int lump_fd = open(lump_path.c_str(), O_RDONLY);
+  if (lump_fd == -1) {
+    log_wrn_fmt("Failed to open lump %s for mapping", lump_path.c_str());
+    return false;
+  }
+
+  // Map read-only and shared so that every process loading this bundle is
+  // served from the same page cache, and so that only touched assets are
+  // ever read from disk
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, lump_fd, 0);
+
+  // The mapping holds its own reference to the file
+  close(lump_fd);
+
+  if (mapping == MAP_FAILED) {
+    log_wrn_fmt("Failed to map lump %s", lump_path.c_str());
+    return false;
+  }
+
+  // Assets are accessed individually, so don't bother with readahead
+  madvise(mapping, file_size, MADV_RANDOM);
+
+  loaded_size = file_size;
+  loaded_data = static_cast<char*>(mapping);
+  mapped = true;
+  return true;
+}
+
 bool AssetLump::loadAsset(const SerializedAsset** asset, size_t offset,
                           size_t size) {
-  if (offset + size > loaded_size) {
-    log_err_fmt("Asset range exceeds lump size of 0x%0lx", loaded_size);
-    return false;
+  const char* asset_bytes;
+
+  if (block_compressed) {
+    if (offset + size > content_size) {
+      log_err_fmt("Asset range exceeds lump size of 0x%0lx", content_size);
+      return false;
+    }
+
+    asset_bytes = decodeBlocks(offset, size);
+    if (asset_bytes == nullptr) return false;
+  } else {
+    if (offset + size > loaded_size) {
+      log_err_fmt("Asset range exceeds lump size of 0x%0lx", loaded_size);
+      return false;
+    }
+
+    asset_bytes = loaded_data + offset;
   }
 
-  const uint8_t* asset_data =
-      reinterpret_cast<const uint8_t*>(loaded_data + offset);
+  const uint8_t* asset_data = reinterpret_cast<const uint8_t*>(asset_bytes);
 
   flatbuffers::Verifier verifier(asset_data, size);
   if (!VerifySerializedAssetBuffer(verifier)) {
@@ -217,5 +368,62 @@ bool AssetLump::loadAsset(const SerializedAsset** asset, size_t offset,
   return true;
 }
 
+size_t AssetLump::getResidentSize() const {
+  size_t resident_size = decoded_size;
+  if (loaded_data != nullptr && !mapped) resident_size += loaded_size;
+  return resident_size;
+}
+
+const char* AssetLump::decodeBlocks(size_t offset, size_t size) {
+  auto iter = decoded_assets.find(offset);
+  if (iter != decoded_assets.end()) {
+    // The block start is aligned to block_size, so re-derive the asset start
+    return iter->second.data() + offset % block_size;
+  }
+
+  log_zone;
+
+  size_t first_block = offset / block_size;
+  size_t last_block = (offset + size - 1) / block_size;
+
+  if (last_block + 1 >= block_offsets.size()) {
+    log_err("Asset range exceeds lump block index");
+    return nullptr;
+  }
+
+  size_t decoded_start = first_block * block_size;
+  size_t decoded_end = std::min((last_block + 1) * block_size, content_size);
+
+  std::vector<char> decoded(decoded_end - decoded_start);
+
+  for (size_t block = first_block; block <= last_block; block++) {
+    uint64_t compressed_start = block_offsets[block];
+    uint64_t compressed_end = block_offsets[block + 1];
+
+    if (compressed_start > compressed_end || compressed_end > loaded_size) {
+      log_err_fmt("Block %lu exceeds lump size of 0x%0lx", block, loaded_size);
+      return nullptr;
+    }
+
+    size_t block_start = block * block_size - decoded_start;
+    size_t block_capacity =
+        std::min(static_cast<size_t>(block_size), decoded.size() - block_start);
+
+    int block_decoded_size = LZ4_decompress_safe(
+        loaded_data + compressed_start, decoded.data() + block_start,
+        compressed_end - compressed_start, block_capacity);
+
+    if (block_decoded_size < 0 ||
+        static_cast<size_t>(block_decoded_size) != block_capacity) {
+      log_err_fmt("Failed to decompress LZ4 block %lu", block);
+      return nullptr;
+    }
+  }
+
+  decoded_size += decoded.size();
+  auto stored = decoded_assets.emplace(offset, std::move(decoded)).first;
+  return stored->second.data() + (offset - decoded_start);
+}
+
 }  // namespace assets
 }  // namespace mondradiko
@@ -4,10 +4,13 @@
 #pragma once
 
 #include <filesystem>
+#include <unordered_map>
+#include <vector>
 
 #include "assets/common/AssetTypes.h"
 #include "types/assets/SerializedAsset_generated.h"
 #include "types/assets/types_generated.h"
+#include "zstd.h"  // NOLINT
 
 namespace mondradiko {
 namespace assets {
@@ -20,15 +23,46 @@ class AssetLump {
   bool assertFileSize(size_t);
   bool assertHash(LumpHashMethod, LumpHash);
 
+  void setContentSize(size_t);
+  void setBlockIndex(uint32_t, const std::vector<uint64_t>&);
+  void setDictionary(const ZSTD_DDict*);
   void decompress(LumpCompressionMethod);
 
   bool loadAsset(const SerializedAsset**, size_t, size_t);
 
+  // Heap memory held by this lump. Mapped lumps are paged in and out by the
+  // OS, so they aren't counted.
+  size_t getResidentSize() const;
+
  private:
   std::filesystem::path lump_path;
 
-  size_t loaded_size;
+  size_t loaded_size = 0;
   char* loaded_data = nullptr;
+
+  // If true, loaded_data points into a read-only mapping of the lump file
+  // instead of a heap allocation
+  bool mapped = false;
+
+  bool mapFile(size_t);
+
+  // Uncompressed size, from the registry, for frames that don't record it
+  size_t content_size = 0;
+
+  // Block-compressed lumps keep loaded_data compressed, and only decode the
+  // blocks covering each requested asset
+  bool block_compressed = false;
+  uint32_t block_size = 0;
+  std::vector<uint64_t> block_offsets;
+
+  // Decoded assets, keyed by offset, kept alive for as long as the lump
+  std::unordered_map<size_t, std::vector<char>> decoded_assets;
+  size_t decoded_size = 0;
+
+  const char* decodeBlocks(size_t, size_t);
+
+  // Owned by the AssetBundle
+  const ZSTD_DDict* zstd_dictionary = nullptr;
 };
 
 }  // namespace assets
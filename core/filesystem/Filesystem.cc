@@ -5,21 +5,44 @@
 
 #include <sstream>
 
+#include "core/cvars/BoolCVar.h"
+#include "core/cvars/CVarScope.h"
+#include "core/cvars/IntCVar.h"
 #include "log/log.h"
 
 namespace mondradiko {
 
-Filesystem::Filesystem() { log_zone; }
+void Filesystem::initCVars(CVarScope* cvars) {
+  CVarScope* filesystem = cvars->addChild("filesystem");
+
+  filesystem->addValue<BoolCVar>("paranoid_verification");
+
+  // 0 uses one thread per hardware thread
+  filesystem->addValue<IntCVar>("worker_threads", 0, 256);
+}
+
+Filesystem::Filesystem(const CVarScope* cvars)
+    : cvars(cvars->getChild("filesystem")) {
+  log_zone;
+
+  int64_t worker_threads = this->cvars->get<IntCVar>("worker_threads");
+  workers = new WorkerPool(worker_threads);
+}
 
 Filesystem::~Filesystem() {
   for (auto asset_bundle : asset_bundles) {
     delete asset_bundle;
   }
+
+  if (workers != nullptr) delete workers;
 }
 
 bool Filesystem::loadAssetBundle(const std::filesystem::path& bundle_root) {
+  bool paranoid = cvars->get<BoolCVar>("paranoid_verification");
+
   assets::AssetBundle* asset_bundle = new assets::AssetBundle(bundle_root);
-  auto result = asset_bundle->loadRegistry("registry.bin");
+  auto result =
+      asset_bundle->loadRegistry("registry.bin", paranoid, workers);
   if (result != assets::AssetResult::Success) {
     const char* error_string = assets::getAssetResultString(result);
     log_err_fmt("Failed to load asset bundle registry: %s", error_string);
@@ -27,11 +50,33 @@ bool Filesystem::loadAssetBundle(const std::filesystem::path& bundle_root) {
     return false;
   }
 
+  std::unique_lock<std::mutex> lock(bundles_mutex);
+
+  uint32_t bundle_index = asset_bundles.size();
   asset_bundles.push_back(asset_bundle);
+
+  // Bundles loaded later override assets registered by earlier bundles
+  for (const auto& asset : asset_bundle->getAssetLookup()) {
+    if (asset_index.insert(asset.first, bundle_index, asset.second)) {
+      log_dbg_fmt("Asset 0x%0dx overridden by bundle %s", asset.first,
+                  bundle_root.c_str());
+    }
+  }
+
   return true;
 }
 
+std::future<bool> Filesystem::loadAssetBundleAsync(
+    const std::filesystem::path& bundle_root) {
+  // Runs on its own thread, because the bundle's lumps are loaded on the
+  // worker pool and waiting on them from a worker could deadlock
+  return std::async(std::launch::async, [this, bundle_root]() {
+    return loadAssetBundle(bundle_root);
+  });
+}
+
 void Filesystem::getChecksums(std::vector<assets::LumpHash>& local_checksums) {
+  std::unique_lock<std::mutex> lock(bundles_mutex);
   local_checksums.resize(0);
 
   for (auto asset_bundle : asset_bundles) {
@@ -43,6 +88,7 @@ void Filesystem::getChecksums(std::vector<assets::LumpHash>& local_checksums) {
 }
 
 void Filesystem::getInitialPrefabs(std::vector<assets::AssetId>& prefabs) {
+  std::unique_lock<std::mutex> lock(bundles_mutex);
   prefabs.resize(0);
 
   for (auto asset_bundle : asset_bundles) {
@@ -52,16 +98,57 @@ void Filesystem::getInitialPrefabs(std::vector<assets::AssetId>& prefabs) {
   }
 }
 
-bool Filesystem::loadAsset(const assets::SerializedAsset** asset, AssetId id) {
-  // TODO(marceline-cramer) The index of each asset's bundle could be cached
-  for (auto asset_bundle : asset_bundles) {
-    if (asset_bundle->isAssetRegistered(id)) {
-      return asset_bundle->loadAsset(asset, id);
+bool Filesystem::loadAsset(const assets::SerializedAsset** asset, AssetId id,
+                           AssetLocation* location) {
+  assets::AssetBundle* asset_bundle;
+
+  {
+    std::unique_lock<std::mutex> lock(bundles_mutex);
+
+    const assets::AssetIndex::Entry* entry = asset_index.find(id);
+
+    if (entry == nullptr) {
+      log_err_fmt("Asset 0x%0dx does not exist", id);
+      return false;
     }
+
+    // Copied, since the index entry is replaced if the asset is overridden
+    *location = *entry;
+    asset_bundle = asset_bundles[entry->bundle_index];
+  }
+
+  // Decoding only locks the lump, so reads from other lumps can run alongside
+  return asset_bundle->loadAsset(asset, location->location);
+}
+
+void Filesystem::releaseAsset(const AssetLocation& location) {
+  assets::AssetBundle* asset_bundle;
+
+  {
+    std::unique_lock<std::mutex> lock(bundles_mutex);
+    asset_bundle = asset_bundles[location.bundle_index];
+  }
+
+  asset_bundle->releaseAsset(location.location);
+}
+
+void Filesystem::evictUnusedLumps() {
+  std::unique_lock<std::mutex> lock(bundles_mutex);
+
+  for (auto asset_bundle : asset_bundles) {
+    asset_bundle->evictUnusedLumps();
+  }
+}
+
+size_t Filesystem::getResidentLumpSize() {
+  std::unique_lock<std::mutex> lock(bundles_mutex);
+
+  size_t resident_size = 0;
+  for (auto asset_bundle : asset_bundles) {
+    resident_size += asset_bundle->getResidentSize();
   }
 
-  log_err_fmt("Asset 0x%0dx does not exist", id);
-  return false;
+  return resident_size;
 }
 
 toml::value Filesystem::loadToml(const std::filesystem::path& toml_path) {
@@ -4,28 +4,60 @@
 #pragma once
 
 #include <filesystem>
+#include <future>
+#include <mutex>
 #include <vector>
 
+#include "assets/common/WorkerPool.h"
 #include "core/assets/Asset.h"
 #include "core/filesystem/AssetBundle.h"
+#include "core/filesystem/AssetIndex.h"
 #include "lib/include/toml_headers.h"
 
 namespace mondradiko {
 
+// Forward declarations
+class CVarScope;
+
 class Filesystem {
  public:
-  Filesystem();
+  static void initCVars(CVarScope*);
+
+  explicit Filesystem(const CVarScope*);
   ~Filesystem();
 
   bool loadAssetBundle(const std::filesystem::path&);
+  std::future<bool> loadAssetBundleAsync(const std::filesystem::path&);
   void getChecksums(std::vector<assets::LumpHash>&);
   void getInitialPrefabs(std::vector<assets::AssetId>&);
-  bool loadAsset(const assets::SerializedAsset**, AssetId);
 
-  toml::value loadToml(const std::filesystem::path&);
+  // Identifies the lump that a loaded asset was read from
+  using AssetLocation = assets::AssetIndex::Entry;
+
+  bool loadAsset(const assets::SerializedAsset**, AssetId, AssetLocation*);
+
+  // Releases against the lump the asset was read from, even if a bundle
+  // loaded since then overrides it
+  void releaseAsset(const AssetLocation&);
+
+  void evictUnusedLumps();
+  size_t getResidentLumpSize();
+
+  WorkerPool* getWorkers() { return workers; }
+
+  static toml::value loadToml(const std::filesystem::path&);
 
  private:
+  const CVarScope* cvars;
+
+  WorkerPool* workers = nullptr;
+
+  // Only guards asset_bundles and asset_index; bundles lock their own lumps
+  std::mutex bundles_mutex;
   std::vector<assets::AssetBundle*> asset_bundles;
+
+  // Maps every loaded asset to its location in asset_bundles
+  assets::AssetIndex asset_index;
 };
 
 }  // namespace mondradiko
@@ -39,9 +39,12 @@ void GpuBuffer::reserve(size_t target_size) {
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
   VmaAllocationCreateInfo allocationCreateInfo{};
-  allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
   allocationCreateInfo.usage = memory_usage;
 
+  if (memory_usage != VMA_MEMORY_USAGE_GPU_ONLY) {
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  }
+
   if (vmaCreateBuffer(gpu->allocator, &bufferInfo, &allocationCreateInfo,
                       &buffer, &allocation, &allocation_info) != VK_SUCCESS) {
     log_ftl("Failed to allocate Vulkan buffer.");
@@ -53,7 +56,13 @@ void GpuBuffer::reserve(size_t target_size) {
 void GpuBuffer::writeData(const void* src) {
   // TODO(marceline-cramer) This function is bad, please replace
   // Consider a streaming job system for all static GPU assets
-  memcpy(allocation_info.pMappedData, src, allocation_info.size);
+  if (allocation_info.pMappedData == nullptr) {
+    log_ftl("Attempted to write to unmapped GPU buffer");
+  }
+
+  // The allocation may be padded past the buffer's size, so only copy as
+  // much as the caller asked for
+  memcpy(allocation_info.pMappedData, src, buffer_size);
 }
 
 }  // namespace mondradiko
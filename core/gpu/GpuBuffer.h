@@ -16,17 +16,20 @@ class GpuBuffer {
             VkBufferUsageFlags buffer_usage_flags)
       : GpuBuffer(gpu, initial_size, buffer_usage_flags,
                   VMA_MEMORY_USAGE_CPU_TO_GPU) {}
+
+  // Buffers with VMA_MEMORY_USAGE_GPU_ONLY can't be written by the CPU, and
+  // have to be filled through a GpuUploader
+  GpuBuffer(GpuInstance*, size_t, VkBufferUsageFlags, VmaMemoryUsage);
   ~GpuBuffer();
 
   VkBuffer getBuffer() const { return buffer; }
   size_t getBufferSize() const { return buffer_size; }
+  void* getMappedData() const { return allocation_info.pMappedData; }
 
   // TODO(marceline-cramer) Get rid of this method
   void writeData(const void*);
 
  protected:
-  GpuBuffer(GpuInstance*, size_t, VkBufferUsageFlags, VmaMemoryUsage);
-
   /**
    * @warning This method may potentially recreate the buffer handle,
    * making any former references to this buffer invalid.
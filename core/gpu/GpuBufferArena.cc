@@ -0,0 +1,159 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/gpu/GpuBufferArena.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "core/gpu/GpuBuffer.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+GpuBufferArena::GpuBufferArena(GpuInstance* gpu, size_t block_size,
+                               VkBufferUsageFlags usage)
+    : gpu(gpu),
+      block_size(block_size),
+      usage(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT) {}
+
+GpuBufferArena::~GpuBufferArena() {
+  if (stats.allocation_count > 0) {
+    log_wrn_fmt("Destroying buffer arena with %u live allocations",
+                stats.allocation_count);
+  }
+
+  for (auto& block : blocks) {
+    if (block.buffer != nullptr) delete block.buffer;
+  }
+}
+
+GpuBufferArena::Allocation GpuBufferArena::allocate(size_t size,
+                                                    size_t alignment) {
+  Allocation allocation;
+  if (size == 0) return allocation;
+
+  bool found = false;
+  for (uint32_t i = 0; i < blocks.size() && !found; i++) {
+    found = allocateFromBlock(i, size, alignment, &allocation);
+  }
+
+  if (!found) {
+    // Oversized allocations get a block of their own
+    uint32_t block = createBlock(std::max(block_size, size));
+    allocateFromBlock(block, size, alignment, &allocation);
+  }
+
+  stats.allocation_count++;
+  stats.allocated_size += allocation.size;
+  return allocation;
+}
+
+void GpuBufferArena::free(const Allocation& allocation) {
+  if (allocation.size == 0) return;
+
+  Block& block = blocks[allocation.block];
+  block.allocation_count--;
+
+  stats.allocation_count--;
+  stats.allocated_size -= allocation.size;
+
+  if (block.allocation_count == 0) {
+    // Release empty blocks so that unloaded meshes give memory back
+    stats.block_count--;
+    stats.reserved_size -= block.size;
+
+    delete block.buffer;
+    block.buffer = nullptr;
+    block.size = 0;
+    block.free_ranges.clear();
+    return;
+  }
+
+  size_t offset = allocation.offset;
+  size_t size = allocation.size;
+
+  // Coalesce with the following range
+  auto next = block.free_ranges.lower_bound(offset);
+  if (next != block.free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    next = block.free_ranges.erase(next);
+  }
+
+  // Coalesce with the preceding range
+  if (next != block.free_ranges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      previous->second += size;
+      return;
+    }
+  }
+
+  block.free_ranges.emplace(offset, size);
+}
+
+bool GpuBufferArena::allocateFromBlock(uint32_t block_index, size_t size,
+                                       size_t alignment,
+                                       Allocation* allocation) {
+  Block& block = blocks[block_index];
+  if (block.buffer == nullptr) return false;
+
+  for (auto iter = block.free_ranges.begin(); iter != block.free_ranges.end();
+       iter++) {
+    size_t range_offset = iter->first;
+    size_t range_size = iter->second;
+
+    size_t offset = (range_offset + alignment - 1) / alignment * alignment;
+    if (offset + size > range_offset + range_size) continue;
+
+    block.free_ranges.erase(iter);
+
+    // Return the alignment padding and the remainder to the free list
+    if (offset > range_offset) {
+      block.free_ranges.emplace(range_offset, offset - range_offset);
+    }
+
+    size_t end = offset + size;
+    if (end < range_offset + range_size) {
+      block.free_ranges.emplace(end, range_offset + range_size - end);
+    }
+
+    block.allocation_count++;
+
+    allocation->block = block_index;
+    allocation->offset = offset;
+    allocation->size = size;
+    return true;
+  }
+
+  return false;
+}
+
+uint32_t GpuBufferArena::createBlock(size_t size) {
+  uint32_t block_index = blocks.size();
+
+  // Reuse the slot of a released block if there is one
+  for (uint32_t i = 0; i < blocks.size(); i++) {
+    if (blocks[i].buffer == nullptr) {
+      block_index = i;
+      break;
+    }
+  }
+
+  if (block_index == blocks.size()) blocks.emplace_back();
+
+  Block& block = blocks[block_index];
+  block.buffer = new GpuBuffer(gpu, size, usage, VMA_MEMORY_USAGE_GPU_ONLY);
+  block.size = size;
+  block.allocation_count = 0;
+  block.free_ranges.emplace(0, size);
+
+  stats.block_count++;
+  stats.reserved_size += size;
+
+  log_dbg_fmt("Created %zu KiB buffer arena block", size >> 10);
+
+  return block_index;
+}
+
+}  // namespace mondradiko
@@ -0,0 +1,69 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "lib/include/vulkan_headers.h"
+
+namespace mondradiko {
+
+// Forward declarations
+class GpuBuffer;
+class GpuInstance;
+
+/**
+ * @brief Sub-allocates ranges of large, device-local buffers.
+ * The arena grows one block at a time, and each block keeps a free list of
+ * ranges that are coalesced as they're freed. Ranges are filled with a
+ * GpuUploader.
+ */
+class GpuBufferArena {
+ public:
+  GpuBufferArena(GpuInstance*, size_t, VkBufferUsageFlags);
+  ~GpuBufferArena();
+
+  struct Allocation {
+    uint32_t block = 0;
+    size_t offset = 0;
+    size_t size = 0;
+  };
+
+  struct Stats {
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+    size_t allocated_size = 0;
+    size_t reserved_size = 0;
+  };
+
+  // Offsets are multiples of the alignment, which may be any element size
+  Allocation allocate(size_t, size_t);
+  void free(const Allocation&);
+
+  GpuBuffer* getBuffer(uint32_t block) const { return blocks[block].buffer; }
+  const Stats& getStats() const { return stats; }
+
+ private:
+  GpuInstance* gpu;
+  size_t block_size;
+  VkBufferUsageFlags usage;
+
+  struct Block {
+    GpuBuffer* buffer = nullptr;
+    size_t size = 0;
+    uint32_t allocation_count = 0;
+
+    // Free ranges, keyed by offset
+    std::map<size_t, size_t> free_ranges;
+  };
+
+  std::vector<Block> blocks;
+  Stats stats;
+
+  bool allocateFromBlock(uint32_t, size_t, size_t, Allocation*);
+  uint32_t createBlock(size_t);
+};
+
+}  // namespace mondradiko
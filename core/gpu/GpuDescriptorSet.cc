@@ -79,9 +79,14 @@ void GpuDescriptorSet::updateStorageBuffer(uint32_t binding,
 }
 
 void GpuDescriptorSet::updateImage(uint32_t binding, const GpuImage* image) {
+  updateImage(binding, image->view, image->layout);
+}
+
+void GpuDescriptorSet::updateImage(uint32_t binding, VkImageView view,
+                                   VkImageLayout layout) {
   VkDescriptorImageInfo image_info{};
-  image_info.imageView = image->view;
-  image_info.imageLayout = image->layout;
+  image_info.imageView = view;
+  image_info.imageLayout = layout;
 
   VkWriteDescriptorSet descriptor_writes{};
   descriptor_writes.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -95,14 +100,32 @@ void GpuDescriptorSet::updateImage(uint32_t binding, const GpuImage* image) {
   vkUpdateDescriptorSets(gpu->device, 1, &descriptor_writes, 0, nullptr);
 }
 
+void GpuDescriptorSet::updateStorageImage(uint32_t binding, VkImageView view) {
+  VkDescriptorImageInfo image_info{};
+  image_info.imageView = view;
+  image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  VkWriteDescriptorSet descriptor_writes{};
+  descriptor_writes.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_writes.dstSet = descriptor_set;
+  descriptor_writes.dstBinding = binding;
+  descriptor_writes.dstArrayElement = 0;
+  descriptor_writes.descriptorCount = 1;
+  descriptor_writes.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  descriptor_writes.pImageInfo = &image_info;
+
+  vkUpdateDescriptorSets(gpu->device, 1, &descriptor_writes, 0, nullptr);
+}
+
 void GpuDescriptorSet::updateDynamicOffset(uint32_t binding, uint32_t offset) {
   dynamic_offsets[binding] = offset * dynamic_offset_granularity[binding];
 }
 
 void GpuDescriptorSet::cmdBind(VkCommandBuffer command_buffer,
                                VkPipelineLayout pipeline_layout,
-                               uint32_t binding) const {
-  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                               uint32_t binding,
+                               VkPipelineBindPoint bind_point) const {
+  vkCmdBindDescriptorSets(command_buffer, bind_point,
                           pipeline_layout, binding, 1, &descriptor_set,
                           static_cast<uint32_t>(dynamic_offsets.size()),
                           dynamic_offsets.data());
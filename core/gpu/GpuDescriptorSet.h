@@ -27,10 +27,13 @@ class GpuDescriptorSet {
   void updateDynamicBuffer(uint32_t, GpuVector*);
   void updateStorageBuffer(uint32_t, const GpuBuffer*);
   void updateImage(uint32_t, const GpuImage*);
+  void updateImage(uint32_t, VkImageView, VkImageLayout);
+  void updateStorageImage(uint32_t, VkImageView);
 
   void updateDynamicOffset(uint32_t, uint32_t);
 
-  void cmdBind(VkCommandBuffer, VkPipelineLayout, uint32_t) const;
+  void cmdBind(VkCommandBuffer, VkPipelineLayout, uint32_t,
+               VkPipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) const;
 
  private:
   GpuInstance* gpu;
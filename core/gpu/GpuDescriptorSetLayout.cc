@@ -8,7 +8,9 @@
 
 namespace mondradiko {
 
-GpuDescriptorSetLayout::GpuDescriptorSetLayout(GpuInstance* gpu) : gpu(gpu) {}
+GpuDescriptorSetLayout::GpuDescriptorSetLayout(GpuInstance* gpu,
+                                               VkShaderStageFlags stage_flags)
+    : gpu(gpu), stage_flags(stage_flags) {}
 
 GpuDescriptorSetLayout::~GpuDescriptorSetLayout() {
   if (set_layout != VK_NULL_HANDLE)
@@ -20,20 +22,28 @@ void GpuDescriptorSetLayout::addCombinedImageSampler(VkSampler sampler) {
   cis_binding.binding = static_cast<uint32_t>(layout_bindings.size());
   cis_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   cis_binding.descriptorCount = 1;
-  cis_binding.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  cis_binding.stageFlags = stage_flags;
 
   layout_bindings.push_back(cis_binding);
   immutable_samplers.push_back(sampler);
 }
 
+void GpuDescriptorSetLayout::addStorageImage() {
+  VkDescriptorSetLayoutBinding storage_binding{};
+  storage_binding.binding = static_cast<uint32_t>(layout_bindings.size());
+  storage_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  storage_binding.descriptorCount = 1;
+  storage_binding.stageFlags = stage_flags;
+
+  layout_bindings.push_back(storage_binding);
+}
+
 void GpuDescriptorSetLayout::addStorageBuffer(uint32_t element_size) {
   VkDescriptorSetLayoutBinding storage_binding{};
   storage_binding.binding = static_cast<uint32_t>(layout_bindings.size());
   storage_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
   storage_binding.descriptorCount = 1;
-  storage_binding.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  storage_binding.stageFlags = stage_flags;
 
   layout_bindings.push_back(storage_binding);
   buffer_sizes.push_back(element_size);
@@ -46,8 +56,7 @@ void GpuDescriptorSetLayout::addDynamicUniformBuffer(uint32_t buffer_size) {
   dubo_binding.binding = static_cast<uint32_t>(layout_bindings.size());
   dubo_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   dubo_binding.descriptorCount = 1;
-  dubo_binding.stageFlags =
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  dubo_binding.stageFlags = stage_flags;
 
   layout_bindings.push_back(dubo_binding);
   buffer_sizes.push_back(buffer_size);
@@ -14,7 +14,10 @@ class GpuInstance;
 
 class GpuDescriptorSetLayout {
  public:
-  explicit GpuDescriptorSetLayout(GpuInstance*);
+  // Bindings are visible to every stage in the flags
+  explicit GpuDescriptorSetLayout(
+      GpuInstance*, VkShaderStageFlags = VK_SHADER_STAGE_VERTEX_BIT |
+                                         VK_SHADER_STAGE_FRAGMENT_BIT);
   ~GpuDescriptorSetLayout();
 
   // TODO(marceline-cramer) SPIR-V reflection w/ stage flags
@@ -22,7 +25,7 @@ class GpuDescriptorSetLayout {
   // void addSampler();
   void addCombinedImageSampler(VkSampler);
   // void addSampledImage();
-  // void addStorageImage();
+  void addStorageImage();
   // void addUniformTexelBuffer();
   // void addStorageTexelBuffer();
   // void addUniformBuffer();
@@ -37,6 +40,7 @@ class GpuDescriptorSetLayout {
 
  private:
   GpuInstance* gpu;
+  VkShaderStageFlags stage_flags;
 
   std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
   std::vector<VkSampler> immutable_samplers;
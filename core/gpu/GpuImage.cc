@@ -3,7 +3,6 @@
 
 #include "core/gpu/GpuImage.h"
 
-#include "core/gpu/GpuBuffer.h"
 #include "core/gpu/GpuInstance.h"
 #include "log/log.h"
 
@@ -12,17 +11,29 @@ namespace mondradiko {
 GpuImage::GpuImage(GpuInstance* gpu, VkFormat format, uint32_t width,
                    uint32_t height, VkImageUsageFlags image_usage_flags,
                    VmaMemoryUsage memory_usage)
+    : GpuImage(gpu, format, width, height, 1,
+               {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY},
+               image_usage_flags, memory_usage) {}
+
+GpuImage::GpuImage(GpuInstance* gpu, VkFormat format, uint32_t width,
+                   uint32_t height, uint32_t mip_levels,
+                   VkComponentMapping components,
+                   VkImageUsageFlags image_usage_flags,
+                   VmaMemoryUsage memory_usage)
     : format(format),
       layout(VK_IMAGE_LAYOUT_UNDEFINED),
-      width(height),
+      width(width),
       height(height),
+      mip_levels(mip_levels),
+      components(components),
       gpu(gpu) {
   VkImageCreateInfo imageCreateInfo{};
   imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
   imageCreateInfo.format = format;
   imageCreateInfo.extent = VkExtent3D{ width, height, 1 };
-  imageCreateInfo.mipLevels = 1;
+  imageCreateInfo.mipLevels = mip_levels;
   imageCreateInfo.arrayLayers = 1;
   imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -30,10 +41,15 @@ GpuImage::GpuImage(GpuInstance* gpu, VkFormat format, uint32_t width,
   imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   imageCreateInfo.initialLayout = layout;
 
+  // Only attachments get their own memory; sampled images share blocks
   VmaAllocationCreateInfo allocationCreateInfo{};
-  allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
   allocationCreateInfo.usage = memory_usage;
 
+  if (image_usage_flags & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+  }
+
   if (vmaCreateImage(gpu->allocator, &imageCreateInfo, &allocationCreateInfo,
                      &image, &allocation, &allocation_info) != VK_SUCCESS) {
     log_ftl("Failed to allocate Vulkan image.");
@@ -48,35 +64,6 @@ GpuImage::~GpuImage() {
   if (allocation != nullptr) vmaDestroyImage(gpu->allocator, image, allocation);
 }
 
-void GpuImage::writeData(const void* src) {
-  // TODO(marceline-cramer) This function is bad, please replace
-  // Consider a streaming job system for all static GPU assets
-  GpuBuffer stage(gpu, allocation_info.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  stage.writeData(src);
-
-  VkCommandBuffer commandBuffer = gpu->beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-
-  VkImageSubresourceLayers imageSubresource{};
-  imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  imageSubresource.mipLevel = 0;
-  imageSubresource.baseArrayLayer = 0;
-  imageSubresource.layerCount = 1;
-  region.imageSubresource = imageSubresource;
-
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(commandBuffer, stage.getBuffer(), image, layout, 1,
-                         &region);
-
-  gpu->endSingleTimeCommands(commandBuffer);
-}
-
 void GpuImage::transitionLayout(VkImageLayout targetLayout) {
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -89,7 +76,7 @@ void GpuImage::transitionLayout(VkImageLayout targetLayout) {
   VkImageSubresourceRange subresourceRange{};
   subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   subresourceRange.baseMipLevel = 0;
-  subresourceRange.levelCount = 1;
+  subresourceRange.levelCount = mip_levels;
   subresourceRange.baseArrayLayer = 0;
   subresourceRange.layerCount = 1;
   barrier.subresourceRange = subresourceRange;
@@ -145,11 +132,12 @@ void GpuImage::createView() {
   viewInfo.image = image;
   viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
   viewInfo.format = format;
+  viewInfo.components = components;
 
   VkImageSubresourceRange subresourceRange{};
   subresourceRange.aspectMask = aspect_mask;
   subresourceRange.baseMipLevel = 0;
-  subresourceRange.levelCount = 1;
+  subresourceRange.levelCount = mip_levels;
   subresourceRange.baseArrayLayer = 0;
   subresourceRange.layerCount = 1;
   viewInfo.subresourceRange = subresourceRange;
@@ -15,15 +15,18 @@ class GpuImage {
  public:
   GpuImage(GpuInstance*, VkFormat, uint32_t, uint32_t, VkImageUsageFlags,
            VmaMemoryUsage);
+  GpuImage(GpuInstance*, VkFormat, uint32_t, uint32_t, uint32_t,
+           VkComponentMapping, VkImageUsageFlags, VmaMemoryUsage);
   ~GpuImage();
 
-  void writeData(const void*);
   void transitionLayout(VkImageLayout);
 
   VkFormat format;
   VkImageLayout layout;
   uint32_t width;
   uint32_t height;
+  uint32_t mip_levels;
+  VkComponentMapping components;
   VmaAllocation allocation = nullptr;
   VmaAllocationInfo allocation_info;
   VkImage image = VK_NULL_HANDLE;
@@ -8,6 +8,7 @@
 
 #include "core/common/vulkan_validation.h"
 #include "core/displays/DisplayInterface.h"
+#include "core/gpu/GpuUploader.h"
 #include "log/log.h"
 #include "types/build_config.h"
 
@@ -37,6 +38,8 @@ GpuInstance::GpuInstance(DisplayInterface* display) : display(display) {
   createLogicalDevice(&requirements);
   createCommandPool();
   createAllocator();
+
+  uploader = new GpuUploader(this);
 }
 
 GpuInstance::~GpuInstance() {
@@ -46,6 +49,8 @@ GpuInstance::~GpuInstance() {
 
   vkDeviceWaitIdle(device);
 
+  if (uploader != nullptr) delete uploader;
+
   if (allocator != nullptr) vmaDestroyAllocator(allocator);
 
   if (command_pool != VK_NULL_HANDLE)
@@ -238,6 +243,7 @@ void GpuInstance::findPhysicalDevice(DisplayInterface* display) {
   }
 
   vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+  vkGetPhysicalDeviceFeatures(physical_device, &physical_device_features);
 }
 
 void GpuInstance::findQueueFamilies() {
@@ -256,6 +262,32 @@ void GpuInstance::findQueueFamilies() {
       break;
     }
   }
+
+  // Prefer a transfer-only family (i.e. a DMA engine), then any other family
+  // that isn't the graphics family
+  transfer_queue_family = graphics_queue_family;
+  bool found_dedicated = false;
+
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (i == graphics_queue_family) continue;
+    if (!(flags & VK_QUEUE_TRANSFER_BIT)) continue;
+
+    bool dedicated =
+        !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT);
+
+    if (dedicated && !found_dedicated) {
+      transfer_queue_family = i;
+      found_dedicated = true;
+    } else if (transfer_queue_family == graphics_queue_family) {
+      transfer_queue_family = i;
+    }
+  }
+
+  if (transfer_queue_family != graphics_queue_family) {
+    log_inf_fmt("Uploading on transfer queue family %u",
+                transfer_queue_family);
+  }
 }
 
 void GpuInstance::createLogicalDevice(VulkanRequirements* requirements) {
@@ -267,7 +299,8 @@ void GpuInstance::createLogicalDevice(VulkanRequirements* requirements) {
   }
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {graphics_queue_family};
+  std::set<uint32_t> uniqueQueueFamilies = {graphics_queue_family,
+                                            transfer_queue_family};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -283,6 +316,15 @@ void GpuInstance::createLogicalDevice(VulkanRequirements* requirements) {
   deviceFeatures.multiViewport = VK_TRUE;
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  // Block-compressed textures fall back to RGBA8 without this
+  deviceFeatures.textureCompressionBC =
+      physical_device_features.textureCompressionBC;
+
+  // Indirect mesh draws fall back to direct draws without these
+  deviceFeatures.multiDrawIndirect = physical_device_features.multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance =
+      physical_device_features.drawIndirectFirstInstance;
+
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   createInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
@@ -304,6 +346,7 @@ void GpuInstance::createLogicalDevice(VulkanRequirements* requirements) {
   }
 
   vkGetDeviceQueue(device, graphics_queue_family, 0, &graphics_queue);
+  vkGetDeviceQueue(device, transfer_queue_family, 0, &transfer_queue);
 }
 
 void GpuInstance::createCommandPool() {
@@ -11,6 +11,7 @@ namespace mondradiko {
 
 // Forward declarations
 class DisplayInterface;
+class GpuUploader;
 struct VulkanRequirements;
 
 class GpuInstance {
@@ -35,14 +36,21 @@ class GpuInstance {
   VkDevice device = VK_NULL_HANDLE;
 
   VkPhysicalDeviceProperties physical_device_properties;
+  VkPhysicalDeviceFeatures physical_device_features;
 
   uint32_t graphics_queue_family;
   VkQueue graphics_queue;
 
+  // Same as the graphics queue if there's no separate transfer family
+  uint32_t transfer_queue_family;
+  VkQueue transfer_queue;
+
   VkCommandPool command_pool = VK_NULL_HANDLE;
 
   VmaAllocator allocator = nullptr;
 
+  GpuUploader* uploader = nullptr;
+
  private:
   const std::vector<const char*> validationLayers = {
       "VK_LAYER_KHRONOS_validation"};
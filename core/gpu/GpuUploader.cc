@@ -0,0 +1,457 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/gpu/GpuUploader.h"
+
+#include <cstring>
+
+#include "core/gpu/GpuBuffer.h"
+#include "core/gpu/GpuImage.h"
+#include "core/gpu/GpuInstance.h"
+#include "log/log.h"
+
+namespace mondradiko {
+
+// Satisfies the copy offset alignment of every texel block size we upload
+static const size_t STAGING_ALIGNMENT = 16;
+
+// Every stage that reads uploaded data, including compute passes such as
+// the CullPass, which runs on the graphics queue
+static const VkPipelineStageFlags UPLOAD_DST_STAGES =
+    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+static const VkAccessFlags UPLOAD_DST_ACCESS =
+    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+    VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+GpuUploader::GpuUploader(GpuInstance* gpu)
+    : gpu(gpu),
+      separate_queue(gpu->transfer_queue_family != gpu->graphics_queue_family),
+      ring_size(32 << 20) {
+  log_zone;
+
+  VkCommandPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = gpu->transfer_queue_family;
+
+  if (vkCreateCommandPool(gpu->device, &pool_info, nullptr, &command_pool) !=
+      VK_SUCCESS) {
+    log_ftl("Failed to create upload command pool.");
+  }
+
+  if (separate_queue) {
+    pool_info.queueFamilyIndex = gpu->graphics_queue_family;
+
+    if (vkCreateCommandPool(gpu->device, &pool_info, nullptr,
+                            &acquire_command_pool) != VK_SUCCESS) {
+      log_ftl("Failed to create upload acquire command pool.");
+    }
+  }
+
+  ring = new GpuBuffer(gpu, ring_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
+
+GpuUploader::~GpuUploader() {
+  log_zone;
+
+  waitIdle();
+
+  for (auto batch : free_batches) {
+    vkDestroyFence(gpu->device, batch->fence, nullptr);
+
+    if (batch->transfer_complete != VK_NULL_HANDLE) {
+      vkDestroySemaphore(gpu->device, batch->transfer_complete, nullptr);
+    }
+
+    delete batch;
+  }
+
+  if (ring != nullptr) delete ring;
+
+  if (acquire_command_pool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(gpu->device, acquire_command_pool, nullptr);
+  }
+
+  if (command_pool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(gpu->device, command_pool, nullptr);
+  }
+}
+
+void GpuUploader::writeBuffer(GpuBuffer* buffer, size_t offset,
+                              const void* src, size_t size) {
+  if (size == 0) return;
+
+  VkBuffer stage;
+  size_t stage_offset;
+  stageData(src, size, &stage, &stage_offset);
+
+  Batch* batch = getRecordingBatch();
+
+  VkBufferCopy region{};
+  region.srcOffset = stage_offset;
+  region.dstOffset = offset;
+  region.size = size;
+
+  vkCmdCopyBuffer(batch->command_buffer, stage, buffer->getBuffer(), 1,
+                  &region);
+
+  if (separate_queue) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = UPLOAD_DST_ACCESS;
+    barrier.srcQueueFamilyIndex = gpu->transfer_queue_family;
+    barrier.dstQueueFamilyIndex = gpu->graphics_queue_family;
+    barrier.buffer = buffer->getBuffer();
+    barrier.offset = offset;
+    barrier.size = size;
+    pending_buffer_barriers.push_back(barrier);
+  } else {
+    pending_buffer_writes = true;
+  }
+}
+
+void GpuUploader::writeImage(GpuImage* image, const void* src, size_t size,
+                             const std::vector<size_t>& level_offsets) {
+  VkBuffer stage;
+  size_t stage_offset;
+  stageData(src, size, &stage, &stage_offset);
+
+  Batch* batch = getRecordingBatch();
+
+  VkImageSubresourceRange subresource_range{};
+  subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseMipLevel = 0;
+  subresource_range.levelCount = image->mip_levels;
+  subresource_range.baseArrayLayer = 0;
+  subresource_range.layerCount = 1;
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image->image;
+  barrier.subresourceRange = subresource_range;
+
+  vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  std::vector<VkBufferImageCopy> regions(level_offsets.size());
+
+  for (uint32_t level = 0; level < regions.size(); level++) {
+    VkBufferImageCopy& region = regions[level];
+    region.bufferOffset = stage_offset + level_offsets[level];
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    uint32_t level_width = image->width >> level;
+    uint32_t level_height = image->height >> level;
+    if (level_width == 0) level_width = 1;
+    if (level_height == 0) level_height = 1;
+
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {level_width, level_height, 1};
+  }
+
+  vkCmdCopyBufferToImage(batch->command_buffer, stage, image->image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(),
+                         regions.data());
+
+  // Every image is made readable by one barrier when the batch is flushed
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  if (separate_queue) {
+    barrier.srcQueueFamilyIndex = gpu->transfer_queue_family;
+    barrier.dstQueueFamilyIndex = gpu->graphics_queue_family;
+  }
+
+  pending_image_barriers.push_back(barrier);
+
+  image->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+void GpuUploader::flush() {
+  retireBatches(false);
+
+  if (recording == nullptr) return;
+
+  log_zone;
+
+  if (separate_queue) {
+    submitSeparateQueue();
+  } else {
+    submitSameQueue();
+  }
+
+  submitted_batches.push_back(recording);
+  recording = nullptr;
+
+  pending_image_barriers.clear();
+  pending_buffer_barriers.clear();
+  pending_buffer_writes = false;
+}
+
+void GpuUploader::submitSameQueue() {
+  VkMemoryBarrier buffer_barrier{};
+  buffer_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  buffer_barrier.dstAccessMask = UPLOAD_DST_ACCESS;
+
+  uint32_t buffer_barrier_count = pending_buffer_writes ? 1 : 0;
+
+  vkCmdPipelineBarrier(recording->command_buffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_DST_STAGES, 0,
+                       buffer_barrier_count, &buffer_barrier, 0, nullptr,
+                       pending_image_barriers.size(),
+                       pending_image_barriers.data());
+
+  vkEndCommandBuffer(recording->command_buffer);
+
+  VkSubmitInfo submit_info{};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &recording->command_buffer;
+
+  vkResetFences(gpu->device, 1, &recording->fence);
+  if (vkQueueSubmit(gpu->graphics_queue, 1, &submit_info, recording->fence) !=
+      VK_SUCCESS) {
+    log_ftl("Failed to submit uploads.");
+  }
+}
+
+void GpuUploader::submitSeparateQueue() {
+  // Release ownership to the graphics family
+  vkCmdPipelineBarrier(recording->command_buffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                       pending_buffer_barriers.size(),
+                       pending_buffer_barriers.data(),
+                       pending_image_barriers.size(),
+                       pending_image_barriers.data());
+
+  vkEndCommandBuffer(recording->command_buffer);
+
+  VkSubmitInfo transfer_info{};
+  transfer_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  transfer_info.commandBufferCount = 1;
+  transfer_info.pCommandBuffers = &recording->command_buffer;
+  transfer_info.signalSemaphoreCount = 1;
+  transfer_info.pSignalSemaphores = &recording->transfer_complete;
+
+  if (vkQueueSubmit(gpu->transfer_queue, 1, &transfer_info, VK_NULL_HANDLE) !=
+      VK_SUCCESS) {
+    log_ftl("Failed to submit uploads.");
+  }
+
+  // Acquire barriers must match the release barriers, minus the source
+  // access, which is already made available by the release
+  for (auto& barrier : pending_buffer_barriers) barrier.srcAccessMask = 0;
+  for (auto& barrier : pending_image_barriers) barrier.srcAccessMask = 0;
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(recording->acquire_command_buffer, &begin_info);
+
+  // Chained to the semaphore wait, which blocks the same stages
+  vkCmdPipelineBarrier(recording->acquire_command_buffer, UPLOAD_DST_STAGES,
+                       UPLOAD_DST_STAGES, 0, 0, nullptr,
+                       pending_buffer_barriers.size(),
+                       pending_buffer_barriers.data(),
+                       pending_image_barriers.size(),
+                       pending_image_barriers.data());
+
+  vkEndCommandBuffer(recording->acquire_command_buffer);
+
+  VkPipelineStageFlags wait_stages = UPLOAD_DST_STAGES;
+
+  VkSubmitInfo acquire_info{};
+  acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  acquire_info.waitSemaphoreCount = 1;
+  acquire_info.pWaitSemaphores = &recording->transfer_complete;
+  acquire_info.pWaitDstStageMask = &wait_stages;
+  acquire_info.commandBufferCount = 1;
+  acquire_info.pCommandBuffers = &recording->acquire_command_buffer;
+
+  // The acquire can't finish before the transfer, so its fence covers both
+  vkResetFences(gpu->device, 1, &recording->fence);
+  if (vkQueueSubmit(gpu->graphics_queue, 1, &acquire_info, recording->fence) !=
+      VK_SUCCESS) {
+    log_ftl("Failed to submit upload acquisition.");
+  }
+}
+
+void GpuUploader::waitIdle() {
+  flush();
+
+  while (!submitted_batches.empty()) {
+    retireBatches(true);
+  }
+}
+
+GpuUploader::Batch* GpuUploader::getRecordingBatch() {
+  if (recording != nullptr) return recording;
+
+  if (free_batches.empty()) {
+    Batch* batch = new Batch;
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(gpu->device, &alloc_info,
+                                 &batch->command_buffer) != VK_SUCCESS) {
+      log_ftl("Failed to allocate upload command buffer.");
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(gpu->device, &fence_info, nullptr, &batch->fence) !=
+        VK_SUCCESS) {
+      log_ftl("Failed to create upload fence.");
+    }
+
+    if (separate_queue) {
+      alloc_info.commandPool = acquire_command_pool;
+
+      if (vkAllocateCommandBuffers(gpu->device, &alloc_info,
+                                   &batch->acquire_command_buffer) !=
+          VK_SUCCESS) {
+        log_ftl("Failed to allocate upload acquire command buffer.");
+      }
+
+      VkSemaphoreCreateInfo semaphore_info{};
+      semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+      if (vkCreateSemaphore(gpu->device, &semaphore_info, nullptr,
+                            &batch->transfer_complete) != VK_SUCCESS) {
+        log_ftl("Failed to create upload semaphore.");
+      }
+    }
+
+    free_batches.push_back(batch);
+  }
+
+  recording = free_batches.back();
+  free_batches.pop_back();
+
+  recording->ring_end = ring_head;
+  recording->ring_used = 0;
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(recording->command_buffer, &begin_info);
+
+  return recording;
+}
+
+void GpuUploader::stageData(const void* src, size_t size, VkBuffer* stage,
+                            size_t* offset) {
+  if (size > ring_size) {
+    log_dbg_fmt("Staging %zu KiB upload outside of the ring", size >> 10);
+
+    GpuBuffer* dedicated_stage =
+        new GpuBuffer(gpu, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    dedicated_stage->writeData(src);
+
+    getRecordingBatch()->dedicated_stages.push_back(dedicated_stage);
+    *stage = dedicated_stage->getBuffer();
+    *offset = 0;
+    return;
+  }
+
+  size_t consumed;
+  while (!allocateRing(size, offset, &consumed)) {
+    // Submit whatever is holding ring space, then wait for the oldest batch
+    log_zone_named("Wait for staging ring");
+    flush();
+    retireBatches(true);
+  }
+
+  Batch* batch = getRecordingBatch();
+  batch->ring_used += consumed;
+  batch->ring_end = ring_head;
+
+  memcpy(static_cast<uint8_t*>(ring->getMappedData()) + *offset, src, size);
+  *stage = ring->getBuffer();
+}
+
+bool GpuUploader::allocateRing(size_t size, size_t* offset,
+                               size_t* consumed) {
+  size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+  if (ring_used == 0) {
+    ring_head = 0;
+    ring_tail = 0;
+  }
+
+  if (ring_used > 0 && ring_head == ring_tail) {
+    // Full
+    return false;
+  } else if (ring_head >= ring_tail) {
+    // Free space is at the end of the ring and before the tail
+    if (ring_head + size <= ring_size) {
+      *offset = ring_head;
+      *consumed = size;
+    } else if (size <= ring_tail) {
+      // Skip the end of the ring
+      *offset = 0;
+      *consumed = ring_size - ring_head + size;
+    } else {
+      return false;
+    }
+  } else {
+    // Free space is between the head and the tail
+    if (ring_head + size > ring_tail) return false;
+    *offset = ring_head;
+    *consumed = size;
+  }
+
+  ring_head = *offset + size;
+  ring_used += *consumed;
+  return true;
+}
+
+void GpuUploader::retireBatches(bool wait) {
+  while (!submitted_batches.empty()) {
+    Batch* batch = submitted_batches.front();
+
+    if (wait) {
+      vkWaitForFences(gpu->device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+      wait = false;
+    } else if (vkGetFenceStatus(gpu->device, batch->fence) != VK_SUCCESS) {
+      break;
+    }
+
+    ring_used -= batch->ring_used;
+    ring_tail = batch->ring_end;
+
+    for (auto stage : batch->dedicated_stages) delete stage;
+    batch->dedicated_stages.clear();
+
+    submitted_batches.pop_front();
+    free_batches.push_back(batch);
+  }
+}
+
+}  // namespace mondradiko
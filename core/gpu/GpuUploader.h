@@ -0,0 +1,100 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "lib/include/vulkan_headers.h"
+
+namespace mondradiko {
+
+// Forward declarations
+class GpuBuffer;
+class GpuImage;
+class GpuInstance;
+
+/**
+ * @brief Batches static data uploads into one submission per frame.
+ * Source data is copied into a persistent staging ring, and the copies and
+ * barriers are recorded into a shared command buffer that's submitted by
+ * flush(). Ring space is reclaimed once each batch's fence signals, so
+ * uploading never waits on the queue unless the ring is full.
+ *
+ * If the device has a separate transfer queue family, batches are submitted
+ * there and ownership of each resource is released to the graphics family.
+ * The matching acquire barriers are submitted to the graphics queue, which
+ * waits on a semaphore signaled by the transfer. Rendering only waits on
+ * uploads once it reaches a stage that reads them.
+ *
+ * Uploaded resources may be used by any command buffer that's submitted to
+ * the graphics queue after the next flush().
+ */
+class GpuUploader {
+ public:
+  explicit GpuUploader(GpuInstance*);
+  ~GpuUploader();
+
+  // Copies data to a buffer created with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+  void writeBuffer(GpuBuffer*, size_t, const void*, size_t);
+
+  // Copies every tightly-packed mip level of an image, given each level's
+  // offset, and leaves it in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  void writeImage(GpuImage*, const void*, size_t, const std::vector<size_t>&);
+
+  // Submits everything recorded since the last flush
+  void flush();
+
+  // Blocks until every submitted upload has finished
+  void waitIdle();
+
+ private:
+  GpuInstance* gpu;
+
+  // Uploads are recorded for the transfer queue family
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+
+  // Used to acquire ownership on the graphics queue family
+  bool separate_queue;
+  VkCommandPool acquire_command_pool = VK_NULL_HANDLE;
+
+  struct Batch {
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+
+    // Only created with a separate transfer queue
+    VkCommandBuffer acquire_command_buffer = VK_NULL_HANDLE;
+    VkSemaphore transfer_complete = VK_NULL_HANDLE;
+
+    // Ring space is released up to ring_end once the batch completes
+    size_t ring_end = 0;
+    size_t ring_used = 0;
+
+    // Uploads that didn't fit in the ring get their own staging buffers
+    std::vector<GpuBuffer*> dedicated_stages;
+  };
+
+  std::vector<Batch*> free_batches;
+  std::deque<Batch*> submitted_batches;
+  Batch* recording = nullptr;
+
+  std::vector<VkImageMemoryBarrier> pending_image_barriers;
+  std::vector<VkBufferMemoryBarrier> pending_buffer_barriers;
+  bool pending_buffer_writes = false;
+
+  GpuBuffer* ring = nullptr;
+  size_t ring_size;
+  size_t ring_head = 0;
+  size_t ring_tail = 0;
+  size_t ring_used = 0;
+
+  Batch* getRecordingBatch();
+  void submitSameQueue();
+  void submitSeparateQueue();
+  void stageData(const void*, size_t, VkBuffer*, size_t*);
+  bool allocateRing(size_t, size_t*, size_t*);
+  void retireBatches(bool);
+};
+
+}  // namespace mondradiko
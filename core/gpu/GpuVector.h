@@ -12,6 +12,8 @@
 
 namespace mondradiko {
 
+// Host-visible and persistently mapped, for data that's rewritten every
+// frame; static data belongs in a GPU_ONLY GpuBuffer instead
 class GpuVector : public GpuBuffer {
  public:
   GpuVector(GpuInstance* gpu, size_t element_size,
@@ -0,0 +1,635 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/renderer/CullPass.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "core/cvars/BoolCVar.h"
+#include "core/cvars/CVarScope.h"
+#include "core/displays/Viewport.h"
+#include "core/gpu/GpuBuffer.h"
+#include "core/gpu/GpuDescriptorPool.h"
+#include "core/gpu/GpuDescriptorSet.h"
+#include "core/gpu/GpuDescriptorSetLayout.h"
+#include "core/gpu/GpuImage.h"
+#include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuShader.h"
+#include "core/gpu/GpuVector.h"
+#include "core/renderer/MeshPass.h"
+#include "core/renderer/Renderer.h"
+#include "log/log.h"
+#include "shaders/depth_reduce.comp.h"
+#include "shaders/mesh_compact.comp.h"
+#include "shaders/mesh_cull.comp.h"
+
+namespace mondradiko {
+
+// Must match local_size_x in shaders/mesh_cull.comp and mesh_compact.comp
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// Must match local_size_x and local_size_y in shaders/depth_reduce.comp
+const uint32_t REDUCE_GROUP_SIZE = 8;
+
+struct CullConstants {
+  uint32_t instance_count;
+  uint32_t viewport_idx;
+};
+
+struct ReduceConstants {
+  uint32_t source_width;
+  uint32_t source_height;
+  uint32_t level_width;
+  uint32_t level_height;
+};
+
+static uint32_t floorPowerOfTwo(uint32_t value) {
+  uint32_t power = 1;
+  while (power * 2 <= value) power *= 2;
+  return power;
+}
+
+static VkImageAspectFlags getDepthAspects(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+    default:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+  }
+}
+
+static VkPipelineLayout createPipelineLayout(GpuInstance* gpu,
+                                             GpuDescriptorSetLayout* layout,
+                                             uint32_t push_constant_size) {
+  VkDescriptorSetLayout set_layout = layout->getSetLayout();
+
+  VkPushConstantRange push_constant_range{};
+  push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant_range.offset = 0;
+  push_constant_range.size = push_constant_size;
+
+  VkPipelineLayoutCreateInfo layout_info{};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &set_layout;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_constant_range;
+
+  VkPipelineLayout pipeline_layout;
+  if (vkCreatePipelineLayout(gpu->device, &layout_info, nullptr,
+                             &pipeline_layout) != VK_SUCCESS) {
+    log_ftl("Failed to create pipeline layout.");
+  }
+
+  return pipeline_layout;
+}
+
+static VkPipeline createComputePipeline(GpuInstance* gpu,
+                                        VkPipelineLayout pipeline_layout,
+                                        const GpuShader* shader) {
+  VkComputePipelineCreateInfo pipeline_info{};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage = shader->getStageCreateInfo();
+  pipeline_info.layout = pipeline_layout;
+
+  VkPipeline pipeline;
+  if (vkCreateComputePipelines(gpu->device, VK_NULL_HANDLE, 1, &pipeline_info,
+                               nullptr, &pipeline) != VK_SUCCESS) {
+    log_ftl("Failed to create compute pipeline.");
+  }
+
+  return pipeline;
+}
+
+static void cmdComputeBarrier(VkCommandBuffer command_buffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+void CullPass::initCVars(CVarScope* cvars) {
+  CVarScope* culling = cvars->addChild("culling");
+
+  culling->addValue<BoolCVar>("enabled");
+  culling->addValue<BoolCVar>("occlusion");
+}
+
+CullPass::CullPass(const CVarScope* cvars, Renderer* renderer,
+                   MeshPass* mesh_pass)
+    : cvars(cvars->getChild("culling")),
+      gpu(renderer->getGpu()),
+      renderer(renderer),
+      mesh_pass(mesh_pass) {
+  log_zone;
+
+  if (!this->cvars->get<BoolCVar>("enabled")) {
+    log_inf("GPU culling is disabled");
+    return;
+  }
+
+  // Visible instances are counted into the MeshPass's indirect draws
+  if (!mesh_pass->indirect_draws) {
+    log_wrn("Indirect draws aren't supported; disabling GPU culling");
+    return;
+  }
+
+  mesh_pass->gpu_culling = true;
+
+  {
+    log_zone_named("Create pyramid sampler");
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.mipLodBias = 0.0f;
+    sampler_info.anisotropyEnable = VK_FALSE;
+    sampler_info.compareEnable = VK_FALSE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sampler_info.unnormalizedCoordinates = VK_FALSE;
+
+    if (vkCreateSampler(gpu->device, &sampler_info, nullptr,
+                        &pyramid_sampler) != VK_SUCCESS) {
+      log_ftl("Failed to create depth pyramid sampler.");
+    }
+  }
+
+  {
+    log_zone_named("Create set layouts");
+
+    // Bindings are shared by shaders/mesh_cull.comp and mesh_compact.comp
+    cull_layout = new GpuDescriptorSetLayout(gpu, VK_SHADER_STAGE_COMPUTE_BIT);
+    cull_layout->addStorageBuffer(sizeof(MeshUniform));
+    cull_layout->addStorageBuffer(sizeof(CullViewportUniform));
+    cull_layout->addStorageBuffer(sizeof(uint32_t));
+    cull_layout->addCombinedImageSampler(pyramid_sampler);
+    cull_layout->addStorageBuffer(sizeof(VkDrawIndexedIndirectCommand));
+    cull_layout->addStorageBuffer(sizeof(uint32_t));
+    cull_layout->addStorageBuffer(sizeof(Stats));
+
+    reduce_layout =
+        new GpuDescriptorSetLayout(gpu, VK_SHADER_STAGE_COMPUTE_BIT);
+    reduce_layout->addCombinedImageSampler(pyramid_sampler);
+    reduce_layout->addStorageImage();
+  }
+
+  {
+    log_zone_named("Create pipelines");
+
+    cull_pipeline_layout =
+        createPipelineLayout(gpu, cull_layout, sizeof(CullConstants));
+    reduce_pipeline_layout =
+        createPipelineLayout(gpu, reduce_layout, sizeof(ReduceConstants));
+
+    cull_shader = new GpuShader(gpu, VK_SHADER_STAGE_COMPUTE_BIT,
+                                shaders_mesh_cull_comp,
+                                sizeof(shaders_mesh_cull_comp));
+    compact_shader = new GpuShader(gpu, VK_SHADER_STAGE_COMPUTE_BIT,
+                                   shaders_mesh_compact_comp,
+                                   sizeof(shaders_mesh_compact_comp));
+    reduce_shader = new GpuShader(gpu, VK_SHADER_STAGE_COMPUTE_BIT,
+                                  shaders_depth_reduce_comp,
+                                  sizeof(shaders_depth_reduce_comp));
+
+    cull_pipeline =
+        createComputePipeline(gpu, cull_pipeline_layout, cull_shader);
+    compact_pipeline =
+        createComputePipeline(gpu, cull_pipeline_layout, compact_shader);
+    reduce_pipeline =
+        createComputePipeline(gpu, reduce_pipeline_layout, reduce_shader);
+  }
+}
+
+CullPass::~CullPass() {
+  log_zone;
+
+  for (auto& pyramid : pyramids) destroyPyramid(&pyramid);
+
+  if (cull_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(gpu->device, cull_pipeline, nullptr);
+  if (compact_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(gpu->device, compact_pipeline, nullptr);
+  if (reduce_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(gpu->device, reduce_pipeline, nullptr);
+  if (cull_shader != nullptr) delete cull_shader;
+  if (compact_shader != nullptr) delete compact_shader;
+  if (reduce_shader != nullptr) delete reduce_shader;
+  if (cull_pipeline_layout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(gpu->device, cull_pipeline_layout, nullptr);
+  if (reduce_pipeline_layout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(gpu->device, reduce_pipeline_layout, nullptr);
+  if (cull_layout != nullptr) delete cull_layout;
+  if (reduce_layout != nullptr) delete reduce_layout;
+  if (pyramid_sampler != VK_NULL_HANDLE)
+    vkDestroySampler(gpu->device, pyramid_sampler, nullptr);
+}
+
+void CullPass::createFrameData(uint32_t frame_count) {
+  log_zone;
+
+  frame_data.resize(frame_count);
+
+  for (auto& frame : frame_data) {
+    frame.viewports = new GpuVector(gpu, sizeof(CullViewportUniform),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    frame.visibility = new GpuVector(gpu, sizeof(uint32_t),
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    frame.stats_buffer =
+        new GpuBuffer(gpu, sizeof(Stats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VMA_MEMORY_USAGE_GPU_TO_CPU);
+  }
+}
+
+void CullPass::destroyFrameData() {
+  log_zone;
+
+  for (auto& frame : frame_data) {
+    if (frame.viewports != nullptr) delete frame.viewports;
+    if (frame.visibility != nullptr) delete frame.visibility;
+    if (frame.stats_buffer != nullptr) delete frame.stats_buffer;
+  }
+
+  frame_data.clear();
+
+  // Pyramids are read by every frame in flight, which are now finished
+  for (auto& pyramid : pyramids) destroyPyramid(&pyramid);
+  pyramids.clear();
+}
+
+void CullPass::allocateDescriptors(uint32_t frame_index,
+                                   GpuDescriptorPool* descriptor_pool) {
+  log_zone;
+
+  auto& frame = frame_data[frame_index];
+
+  if (frame.stats_pending) {
+    // The Renderer has waited on this frame's fence, so its counts are final
+    memcpy(&stats, frame.stats_buffer->getMappedData(), sizeof(Stats));
+    frame.stats_pending = false;
+
+    log_plot("GPU culled meshes drawn", stats.drawn_count);
+    log_plot("GPU culled meshes outside frusta", stats.frustum_culled_count);
+    log_plot("GPU culled meshes occluded", stats.occlusion_culled_count);
+  }
+
+  frame.instance_count = 0;
+  frame.cull_descriptors.clear();
+  frame.reduce_descriptors.clear();
+
+  if (!mesh_pass->gpu_culling) return;
+
+  const auto& viewports = renderer->getViewports();
+  const auto& view_projections = renderer->getViewerViewProjections();
+  const auto& mesh_frame = mesh_pass->frame_data[frame_index];
+
+  if (viewports.size() > 0) {
+    frame.instance_count = mesh_frame.commands.size();
+  }
+
+  if (pyramids.size() < viewports.size()) pyramids.resize(viewports.size());
+
+  std::vector<bool> build_pyramids(viewports.size());
+
+  for (uint32_t i = 0; i < viewports.size(); i++) {
+    DepthPyramid& pyramid = pyramids[i];
+    const GpuImage* depth_image = viewports[i]->getDepthImage();
+
+    if (pyramid.image == nullptr ||
+        pyramid.source_width != depth_image->width ||
+        pyramid.source_height != depth_image->height) {
+      // Viewports are rarely resized, so waiting here is fine
+      vkDeviceWaitIdle(gpu->device);
+      destroyPyramid(&pyramid);
+      createPyramid(&pyramid, depth_image);
+    }
+
+    // Viewports are always rendered after they're culled, so the depth
+    // reflects the view stored here by the time the next frame reads it
+    build_pyramids[i] = frame.instance_count > 0 && pyramid.occlusion &&
+                        pyramid.has_history && viewports[i]->hasRenderedDepth();
+
+    CullViewportUniform uniform;
+    uniform.view_projection = view_projections[i];
+    uniform.previous_view_projection = pyramid.view_projection;
+    uniform.pyramid_size =
+        glm::vec2(pyramid.image->width, pyramid.image->height);
+    uniform.pyramid_levels = pyramid.image->mip_levels;
+    uniform.occlusion_enabled = build_pyramids[i] ? 1 : 0;
+    frame.viewports->writeElement(i, uniform);
+
+    pyramid.view_projection = view_projections[i];
+    pyramid.has_history = true;
+  }
+
+  if (frame.instance_count == 0) return;
+
+  // Every instance starts out culled from every viewport
+  frame.visibility->writeElement(frame.instance_count - 1, 0u);
+  memset(frame.visibility->getMappedData(), 0,
+         frame.instance_count * sizeof(uint32_t));
+  memset(frame.stats_buffer->getMappedData(), 0, sizeof(Stats));
+
+  for (uint32_t i = 0; i < viewports.size(); i++) {
+    const DepthPyramid& pyramid = pyramids[i];
+
+    GpuDescriptorSet* cull_descriptor = descriptor_pool->allocate(cull_layout);
+    cull_descriptor->updateStorageBuffer(0, mesh_frame.mesh_buffer);
+    cull_descriptor->updateStorageBuffer(1, frame.viewports);
+    cull_descriptor->updateStorageBuffer(2, frame.visibility);
+    cull_descriptor->updateImage(3, pyramid.image->view,
+                                 VK_IMAGE_LAYOUT_GENERAL);
+    cull_descriptor->updateStorageBuffer(4, mesh_frame.draw_buffer);
+    cull_descriptor->updateStorageBuffer(5, mesh_frame.instance_buffer);
+    cull_descriptor->updateStorageBuffer(6, frame.stats_buffer);
+    frame.cull_descriptors.push_back(cull_descriptor);
+
+    std::vector<GpuDescriptorSet*> reduce_descriptors;
+
+    if (build_pyramids[i]) {
+      for (uint32_t level = 0; level < pyramid.level_views.size(); level++) {
+        GpuDescriptorSet* reduce_descriptor =
+            descriptor_pool->allocate(reduce_layout);
+
+        // The first level is reduced from the depth attachment itself
+        if (level == 0) {
+          reduce_descriptor->updateImage(
+              0, viewports[i]->getDepthImage()->view,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        } else {
+          reduce_descriptor->updateImage(0, pyramid.level_views[level - 1],
+                                         VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        reduce_descriptor->updateStorageImage(1, pyramid.level_views[level]);
+        reduce_descriptors.push_back(reduce_descriptor);
+      }
+    }
+
+    frame.reduce_descriptors.push_back(reduce_descriptors);
+  }
+}
+
+void CullPass::preRender(uint32_t frame_index,
+                         VkCommandBuffer command_buffer) {
+  auto& frame = frame_data[frame_index];
+  if (frame.instance_count == 0) return;
+
+  log_zone;
+
+  const auto& viewports = renderer->getViewports();
+
+  {
+    log_zone_named("Build depth pyramids");
+
+    // Rebuilt pyramids are entirely rewritten, so last frame's contents are
+    // dropped, but its writes to them may still be in flight. Pyramids that
+    // aren't rebuilt are only transitioned once, so that the cull
+    // descriptors can bind them.
+    std::vector<VkImageMemoryBarrier> pyramid_barriers;
+
+    for (uint32_t i = 0; i < viewports.size(); i++) {
+      bool rebuild = !frame.reduce_descriptors[i].empty();
+      if (!rebuild && pyramids[i].transitioned) continue;
+      pyramids[i].transitioned = true;
+
+      VkImageMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask =
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image = pyramids[i].image->image;
+      barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      barrier.subresourceRange.baseMipLevel = 0;
+      barrier.subresourceRange.levelCount = pyramids[i].image->mip_levels;
+      barrier.subresourceRange.baseArrayLayer = 0;
+      barrier.subresourceRange.layerCount = 1;
+      pyramid_barriers.push_back(barrier);
+    }
+
+    if (!pyramid_barriers.empty()) {
+      vkCmdPipelineBarrier(command_buffer,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                           nullptr, 0, nullptr, pyramid_barriers.size(),
+                           pyramid_barriers.data());
+    }
+
+    for (uint32_t i = 0; i < viewports.size(); i++) {
+      if (frame.reduce_descriptors[i].empty()) continue;
+      buildPyramid(command_buffer, viewports[i], pyramids[i],
+                   frame.reduce_descriptors[i]);
+    }
+  }
+
+  {
+    log_zone_named("Cull meshes");
+
+    uint32_t group_count =
+        (frame.instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      cull_pipeline);
+
+    for (uint32_t i = 0; i < viewports.size(); i++) {
+      frame.cull_descriptors[i]->cmdBind(command_buffer, cull_pipeline_layout,
+                                         0, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+      CullConstants constants;
+      constants.instance_count = frame.instance_count;
+      constants.viewport_idx = i;
+      vkCmdPushConstants(command_buffer, cull_pipeline_layout,
+                         VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                         &constants);
+
+      vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+      // Visibility is accumulated across viewports
+      cmdComputeBarrier(command_buffer);
+    }
+
+    // Shares the cull pipeline's layout, so the last viewport's descriptors
+    // and push constants stay bound
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      compact_pipeline);
+    vkCmdDispatch(command_buffer, group_count, 1, 1);
+  }
+
+  {
+    // Also orders the reads of the depth attachments before their render
+    // passes transition them, which happens after color attachment output
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  frame.stats_pending = true;
+}
+
+void CullPass::createPyramid(DepthPyramid* pyramid,
+                             const GpuImage* depth_image) {
+  log_zone;
+
+  // Power-of-two sizes halve evenly all the way down to 1x1
+  uint32_t width = floorPowerOfTwo(depth_image->width);
+  uint32_t height = floorPowerOfTwo(depth_image->height);
+
+  uint32_t levels = 1;
+  while ((std::max(width, height) >> levels) > 0) levels++;
+
+  VkComponentMapping components{};
+  components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+  components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+  components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+  components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+  pyramid->image = new GpuImage(
+      gpu, VK_FORMAT_R32_SFLOAT, width, height, levels, components,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+
+  // Each level is written through its own view
+  pyramid->level_views.resize(levels);
+  for (uint32_t level = 0; level < levels; level++) {
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = pyramid->image->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = VK_FORMAT_R32_SFLOAT;
+    view_info.components = components;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = level;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(gpu->device, &view_info, nullptr,
+                          &pyramid->level_views[level]) != VK_SUCCESS) {
+      log_ftl("Failed to create depth pyramid level view.");
+    }
+  }
+
+  pyramid->source_width = depth_image->width;
+  pyramid->source_height = depth_image->height;
+  pyramid->has_history = false;
+  pyramid->transitioned = false;
+
+  VkFormatProperties depth_properties;
+  vkGetPhysicalDeviceFormatProperties(gpu->physical_device,
+                                      depth_image->format, &depth_properties);
+  bool depth_sampled = depth_properties.optimalTilingFeatures &
+                       VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+  pyramid->occlusion = cvars->get<BoolCVar>("occlusion") && depth_sampled;
+  if (cvars->get<BoolCVar>("occlusion") && !depth_sampled) {
+    log_wrn("Depth format can't be sampled; disabling occlusion culling");
+  }
+}
+
+void CullPass::destroyPyramid(DepthPyramid* pyramid) {
+  for (auto level_view : pyramid->level_views) {
+    vkDestroyImageView(gpu->device, level_view, nullptr);
+  }
+
+  pyramid->level_views.clear();
+
+  if (pyramid->image != nullptr) delete pyramid->image;
+  pyramid->image = nullptr;
+}
+
+void CullPass::buildPyramid(
+    VkCommandBuffer command_buffer, Viewport* viewport,
+    const DepthPyramid& pyramid,
+    const std::vector<GpuDescriptorSet*>& reduce_descriptors) {
+  log_zone;
+
+  GpuImage* depth_image = viewport->getDepthImage();
+
+  {
+    // The last frame's render pass left its depth in this layout
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = depth_image->image;
+    barrier.subresourceRange.aspectMask = getDepthAspects(depth_image->format);
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+  }
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    reduce_pipeline);
+
+  ReduceConstants constants;
+  constants.source_width = depth_image->width;
+  constants.source_height = depth_image->height;
+
+  for (uint32_t level = 0; level < reduce_descriptors.size(); level++) {
+    constants.level_width = std::max(pyramid.image->width >> level, 1u);
+    constants.level_height = std::max(pyramid.image->height >> level, 1u);
+
+    reduce_descriptors[level]->cmdBind(command_buffer, reduce_pipeline_layout,
+                                       0, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdPushConstants(command_buffer, reduce_pipeline_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(
+        command_buffer,
+        (constants.level_width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+        (constants.level_height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+        1);
+
+    // Each level is read while reducing the next, and by culling
+    cmdComputeBarrier(command_buffer);
+
+    constants.source_width = constants.level_width;
+    constants.source_height = constants.level_height;
+  }
+}
+
+}  // namespace mondradiko
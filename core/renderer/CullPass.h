@@ -0,0 +1,134 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "core/renderer/RenderPass.h"
+#include "lib/include/glm_headers.h"
+
+namespace mondradiko {
+
+// Forward declarations
+class CVarScope;
+class GpuBuffer;
+class GpuDescriptorSetLayout;
+class GpuImage;
+class GpuInstance;
+class GpuShader;
+class GpuVector;
+class MeshPass;
+class Renderer;
+class Viewport;
+
+// One per viewport, read from a storage buffer by shaders/mesh_cull.comp
+struct CullViewportUniform {
+  glm::mat4 view_projection;
+  glm::mat4 previous_view_projection;
+  glm::vec2 pyramid_size;
+  uint32_t pyramid_levels;
+  uint32_t occlusion_enabled;
+};
+
+/**
+ * @brief Culls a MeshPass's instances in compute shaders before drawing.
+ * Instances are tested against each viewport's frustum, and against a
+ * depth pyramid reduced from that viewport's previous frame. Visible
+ * instances are compacted into the MeshPass's indirect draws.
+ *
+ * @note Add to the Renderer after the MeshPass, so that the MeshPass's
+ * draws are written before they're culled.
+ */
+class CullPass : public RenderPass {
+ public:
+  static void initCVars(CVarScope*);
+
+  CullPass(const CVarScope*, Renderer*, MeshPass*);
+  ~CullPass();
+
+  // Counted on the GPU and read back once their frame has finished
+  struct Stats {
+    uint32_t drawn_count = 0;
+    uint32_t frustum_culled_count = 0;
+    uint32_t occlusion_culled_count = 0;
+  };
+
+  // Counts from the most recently finished frame
+  const Stats& getStats() const { return stats; }
+
+  // RenderPass implementation
+  void createFrameData(uint32_t) final;
+  void destroyFrameData() final;
+  void allocateDescriptors(uint32_t, GpuDescriptorPool*) final;
+  void preRender(uint32_t, VkCommandBuffer) final;
+  void render(uint32_t, VkCommandBuffer, const GpuDescriptorSet*) final {}
+
+ private:
+  const CVarScope* cvars;
+  GpuInstance* gpu;
+  Renderer* renderer;
+  MeshPass* mesh_pass;
+
+  VkSampler pyramid_sampler = VK_NULL_HANDLE;
+
+  GpuDescriptorSetLayout* cull_layout = nullptr;
+  GpuDescriptorSetLayout* reduce_layout = nullptr;
+
+  VkPipelineLayout cull_pipeline_layout = VK_NULL_HANDLE;
+  VkPipelineLayout reduce_pipeline_layout = VK_NULL_HANDLE;
+
+  GpuShader* cull_shader = nullptr;
+  GpuShader* compact_shader = nullptr;
+  GpuShader* reduce_shader = nullptr;
+
+  VkPipeline cull_pipeline = VK_NULL_HANDLE;
+  VkPipeline compact_pipeline = VK_NULL_HANDLE;
+  VkPipeline reduce_pipeline = VK_NULL_HANDLE;
+
+  // One per viewport, kept across frames
+  struct DepthPyramid {
+    GpuImage* image = nullptr;
+    std::vector<VkImageView> level_views;
+    uint32_t source_width = 0;
+    uint32_t source_height = 0;
+
+    // Set once the image has left its initial, undefined layout
+    bool transitioned = false;
+
+    // Set if occlusion culling is enabled and the depth can be sampled
+    bool occlusion = false;
+
+    // The view that the viewport's depth was last rendered with
+    glm::mat4 view_projection;
+    bool has_history = false;
+  };
+
+  std::vector<DepthPyramid> pyramids;
+
+  struct FrameData {
+    GpuVector* viewports = nullptr;
+    GpuVector* visibility = nullptr;
+    GpuBuffer* stats_buffer = nullptr;
+    bool stats_pending = false;
+
+    // Zero if there's nothing to cull this frame
+    uint32_t instance_count = 0;
+
+    std::vector<GpuDescriptorSet*> cull_descriptors;
+
+    // One per pyramid level, per viewport; empty if a viewport's pyramid
+    // isn't built this frame
+    std::vector<std::vector<GpuDescriptorSet*>> reduce_descriptors;
+  };
+
+  std::vector<FrameData> frame_data;
+  Stats stats;
+
+  void createPyramid(DepthPyramid*, const GpuImage*);
+  void destroyPyramid(DepthPyramid*);
+  void buildPyramid(VkCommandBuffer, Viewport*, const DepthPyramid&,
+                    const std::vector<GpuDescriptorSet*>&);
+};
+
+}  // namespace mondradiko
@@ -0,0 +1,317 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "core/renderer/MeshBvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "log/log.h"
+
+namespace mondradiko {
+
+// Nodes with this many leaves or fewer aren't split any further
+const uint32_t BVH_MAX_NODE_LEAVES = 4;
+
+// Refitting can stretch nodes arbitrarily as leaves move apart, so the tree
+// is rebuilt once its summed surface area grows by this factor
+const float BVH_REBUILD_COST_RATIO = 2.0f;
+
+// Frusta are tracked with a bitmask while traversing
+const uint32_t BVH_MAX_FRUSTA = 32;
+
+// Only the side planes are culled against, since they alone bound the
+// frustum in front of the viewer no matter the depth range or far plane
+const uint32_t FRUSTUM_PLANE_COUNT = 4;
+
+enum class Containment { Outside, Intersecting, Inside };
+
+static float getSurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+  glm::vec3 size = glm::max(max - min, glm::vec3(0.0));
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Extracts normalized planes facing into the frustum (Gribb-Hartmann)
+static void getFrustumPlanes(const glm::mat4& view_projection,
+                             glm::vec4* planes) {
+  glm::mat4 rows = glm::transpose(view_projection);
+  planes[0] = rows[3] + rows[0];
+  planes[1] = rows[3] - rows[0];
+  planes[2] = rows[3] + rows[1];
+  planes[3] = rows[3] - rows[1];
+
+  for (uint32_t i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+    float length = glm::length(glm::vec3(planes[i]));
+    if (length > 0.0f) planes[i] /= length;
+  }
+}
+
+static Containment classifyBox(const glm::vec4* planes, const glm::vec3& min,
+                               const glm::vec3& max) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+  Containment result = Containment::Inside;
+
+  for (uint32_t i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+    glm::vec3 normal(planes[i]);
+    float distance = glm::dot(normal, center) + planes[i].w;
+    float radius = glm::dot(glm::abs(normal), extent);
+
+    if (distance + radius < 0.0f) return Containment::Outside;
+    if (distance - radius < 0.0f) result = Containment::Intersecting;
+  }
+
+  return result;
+}
+
+static bool isSphereOutside(const glm::vec4* planes, const glm::vec3& center,
+                            float radius) {
+  for (uint32_t i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+    if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MeshBvh::beginUpdate() { leaves.clear(); }
+
+void MeshBvh::addLeaf(EntityId entity, const glm::mat4& transform,
+                      const AssetHandle<MeshAsset>& mesh) {
+  Leaf leaf;
+  leaf.entity = entity;
+
+  // Transforms the box's extent by the absolute basis (Arvo)
+  glm::vec3 center = (mesh->bounds_min + mesh->bounds_max) * 0.5f;
+  glm::vec3 extent = (mesh->bounds_max - mesh->bounds_min) * 0.5f;
+  glm::mat3 abs_basis(glm::abs(glm::vec3(transform[0])),
+                      glm::abs(glm::vec3(transform[1])),
+                      glm::abs(glm::vec3(transform[2])));
+  glm::vec3 world_center = transform * glm::vec4(center, 1.0);
+  glm::vec3 world_extent = abs_basis * extent;
+  leaf.min = world_center - world_extent;
+  leaf.max = world_center + world_extent;
+
+  float max_scale = std::max({glm::length(glm::vec3(transform[0])),
+                              glm::length(glm::vec3(transform[1])),
+                              glm::length(glm::vec3(transform[2]))});
+  leaf.sphere_center = transform * glm::vec4(mesh->bounds_center, 1.0);
+  leaf.sphere_radius = mesh->bounds_radius * max_scale;
+
+  leaves.push_back(leaf);
+}
+
+void MeshBvh::endUpdate() {
+  log_zone;
+
+  bool same_leaves = leaves.size() == built_entities.size();
+  for (uint32_t i = 0; same_leaves && i < leaves.size(); i++) {
+    if (leaves[i].entity != built_entities[i]) same_leaves = false;
+  }
+
+  if (!same_leaves || refit() > built_cost * BVH_REBUILD_COST_RATIO) {
+    build();
+  }
+}
+
+void MeshBvh::cull(const std::vector<glm::mat4>& view_projections,
+                   std::vector<EntityId>* visible) const {
+  log_zone;
+
+  if (nodes.size() == 0) return;
+
+  if (view_projections.size() > BVH_MAX_FRUSTA) {
+    for (const auto& leaf : leaves) visible->push_back(leaf.entity);
+    return;
+  }
+
+  uint32_t frustum_count = view_projections.size();
+  std::vector<glm::vec4> planes(frustum_count * FRUSTUM_PLANE_COUNT);
+  for (uint32_t i = 0; i < frustum_count; i++) {
+    getFrustumPlanes(view_projections[i], &planes[i * FRUSTUM_PLANE_COUNT]);
+  }
+
+  // Each entry keeps the frusta that its node's parent straddles; nodes
+  // entirely outside of those are culled, and nodes entirely inside any of
+  // them are visible without testing their children
+  struct StackEntry {
+    uint32_t node;
+    uint32_t frustum_mask;
+  };
+
+  std::vector<StackEntry> stack;
+  stack.push_back({0, static_cast<uint32_t>((1ull << frustum_count) - 1)});
+
+  while (!stack.empty()) {
+    StackEntry entry = stack.back();
+    stack.pop_back();
+
+    const Node& node = nodes[entry.node];
+    uint32_t frustum_mask = 0;
+    bool inside = false;
+
+    for (uint32_t i = 0; i < frustum_count && !inside; i++) {
+      if (!(entry.frustum_mask & (1u << i))) continue;
+
+      const glm::vec4* frustum = &planes[i * FRUSTUM_PLANE_COUNT];
+      switch (classifyBox(frustum, node.min, node.max)) {
+        case Containment::Inside: {
+          inside = true;
+          break;
+        }
+
+        case Containment::Intersecting: {
+          frustum_mask |= 1u << i;
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+
+    if (inside) {
+      for (uint32_t i = 0; i < node.leaf_count; i++) {
+        visible->push_back(leaves[leaf_order[node.first_leaf + i]].entity);
+      }
+
+      continue;
+    }
+
+    if (frustum_mask == 0) continue;
+
+    if (node.left_child != 0) {
+      stack.push_back({node.left_child, frustum_mask});
+      stack.push_back({node.left_child + 1, frustum_mask});
+      continue;
+    }
+
+    // Spheres are tighter than boxes for rotated meshes, and vice versa
+    for (uint32_t i = 0; i < node.leaf_count; i++) {
+      const Leaf& leaf = leaves[leaf_order[node.first_leaf + i]];
+
+      for (uint32_t j = 0; j < frustum_count; j++) {
+        if (!(frustum_mask & (1u << j))) continue;
+
+        const glm::vec4* frustum = &planes[j * FRUSTUM_PLANE_COUNT];
+        if (classifyBox(frustum, leaf.min, leaf.max) == Containment::Outside)
+          continue;
+        if (isSphereOutside(frustum, leaf.sphere_center, leaf.sphere_radius))
+          continue;
+
+        visible->push_back(leaf.entity);
+        break;
+      }
+    }
+  }
+}
+
+void MeshBvh::build() {
+  log_zone;
+
+  built_entities.resize(leaves.size());
+  for (uint32_t i = 0; i < leaves.size(); i++) {
+    built_entities[i] = leaves[i].entity;
+  }
+
+  leaf_order.resize(leaves.size());
+  std::iota(leaf_order.begin(), leaf_order.end(), 0);
+
+  nodes.clear();
+  built_cost = 0.0f;
+  if (leaves.size() == 0) return;
+
+  Node root;
+  root.first_leaf = 0;
+  root.leaf_count = leaves.size();
+  root.left_child = 0;
+  nodes.push_back(root);
+  buildNode(0);
+
+  built_cost = refit();
+}
+
+void MeshBvh::buildNode(uint32_t node_index) {
+  uint32_t first_leaf = nodes[node_index].first_leaf;
+  uint32_t leaf_count = nodes[node_index].leaf_count;
+  if (leaf_count <= BVH_MAX_NODE_LEAVES) return;
+
+  auto get_centroid = [this](uint32_t leaf_index) {
+    const Leaf& leaf = leaves[leaf_index];
+    return (leaf.min + leaf.max) * 0.5f;
+  };
+
+  glm::vec3 centroid_min(std::numeric_limits<float>::max());
+  glm::vec3 centroid_max(std::numeric_limits<float>::lowest());
+
+  for (uint32_t i = first_leaf; i < first_leaf + leaf_count; i++) {
+    glm::vec3 centroid = get_centroid(leaf_order[i]);
+    centroid_min = glm::min(centroid_min, centroid);
+    centroid_max = glm::max(centroid_max, centroid);
+  }
+
+  // Split at the median centroid along the longest axis
+  glm::vec3 centroid_size = centroid_max - centroid_min;
+  int axis = 0;
+  if (centroid_size.y > centroid_size[axis]) axis = 1;
+  if (centroid_size.z > centroid_size[axis]) axis = 2;
+
+  auto begin = leaf_order.begin() + first_leaf;
+  auto end = begin + leaf_count;
+  uint32_t left_count = leaf_count / 2;
+
+  std::nth_element(begin, begin + left_count, end,
+                   [&get_centroid, axis](uint32_t a, uint32_t b) {
+                     return get_centroid(a)[axis] < get_centroid(b)[axis];
+                   });
+
+  uint32_t left_child = nodes.size();
+  nodes[node_index].left_child = left_child;
+
+  Node left;
+  left.first_leaf = first_leaf;
+  left.leaf_count = left_count;
+  left.left_child = 0;
+  nodes.push_back(left);
+
+  Node right;
+  right.first_leaf = first_leaf + left_count;
+  right.leaf_count = leaf_count - left_count;
+  right.left_child = 0;
+  nodes.push_back(right);
+
+  buildNode(left_child);
+  buildNode(left_child + 1);
+}
+
+float MeshBvh::refit() {
+  float cost = 0.0f;
+
+  for (uint32_t i = nodes.size(); i-- > 0;) {
+    Node& node = nodes[i];
+
+    if (node.left_child != 0) {
+      const Node& left = nodes[node.left_child];
+      const Node& right = nodes[node.left_child + 1];
+      node.min = glm::min(left.min, right.min);
+      node.max = glm::max(left.max, right.max);
+    } else {
+      node.min = glm::vec3(std::numeric_limits<float>::max());
+      node.max = glm::vec3(std::numeric_limits<float>::lowest());
+
+      for (uint32_t j = 0; j < node.leaf_count; j++) {
+        const Leaf& leaf = leaves[leaf_order[node.first_leaf + j]];
+        node.min = glm::min(node.min, leaf.min);
+        node.max = glm::max(node.max, leaf.max);
+      }
+    }
+
+    cost += getSurfaceArea(node.min, node.max);
+  }
+
+  return cost;
+}
+
+}  // namespace mondradiko
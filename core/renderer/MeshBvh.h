@@ -0,0 +1,65 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <vector>
+
+#include "core/assets/AssetHandle.h"
+#include "core/assets/MeshAsset.h"
+#include "core/world/Entity.h"
+#include "lib/include/glm_headers.h"
+
+namespace mondradiko {
+
+/**
+ * @brief Bounding volume hierarchy of world-space mesh bounds, for culling.
+ * Leaves are gathered every frame. If the same entities are gathered as
+ * last frame, the tree is refit around their new bounds; otherwise, or once
+ * refitting has loosened the tree too much, it's rebuilt.
+ */
+class MeshBvh {
+ public:
+  // Leaves are added between these, in a consistent order across frames
+  void beginUpdate();
+  void addLeaf(EntityId, const glm::mat4&, const AssetHandle<MeshAsset>&);
+  void endUpdate();
+
+  // Appends every leaf within any of the view-projections' frusta
+  void cull(const std::vector<glm::mat4>&, std::vector<EntityId>*) const;
+
+  uint32_t getLeafCount() const { return leaves.size(); }
+
+ private:
+  struct Leaf {
+    EntityId entity;
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 sphere_center;
+    float sphere_radius;
+  };
+
+  // Each node covers a range of leaf_order; children are allocated in
+  // pairs after their parent, so refitting walks the nodes backwards
+  struct Node {
+    glm::vec3 min;
+    glm::vec3 max;
+    uint32_t first_leaf;
+    uint32_t leaf_count;
+    uint32_t left_child;  // Zero for leaf nodes
+  };
+
+  std::vector<Leaf> leaves;
+  std::vector<EntityId> built_entities;
+  std::vector<uint32_t> leaf_order;
+  std::vector<Node> nodes;
+
+  // Summed surface area of the nodes when the tree was last built
+  float built_cost = 0.0f;
+
+  void build();
+  void buildNode(uint32_t);
+  float refit();
+};
+
+}  // namespace mondradiko
@@ -3,6 +3,9 @@
 
 #include "core/renderer/MeshPass.h"
 
+#include <algorithm>
+#include <limits>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -12,6 +15,7 @@
 #include "core/components/TransformComponent.h"
 #include "core/cvars/CVarScope.h"
 #include "core/gpu/GpuBuffer.h"
+#include "core/gpu/GpuBufferArena.h"
 #include "core/gpu/GpuDescriptorPool.h"
 #include "core/gpu/GpuDescriptorSet.h"
 #include "core/gpu/GpuDescriptorSetLayout.h"
@@ -23,17 +27,41 @@
 #include "core/renderer/Renderer.h"
 #include "core/world/World.h"
 #include "log/log.h"
+#include "shaders/compact_mesh.vert.h"
 #include "shaders/mesh.frag.h"
 #include "shaders/mesh.vert.h"
 
 namespace mondradiko {
 
+// Packs a command's state into a render queue key, most significant first:
+// pipeline (1 bit), vertex block (7), index block (7), index type (1),
+// material (16), and mesh (32). Fields that overflow only make the sort
+// less effective, because batches are split by comparing the state itself.
+static uint64_t makeSortKey(const AssetHandle<MeshAsset>& mesh_asset,
+                            uint32_t material_idx, uint32_t mesh_idx) {
+  uint64_t key = mesh_asset->compact_vertices ? 1 : 0;
+  key = (key << 7) | (mesh_asset->getVertexBlock() & 0x7f);
+  key = (key << 7) | (mesh_asset->getIndexBlock() & 0x7f);
+  key = (key << 1) | (mesh_asset->index_type == VK_INDEX_TYPE_UINT16 ? 0 : 1);
+  key = (key << 16) | (material_idx & 0xffff);
+  key = (key << 32) | mesh_idx;
+  return key;
+}
+
 void MeshPass::initCVars(CVarScope* cvars) {}
 
 MeshPass::MeshPass(Renderer* renderer, World* world)
     : gpu(renderer->getGpu()), renderer(renderer), world(world) {
   log_zone;
 
+  // Indirect draws index per-draw data with their first instance
+  indirect_draws = gpu->physical_device_features.drawIndirectFirstInstance;
+  multi_draw_indirect = gpu->physical_device_features.multiDrawIndirect;
+
+  if (!indirect_draws) {
+    log_wrn("Indirect draws aren't supported; falling back to direct draws");
+  }
+
   {
     log_zone_named("Create texture sampler");
 
@@ -50,7 +78,7 @@ MeshPass::MeshPass(Renderer* renderer, World* world)
     sampler_info.anisotropyEnable = VK_FALSE;
     sampler_info.compareEnable = VK_FALSE;
     sampler_info.minLod = 0.0f;
-    sampler_info.maxLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
     sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     sampler_info.unnormalizedCoordinates = VK_FALSE;
 
@@ -64,14 +92,15 @@ MeshPass::MeshPass(Renderer* renderer, World* world)
     log_zone_named("Create set layouts");
 
     material_layout = new GpuDescriptorSetLayout(gpu);
-    material_layout->addDynamicUniformBuffer(sizeof(MaterialUniform));
+    material_layout->addStorageBuffer(sizeof(MaterialUniform));
 
     texture_layout = new GpuDescriptorSetLayout(gpu);
     texture_layout->addCombinedImageSampler(texture_sampler);
 
     mesh_layout = new GpuDescriptorSetLayout(gpu);
-    mesh_layout->addDynamicUniformBuffer(sizeof(MeshUniform));
+    mesh_layout->addStorageBuffer(sizeof(MeshUniform));
     mesh_layout->addStorageBuffer(sizeof(PointLightUniform));
+    mesh_layout->addStorageBuffer(sizeof(uint32_t));
   }
 
   {
@@ -98,6 +127,9 @@ MeshPass::MeshPass(Renderer* renderer, World* world)
 
     vertex_shader = new GpuShader(gpu, VK_SHADER_STAGE_VERTEX_BIT,
                                   shaders_mesh_vert, sizeof(shaders_mesh_vert));
+    compact_vertex_shader = new GpuShader(gpu, VK_SHADER_STAGE_VERTEX_BIT,
+                                          shaders_compact_mesh_vert,
+                                          sizeof(shaders_compact_mesh_vert));
     fragment_shader =
         new GpuShader(gpu, VK_SHADER_STAGE_FRAGMENT_BIT, shaders_mesh_frag,
                       sizeof(shaders_mesh_frag));
@@ -112,6 +144,15 @@ MeshPass::MeshPass(Renderer* renderer, World* world)
     pipeline = new GpuPipeline(
         gpu, pipeline_layout, renderer->getCompositePass(), 0, vertex_shader,
         fragment_shader, vertex_bindings, attribute_descriptions);
+
+    auto compact_vertex_bindings = CompactMeshVertex::getVertexBindings();
+    auto compact_attribute_descriptions =
+        CompactMeshVertex::getAttributeDescriptions();
+
+    compact_pipeline = new GpuPipeline(
+        gpu, pipeline_layout, renderer->getCompositePass(), 0,
+        compact_vertex_shader, fragment_shader, compact_vertex_bindings,
+        compact_attribute_descriptions);
   }
 }
 
@@ -121,7 +162,9 @@ MeshPass::~MeshPass() {
   if (texture_sampler != VK_NULL_HANDLE)
     vkDestroySampler(gpu->device, texture_sampler, nullptr);
   if (pipeline != nullptr) delete pipeline;
+  if (compact_pipeline != nullptr) delete compact_pipeline;
   if (vertex_shader != nullptr) delete vertex_shader;
+  if (compact_vertex_shader != nullptr) delete compact_vertex_shader;
   if (fragment_shader != nullptr) delete fragment_shader;
   if (pipeline_layout != VK_NULL_HANDLE)
     vkDestroyPipelineLayout(gpu->device, pipeline_layout, nullptr);
@@ -137,13 +180,21 @@ void MeshPass::createFrameData(uint32_t frame_count) {
 
   for (auto& frame : frame_data) {
     frame.material_buffer = new GpuVector(gpu, sizeof(MaterialUniform),
-                                          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
     frame.mesh_buffer = new GpuVector(gpu, sizeof(MeshUniform),
-                                      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
     frame.point_lights = new GpuVector(gpu, sizeof(PointLightUniform),
                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    frame.draw_buffer = new GpuVector(
+        gpu, sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    frame.instance_buffer = new GpuVector(gpu, sizeof(uint32_t),
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
   }
 }
 
@@ -154,6 +205,8 @@ void MeshPass::destroyFrameData() {
     if (frame.material_buffer != nullptr) delete frame.material_buffer;
     if (frame.mesh_buffer != nullptr) delete frame.mesh_buffer;
     if (frame.point_lights != nullptr) delete frame.point_lights;
+    if (frame.draw_buffer != nullptr) delete frame.draw_buffer;
+    if (frame.instance_buffer != nullptr) delete frame.instance_buffer;
   }
 }
 
@@ -188,16 +241,57 @@ void MeshPass::allocateDescriptors(uint32_t frame_index,
   std::vector<MaterialUniform> frame_materials;
   std::vector<GpuDescriptorSet*> frame_textures;
 
-  std::vector<MeshUniform> frame_meshes;
+  // Dense per-frame mesh indices for the sort keys
+  std::unordered_map<AssetId, uint32_t> mesh_assets;
 
   frame.commands.clear();
 
   auto mesh_renderers =
       world->registry.view<MeshRendererComponent, TransformComponent>();
 
+  const auto& viewer_positions = renderer->getViewerPositions();
+
+  mesh_bvh.beginUpdate();
+
   for (auto e : mesh_renderers) {
     auto& mesh_renderer = mesh_renderers.get<MeshRendererComponent>(e);
-    if (!mesh_renderer.isLoaded()) continue;
+    auto& transform = mesh_renderers.get<TransformComponent>(e);
+
+    if (!mesh_renderer.isLoaded()) {
+      // Stream in the assets closest to a viewer first
+      if (viewer_positions.size() > 0) {
+        glm::vec3 position = transform.getWorldTransform()[3];
+
+        float min_distance = std::numeric_limits<float>::infinity();
+        for (const auto& viewer_position : viewer_positions) {
+          min_distance =
+              std::min(min_distance, glm::distance(position, viewer_position));
+        }
+
+        mesh_renderer.prioritize(&world->asset_pool, -min_distance);
+      }
+
+      continue;
+    }
+
+    // Empty meshes have no buffers to bind and nothing to draw
+    if (mesh_renderer.getMeshAsset()->index_count == 0) continue;
+
+    mesh_bvh.addLeaf(e, transform.getWorldTransform(),
+                     mesh_renderer.getMeshAsset());
+  }
+
+  mesh_bvh.endUpdate();
+
+  // Only meshes within at least one viewport are drawn
+  std::vector<EntityId> visible_meshes;
+  mesh_bvh.cull(renderer->getViewerViewProjections(), &visible_meshes);
+
+  log_plot("Meshes visible", visible_meshes.size());
+  log_plot("Meshes culled", mesh_bvh.getLeafCount() - visible_meshes.size());
+
+  for (auto e : visible_meshes) {
+    auto& mesh_renderer = mesh_renderers.get<MeshRendererComponent>(e);
 
     MeshRenderCommand cmd;
 
@@ -206,11 +300,12 @@ void MeshPass::allocateDescriptors(uint32_t frame_index,
       const auto iter = material_assets.find(material_asset.getId());
 
       if (iter != material_assets.end()) {
-        cmd.material_idx = iter->second;
+        cmd.uniform.material_idx = iter->second;
         cmd.textures_descriptor = frame_textures[iter->second];
       } else {
-        cmd.material_idx = frame_materials.size();
-        material_assets.emplace(material_asset.getId(), cmd.material_idx);
+        cmd.uniform.material_idx = frame_materials.size();
+        material_assets.emplace(material_asset.getId(),
+                                cmd.uniform.material_idx);
         frame_materials.push_back(material_asset->getUniform());
 
         cmd.textures_descriptor = descriptor_pool->allocate(texture_layout);
@@ -221,51 +316,153 @@ void MeshPass::allocateDescriptors(uint32_t frame_index,
 
     {  // Write mesh uniform
       auto& transform = mesh_renderers.get<TransformComponent>(e);
-
-      MeshUniform mesh_uniform;
-      mesh_uniform.model = transform.getWorldTransform();
-      mesh_uniform.light_count = light_count;
-
-      cmd.mesh_idx = frame_meshes.size();
-      frame_meshes.push_back(mesh_uniform);
+      const auto& mesh_asset = mesh_renderer.getMeshAsset();
+
+      cmd.uniform.model = transform.getWorldTransform();
+      cmd.uniform.position_offset =
+          glm::vec4(mesh_asset->position_offset, 0.0);
+      cmd.uniform.position_scale = glm::vec4(mesh_asset->position_scale, 0.0);
+      cmd.uniform.bounds_sphere =
+          glm::vec4(mesh_asset->bounds_center, mesh_asset->bounds_radius);
+      cmd.uniform.light_count = light_count;
     }
 
     {  // Write mesh asset
       cmd.mesh_asset = mesh_renderer.getMeshAsset();
+
+      auto iter =
+          mesh_assets.emplace(cmd.mesh_asset.getId(), mesh_assets.size());
+      cmd.sort_key = makeSortKey(cmd.mesh_asset, cmd.uniform.material_idx,
+                                 iter.first->second);
     }
 
     frame.commands.push_back(cmd);
   }
 
+  {
+    const auto& vertex_stats = world->mesh_vertex_arena->getStats();
+    const auto& index_stats = world->mesh_index_arena->getStats();
+    log_plot("Mesh arena allocations",
+             vertex_stats.allocation_count + index_stats.allocation_count);
+    log_plot("Mesh arena blocks",
+             vertex_stats.block_count + index_stats.block_count);
+    log_plot("Mesh arena KiB",
+             (vertex_stats.allocated_size + index_stats.allocated_size) >> 10);
+  }
+
   if (frame_materials.size() > 0) {
     for (uint32_t i = 0; i < frame_materials.size(); i++) {
       frame.material_buffer->writeElement(i, frame_materials[i]);
     }
 
     frame.material_descriptor = descriptor_pool->allocate(material_layout);
-    frame.material_descriptor->updateDynamicBuffer(0, frame.material_buffer);
+    frame.material_descriptor->updateStorageBuffer(0, frame.material_buffer);
   }
 
-  if (frame_meshes.size() > 0) {
-    for (uint32_t i = 0; i < frame_meshes.size(); i++) {
-      frame.mesh_buffer->writeElement(i, frame_meshes[i]);
-    }
+  writeBatches(&frame);
 
+  if (frame.draws.size() > 0) {
     frame.mesh_descriptor = descriptor_pool->allocate(mesh_layout);
-    frame.mesh_descriptor->updateDynamicBuffer(0, frame.mesh_buffer);
+    frame.mesh_descriptor->updateStorageBuffer(0, frame.mesh_buffer);
     frame.mesh_descriptor->updateStorageBuffer(1, frame.point_lights);
+    frame.mesh_descriptor->updateStorageBuffer(2, frame.instance_buffer);
   }
 }
 
+void MeshPass::writeBatches(FrameData* frame) {
+  log_zone;
+
+  auto& commands = frame->commands;
+
+  // Sorting by the packed key is cheaper than comparing each command's state
+  std::sort(commands.begin(), commands.end(),
+            [](const MeshRenderCommand& a, const MeshRenderCommand& b) {
+              return a.sort_key < b.sort_key;
+            });
+
+  // Draws sharing all of their bound state are batched together
+  auto batch_state = [](const MeshRenderCommand& cmd) {
+    const auto& mesh_asset = cmd.mesh_asset;
+    return std::make_tuple(mesh_asset->compact_vertices,
+                           mesh_asset->getVertexBuffer()->getBuffer(),
+                           mesh_asset->getIndexBuffer()->getBuffer(),
+                           mesh_asset->index_type, cmd.textures_descriptor);
+  };
+
+  // Commands with the same mesh and material are drawn as instances
+  auto instance_state = [](const MeshRenderCommand& cmd) {
+    return std::make_tuple(cmd.mesh_asset.getId(), cmd.uniform.material_idx);
+  };
+
+  frame->draws.clear();
+  frame->batches.clear();
+
+  for (uint32_t i = 0; i < commands.size(); i++) {
+    const auto& cmd = commands[i];
+    const auto& mesh_asset = cmd.mesh_asset;
+
+    bool new_batch = i == 0 || batch_state(cmd) != batch_state(commands[i - 1]);
+    bool new_draw =
+        new_batch || instance_state(cmd) != instance_state(commands[i - 1]);
+
+    if (new_batch) {
+      MeshDrawBatch batch;
+      batch.pipeline =
+          mesh_asset->compact_vertices ? compact_pipeline : pipeline;
+      batch.textures_descriptor = cmd.textures_descriptor;
+      batch.vertex_buffer = mesh_asset->getVertexBuffer()->getBuffer();
+      batch.index_buffer = mesh_asset->getIndexBuffer()->getBuffer();
+      batch.index_type = mesh_asset->index_type;
+      batch.first_draw = frame->draws.size();
+      batch.draw_count = 0;
+      frame->batches.push_back(batch);
+    }
+
+    if (new_draw) {
+      VkDrawIndexedIndirectCommand draw;
+      draw.indexCount = mesh_asset->index_count;
+      draw.instanceCount = 1;
+      draw.firstIndex = mesh_asset->first_index;
+      draw.vertexOffset = mesh_asset->vertex_offset;
+      draw.firstInstance = i;
+      frame->draws.push_back(draw);
+
+      frame->batches.back().draw_count++;
+    } else {
+      frame->draws.back().instanceCount++;
+    }
+
+    MeshUniform uniform = cmd.uniform;
+    uniform.draw_idx = frame->draws.size() - 1;
+    frame->mesh_buffer->writeElement(i, uniform);
+
+    // Instances find their mesh uniforms through gl_InstanceIndex
+    frame->instance_buffer->writeElement(i, i);
+  }
+
+  for (uint32_t i = 0; i < frame->draws.size(); i++) {
+    VkDrawIndexedIndirectCommand draw = frame->draws[i];
+
+    // GPU culling counts each draw's visible instances up from zero
+    if (gpu_culling) draw.instanceCount = 0;
+
+    frame->draw_buffer->writeElement(i, draw);
+  }
+
+  log_plot("Mesh instances", commands.size());
+  log_plot("Mesh draws", frame->draws.size());
+  log_plot("Mesh draw batches", frame->batches.size());
+}
+
 void MeshPass::render(uint32_t frame_index, VkCommandBuffer command_buffer,
                       const GpuDescriptorSet* viewport_descriptor) {
   log_zone;
 
   auto& frame = frame_data[frame_index];
 
-  {
-    GraphicsState graphics_state;
+  GraphicsState graphics_state;
 
+  {
     GraphicsState::InputAssemblyState input_assembly_state{};
     input_assembly_state.primitive_topology =
         GraphicsState::PrimitiveTopology::TriangleList;
@@ -283,33 +480,104 @@ void MeshPass::render(uint32_t frame_index, VkCommandBuffer command_buffer,
     depth_state.write_enable = GraphicsState::BoolFlag::True;
     depth_state.compare_op = GraphicsState::CompareOp::Less;
     graphics_state.depth_state = depth_state;
-
-    pipeline->cmdBind(command_buffer, graphics_state);
   }
 
+  if (frame.batches.size() == 0) return;
+
   // TODO(marceline-cramer) GpuPipeline + GpuPipelineLayout
   viewport_descriptor->cmdBind(command_buffer, pipeline_layout, 0);
 
-  for (auto& cmd : frame.commands) {
-    log_zone_named("Render mesh");
+  // Per-draw data is indexed in the shaders, so these sets are only bound
+  // once. Both pipelines share a layout, so bound descriptors stay valid
+  // when switching between them.
+  frame.material_descriptor->cmdBind(command_buffer, pipeline_layout, 1);
+  frame.mesh_descriptor->cmdBind(command_buffer, pipeline_layout, 3);
 
-    frame.material_descriptor->updateDynamicOffset(0, cmd.material_idx);
-    frame.material_descriptor->cmdBind(command_buffer, pipeline_layout, 1);
+  GpuPipeline* bound_pipeline = nullptr;
+  GpuDescriptorSet* bound_textures = nullptr;
 
-    cmd.textures_descriptor->cmdBind(command_buffer, pipeline_layout, 2);
+  // Meshes share arena blocks, so buffers are only rebound between blocks
+  VkBuffer bound_vertex_buffer = VK_NULL_HANDLE;
+  VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+  VkIndexType bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
 
-    frame.mesh_descriptor->updateDynamicOffset(0, cmd.mesh_idx);
-    frame.mesh_descriptor->cmdBind(command_buffer, pipeline_layout, 3);
+  const uint32_t draw_stride = sizeof(VkDrawIndexedIndirectCommand);
+  const uint32_t max_draw_count =
+      gpu->physical_device_properties.limits.maxDrawIndirectCount;
 
-    const auto& mesh_asset = cmd.mesh_asset;
+  // Recording stats; each batch could bind four pieces of state
+  uint32_t binds = 0;
+  uint32_t draw_calls = 0;
+
+  {
+    log_zone_named("Record mesh batches");
+
+    for (const auto& batch : frame.batches) {
+      if (batch.pipeline != bound_pipeline) {
+        batch.pipeline->cmdBind(command_buffer, graphics_state);
+        bound_pipeline = batch.pipeline;
+        binds++;
+      }
+
+      if (batch.textures_descriptor != bound_textures) {
+        batch.textures_descriptor->cmdBind(command_buffer, pipeline_layout, 2);
+        bound_textures = batch.textures_descriptor;
+        binds++;
+      }
 
-    VkBuffer vertex_buffers[] = {mesh_asset->vertex_buffer->getBuffer()};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-    vkCmdBindIndexBuffer(command_buffer, mesh_asset->index_buffer->getBuffer(),
-                         0, VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(command_buffer, mesh_asset->index_count, 1, 0, 0, 0);
+      if (batch.vertex_buffer != bound_vertex_buffer) {
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &batch.vertex_buffer,
+                               offsets);
+        bound_vertex_buffer = batch.vertex_buffer;
+        binds++;
+      }
+
+      if (batch.index_buffer != bound_index_buffer ||
+          batch.index_type != bound_index_type) {
+        vkCmdBindIndexBuffer(command_buffer, batch.index_buffer, 0,
+                             batch.index_type);
+        bound_index_buffer = batch.index_buffer;
+        bound_index_type = batch.index_type;
+        binds++;
+      }
+
+      if (indirect_draws && multi_draw_indirect) {
+        for (uint32_t drawn = 0; drawn < batch.draw_count;) {
+          uint32_t draw_count =
+              std::min(batch.draw_count - drawn, max_draw_count);
+          vkCmdDrawIndexedIndirect(command_buffer,
+                                   frame.draw_buffer->getBuffer(),
+                                   (batch.first_draw + drawn) * draw_stride,
+                                   draw_count, draw_stride);
+          drawn += draw_count;
+          draw_calls++;
+        }
+      } else if (indirect_draws) {
+        for (uint32_t i = 0; i < batch.draw_count; i++) {
+          vkCmdDrawIndexedIndirect(command_buffer,
+                                   frame.draw_buffer->getBuffer(),
+                                   (batch.first_draw + i) * draw_stride, 1,
+                                   draw_stride);
+        }
+
+        draw_calls += batch.draw_count;
+      } else {
+        for (uint32_t i = 0; i < batch.draw_count; i++) {
+          const auto& draw = frame.draws[batch.first_draw + i];
+          vkCmdDrawIndexed(command_buffer, draw.indexCount, draw.instanceCount,
+                           draw.firstIndex, draw.vertexOffset,
+                           draw.firstInstance);
+        }
+
+        draw_calls += batch.draw_count;
+      }
+    }
   }
+
+  log_plot("Mesh binds", binds);
+  log_plot("Mesh binds skipped", frame.batches.size() * 4 - binds);
+  log_plot("Mesh draw calls", draw_calls);
 }
 
 }  // namespace mondradiko
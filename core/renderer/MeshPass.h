@@ -8,6 +8,7 @@
 #include "core/assets/AssetHandle.h"
 #include "core/assets/AssetPool.h"
 #include "core/assets/MeshAsset.h"
+#include "core/renderer/MeshBvh.h"
 #include "core/renderer/RenderPass.h"
 #include "lib/include/glm_headers.h"
 
@@ -27,9 +28,20 @@ class GpuVector;
 class Renderer;
 class World;
 
+// One per instance, read from a storage buffer through the instance indices
 struct MeshUniform {
   glm::mat4 model;
+  glm::vec4 position_offset;
+  glm::vec4 position_scale;
+
+  // Local bounding sphere as center and radius, for GPU culling
+  glm::vec4 bounds_sphere;
+
   alignas(16) uint32_t light_count;
+  uint32_t material_idx;
+
+  // Indirect draw that this instance belongs to
+  uint32_t draw_idx;
 };
 
 class MeshPass : public RenderPass {
@@ -52,6 +64,7 @@ class MeshPass : public RenderPass {
   World* world;
 
   GpuShader* vertex_shader = nullptr;
+  GpuShader* compact_vertex_shader = nullptr;
   GpuShader* fragment_shader = nullptr;
 
   GpuDescriptorSetLayout* material_layout;
@@ -60,28 +73,63 @@ class MeshPass : public RenderPass {
 
   VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
   GpuPipeline* pipeline = nullptr;
+  GpuPipeline* compact_pipeline = nullptr;
 
   VkSampler texture_sampler = VK_NULL_HANDLE;
 
   struct MeshRenderCommand {
-    uint32_t mesh_idx;
-    uint32_t material_idx;
+    // Orders the render queue; see makeSortKey() in MeshPass.cc
+    uint64_t sort_key;
+
+    MeshUniform uniform;
     GpuDescriptorSet* textures_descriptor;
 
     AssetHandle<MeshAsset> mesh_asset;
   };
 
+  // A run of draws that share all of their bound state
+  struct MeshDrawBatch {
+    GpuPipeline* pipeline;
+    GpuDescriptorSet* textures_descriptor;
+    VkBuffer vertex_buffer;
+    VkBuffer index_buffer;
+    VkIndexType index_type;
+
+    uint32_t first_draw;
+    uint32_t draw_count;
+  };
+
   struct FrameData {
     GpuVector* material_buffer = nullptr;
     GpuVector* mesh_buffer = nullptr;
     GpuVector* point_lights = nullptr;
+    GpuVector* draw_buffer = nullptr;
+
+    // Maps gl_InstanceIndex to mesh uniforms; the identity unless a
+    // CullPass compacts visible instances into it
+    GpuVector* instance_buffer = nullptr;
 
     GpuDescriptorSet* material_descriptor;
     GpuDescriptorSet* mesh_descriptor;
 
     std::vector<MeshRenderCommand> commands;
+    std::vector<VkDrawIndexedIndirectCommand> draws;
+    std::vector<MeshDrawBatch> batches;
   };
 
+  // Set if the device can draw batches with vkCmdDrawIndexedIndirect
+  bool indirect_draws;
+  bool multi_draw_indirect;
+
+  // Set by a CullPass, which fills in the draws' instance counts on the GPU
+  bool gpu_culling = false;
+  friend class CullPass;
+
+  // Refit from every loaded mesh renderer's world transform each frame
+  MeshBvh mesh_bvh;
+
+  void writeBatches(FrameData*);
+
   std::vector<FrameData> frame_data;
 };
 
@@ -10,7 +10,9 @@
 #include "core/gpu/GpuDescriptorSet.h"
 #include "core/gpu/GpuDescriptorSetLayout.h"
 #include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuUploader.h"
 #include "core/gpu/GpuVector.h"
+#include "core/renderer/CullPass.h"
 #include "core/renderer/OverlayPass.h"
 #include "core/renderer/RenderPass.h"
 #include "log/log.h"
@@ -20,6 +22,7 @@ namespace mondradiko {
 void Renderer::initCVars(CVarScope* cvars) {
   CVarScope* renderer = cvars->addChild("renderer");
 
+  CullPass::initCVars(renderer);
   OverlayPass::initCVars(renderer);
 }
 
@@ -43,7 +46,8 @@ Renderer::Renderer(const CVarScope* cvars, DisplayInterface* display,
     depth_attachment_description.format = display->getDepthFormat();
     depth_attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // Kept for the next frame's occlusion culling
+    depth_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     depth_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depth_attachment_description.finalLayout =
         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -211,7 +215,13 @@ void Renderer::renderFrame() {
     frame.descriptor_pool->reset();
   }
 
-  std::vector<Viewport*> viewports;
+  {
+    log_zone_named("Submit uploads");
+
+    // Submitted ahead of this frame, so that the frame can use them
+    gpu->uploader->flush();
+  }
+
   std::vector<VkSemaphore> on_viewport_acquire(0);
   bool viewports_require_signal = false;
 
@@ -233,6 +243,23 @@ void Renderer::renderFrame() {
     }
   }
 
+  {
+    log_zone_named("Write viewport uniforms");
+
+    // Written before descriptors are allocated, so that render passes can
+    // cull against this frame's views
+    viewer_positions.resize(viewports.size());
+    viewer_view_projections.resize(viewports.size());
+
+    for (uint32_t i = 0; i < viewports.size(); i++) {
+      ViewportUniform uniform;
+      viewports[i]->writeUniform(&uniform);
+      frame.viewports->writeElement(i, uniform);
+      viewer_positions[i] = uniform.position;
+      viewer_view_projections[i] = uniform.projection * uniform.view;
+    }
+  }
+
   GpuDescriptorSet* viewport_descriptor;
 
   {
@@ -285,16 +312,6 @@ void Renderer::renderFrame() {
     vkEndCommandBuffer(frame.command_buffer);
   }
 
-  {
-    log_zone_named("Write viewport uniforms");
-
-    for (uint32_t i = 0; i < viewports.size(); i++) {
-      ViewportUniform uniform;
-      viewports[i]->writeUniform(&uniform);
-      frame.viewports->writeElement(i, uniform);
-    }
-  }
-
   {
     log_zone_named("Submit to queue");
 
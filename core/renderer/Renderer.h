@@ -8,6 +8,7 @@
 
 #include "core/assets/AssetPool.h"
 #include "core/renderer/RenderPass.h"
+#include "lib/include/glm_headers.h"
 
 namespace mondradiko {
 
@@ -18,6 +19,7 @@ class GpuDescriptorPool;
 class GpuDescriptorSetLayout;
 class GpuInstance;
 class GpuVector;
+class Viewport;
 
 class Renderer {
  public:
@@ -35,6 +37,18 @@ class Renderer {
   GpuDescriptorSetLayout* getViewportLayout() { return viewport_layout; }
   VkRenderPass getCompositePass() const { return composite_pass; }
 
+  // Viewport positions and view-projection matrices of the frame being
+  // rendered; valid from RenderPass::allocateDescriptors() onwards
+  const std::vector<glm::vec3>& getViewerPositions() const {
+    return viewer_positions;
+  }
+
+  const std::vector<glm::mat4>& getViewerViewProjections() const {
+    return viewer_view_projections;
+  }
+
+  const std::vector<Viewport*>& getViewports() const { return viewports; }
+
  private:
   const CVarScope* cvars;
   DisplayInterface* display;
@@ -46,6 +60,12 @@ class Renderer {
 
   std::vector<RenderPass*> render_passes;
 
+  // Acquired for the frame being rendered
+  std::vector<Viewport*> viewports;
+
+  std::vector<glm::vec3> viewer_positions;
+  std::vector<glm::mat4> viewer_view_projections;
+
   struct PipelinedFrameData {
     // TODO(marceline-cramer) Use command pool per frame, per thread
     VkCommandBuffer command_buffer;
@@ -0,0 +1,69 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(set = 0, binding = 0) uniform CameraUniform {
+    mat4 view;
+    mat4 projection;
+    vec3 position;
+} camera;
+
+struct MeshUniform {
+  mat4 model;
+  vec4 position_offset;
+  vec4 position_scale;
+  vec4 bounds_sphere;
+  uint light_count;
+  uint material_idx;
+  uint draw_idx;
+};
+
+layout(set = 3, binding = 0) buffer readonly MeshUniforms {
+  MeshUniform meshes[];
+};
+
+// Maps instances to mesh uniforms; instanced draws start at their first
+// instance's index, and GPU culling compacts the visible instances
+layout(set = 3, binding = 2) buffer readonly MeshInstances {
+  uint instances[];
+};
+
+// Normalized to the mesh's bounds
+layout(location = 0) in vec3 vertPosition;
+// Octahedral encoding
+layout(location = 1) in vec2 vertNormal;
+layout(location = 2) in vec3 vertColor;
+layout(location = 3) in vec2 vertTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPosition;
+layout(location = 4) flat out uint fragMeshIndex;
+
+vec3 decodeOctahedral(vec2 encoded) {
+  vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float fold = max(-normal.z, 0.0);
+  normal.x += normal.x >= 0.0 ? -fold : fold;
+  normal.y += normal.y >= 0.0 ? -fold : fold;
+  return normalize(normal);
+}
+
+void main() {
+  uint mesh_idx = instances[gl_InstanceIndex];
+  MeshUniform mesh = meshes[mesh_idx];
+
+  vec3 position = mesh.position_offset.xyz + vertPosition * mesh.position_scale.xyz;
+  vec3 normal = decodeOctahedral(vertNormal);
+
+  gl_Position = camera.projection * camera.view * mesh.model * vec4(position, 1.0);
+
+  fragColor = vertColor;
+  fragTexCoord = vertTexCoord;
+  fragNormal = (mesh.model * vec4(normal, 0.0)).xyz;
+  fragPosition = (mesh.model * vec4(position, 1.0)).xyz;
+
+  fragMeshIndex = mesh_idx;
+}
@@ -10,16 +10,29 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 position;
 } camera;
 
-layout(set = 1, binding = 0) uniform MaterialUniform {
+struct MaterialUniform {
   vec4 albedo_factor;
-} material;
+};
+
+layout(set = 1, binding = 0) buffer readonly MaterialUniforms {
+  MaterialUniform materials[];
+};
 
 layout(set = 2, binding = 0) uniform sampler2D albedo_texture;
 
-layout(set = 3, binding = 0) uniform MeshUniform {
+struct MeshUniform {
   mat4 model;
+  vec4 position_offset;
+  vec4 position_scale;
+  vec4 bounds_sphere;
   uint light_count;
-} mesh;
+  uint material_idx;
+  uint draw_idx;
+};
+
+layout(set = 3, binding = 0) buffer readonly MeshUniforms {
+  MeshUniform meshes[];
+};
 
 struct PointLightUniform {
   vec4 position;
@@ -34,10 +47,14 @@ layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 fragPosition;
+layout(location = 4) flat in uint fragMeshIndex;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
+  MeshUniform mesh = meshes[fragMeshIndex];
+  MaterialUniform material = materials[mesh.material_idx];
+
   vec4 sampled_albedo = texture(albedo_texture, fragTexCoord);
 
   vec3 surface_position = fragPosition;
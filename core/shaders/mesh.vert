@@ -10,10 +10,25 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 position;
 } camera;
 
-layout(set = 3, binding = 0) uniform MeshUniform {
+struct MeshUniform {
   mat4 model;
+  vec4 position_offset;
+  vec4 position_scale;
+  vec4 bounds_sphere;
   uint light_count;
-} mesh;
+  uint material_idx;
+  uint draw_idx;
+};
+
+layout(set = 3, binding = 0) buffer readonly MeshUniforms {
+  MeshUniform meshes[];
+};
+
+// Maps instances to mesh uniforms; instanced draws start at their first
+// instance's index, and GPU culling compacts the visible instances
+layout(set = 3, binding = 2) buffer readonly MeshInstances {
+  uint instances[];
+};
 
 layout(location = 0) in vec3 vertPosition;
 layout(location = 1) in vec3 vertNormal;
@@ -24,12 +39,18 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
 layout(location = 3) out vec3 fragPosition;
+layout(location = 4) flat out uint fragMeshIndex;
 
 void main() {
+  uint mesh_idx = instances[gl_InstanceIndex];
+  MeshUniform mesh = meshes[mesh_idx];
+
   gl_Position = camera.projection * camera.view * mesh.model * vec4(vertPosition, 1.0);
 
   fragColor = vertColor;
   fragTexCoord = vertTexCoord;
   fragNormal = (mesh.model * vec4(vertNormal, 0.0)).xyz;
   fragPosition = (mesh.model * vec4(vertPosition, 1.0)).xyz;
+
+  fragMeshIndex = mesh_idx;
 }
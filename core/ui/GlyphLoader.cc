@@ -14,6 +14,7 @@
 #include "core/gpu/GpuBuffer.h"
 #include "core/gpu/GpuImage.h"
 #include "core/gpu/GpuShader.h"
+#include "core/gpu/GpuUploader.h"
 #include "log/log.h"
 #include "shaders/glyph.frag.h"
 #include "shaders/glyph.vert.h"
@@ -125,8 +126,11 @@ GlyphLoader::GlyphLoader(const CVarScope* _cvars, GpuInstance* gpu)
                    VMA_MEMORY_USAGE_GPU_ONLY);
 
   std::vector<GlyphUniform> glyph_data(glyph_rects.size());
-  glyph_buffer = new GpuBuffer(gpu, glyph_data.size() * sizeof(glyph_data[0]),
-                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  size_t glyph_size = glyph_data.size() * sizeof(glyph_data[0]);
+  glyph_buffer = new GpuBuffer(
+      gpu, glyph_size,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
 
   unsigned char* atlas_data = new unsigned char[atlas_width * atlas_height * 4];
 
@@ -179,12 +183,11 @@ GlyphLoader::GlyphLoader(const CVarScope* _cvars, GpuInstance* gpu)
     }
   }
 
-  atlas_image->transitionLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  atlas_image->writeData(atlas_data);
-  atlas_image->transitionLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  size_t atlas_size = atlas_width * atlas_height * 4;
+  gpu->uploader->writeImage(atlas_image, atlas_data, atlas_size, {0});
   delete[] atlas_data;
 
-  glyph_buffer->writeData(glyph_data.data());
+  gpu->uploader->writeBuffer(glyph_buffer, 0, glyph_data.data(), glyph_size);
 
   {
     log_zone_named("Create SDF sampler");
@@ -14,6 +14,7 @@
 #include "core/components/ScriptComponent.h"
 #include "core/components/TransformComponent.h"
 #include "core/filesystem/Filesystem.h"
+#include "core/gpu/GpuBufferArena.h"
 #include "core/gpu/GpuInstance.h"
 #include "core/scripting/ScriptEnvironment.h"
 #include "log/log.h"
@@ -21,12 +22,20 @@
 
 namespace mondradiko {
 
-World::World(Filesystem* fs, GpuInstance* gpu)
-    : fs(fs), gpu(gpu), asset_pool(fs) {
+void World::initCVars(CVarScope* cvars) { AssetPool::initCVars(cvars); }
+
+World::World(const CVarScope* cvars, Filesystem* fs, GpuInstance* gpu)
+    : fs(fs), gpu(gpu), asset_pool(cvars, fs) {
   log_zone;
 
+  mesh_vertex_arena =
+      new GpuBufferArena(gpu, 16 << 20, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  mesh_index_arena =
+      new GpuBufferArena(gpu, 8 << 20, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
   asset_pool.initializeAssetType<MaterialAsset>(&asset_pool, gpu);
-  asset_pool.initializeAssetType<MeshAsset>(gpu);
+  asset_pool.initializeAssetType<MeshAsset>(gpu, mesh_vertex_arena,
+                                            mesh_index_arena);
   asset_pool.initializeAssetType<PrefabAsset>(&asset_pool);
   asset_pool.initializeAssetType<ScriptAsset>(&scripts);
   asset_pool.initializeAssetType<TextureAsset>(gpu);
@@ -38,6 +47,9 @@ World::~World() {
   log_zone;
   registry.clear();
   asset_pool.unloadAll();
+
+  if (mesh_vertex_arena != nullptr) delete mesh_vertex_arena;
+  if (mesh_index_arena != nullptr) delete mesh_index_arena;
 }
 
 void World::initializePrefabs() {
@@ -193,6 +205,8 @@ bool World::update() {
 
   scripts.update(registry, &asset_pool);
 
+  asset_pool.update();
+
   log_frame_mark;
   return true;
 }
@@ -13,7 +13,9 @@
 namespace mondradiko {
 
 // Forward declarations
+class CVarScope;
 class Filesystem;
+class GpuBufferArena;
 class GpuInstance;
 
 namespace protocol {
@@ -26,7 +28,9 @@ struct UpdateScripts;
 
 class World {
  public:
-  World(Filesystem*, GpuInstance*);
+  static void initCVars(CVarScope*);
+
+  World(const CVarScope*, Filesystem*, GpuInstance*);
   ~World();
 
   void initializePrefabs();
@@ -52,6 +56,10 @@ class World {
   Filesystem* fs;
   GpuInstance* gpu;
 
+  // Shared by every MeshAsset
+  GpuBufferArena* mesh_vertex_arena = nullptr;
+  GpuBufferArena* mesh_index_arena = nullptr;
+
   // private:
   EntityRegistry registry;
   AssetPool asset_pool;
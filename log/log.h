@@ -37,10 +37,12 @@
   ZoneScopedN(name);         \
   // mondradiko::log(__FILE__, __LINE__, LogLevel::Zone, __FUNCTION__);
 #define log_frame_mark FrameMark
+#define log_plot(name, value) TracyPlot(name, static_cast<int64_t>(value))
 #else
 #define log_zone
 #define log_zone_named(name)
 #define log_frame_mark
+#define log_plot(name, value)
 #endif
 
 namespace mondradiko {
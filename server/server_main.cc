@@ -55,10 +55,11 @@ int ServerArgs::parse(int argc, const char * const argv[]) {
 bool g_interrupted = false;
 
 void run(const ServerArgs& args) {
-  Filesystem fs;
-  auto config = fs.loadToml(args.config_path);
+  auto config = Filesystem::loadToml(args.config_path);
 
   CVarScope cvars;
+  Filesystem::initCVars(&cvars);
+  World::initCVars(&cvars);
 
   CVarScope* server_cvars = cvars.addChild("server");
   server_cvars->addValue<FloatCVar>("max_tps", 1.0, 100.0);
@@ -66,11 +67,12 @@ void run(const ServerArgs& args) {
 
   cvars.loadConfig(config);
 
+  Filesystem fs(&cvars);
   for (auto bundle : args.bundle_paths) {
     fs.loadAssetBundle(bundle);
   }
 
-  World world(&fs, nullptr);
+  World world(&cvars, &fs, nullptr);
   WorldEventSorter world_event_sorter(&world);
   NetworkServer server(&fs, &world_event_sorter, args.server_ip.c_str(),
                        args.server_port);
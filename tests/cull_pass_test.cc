@@ -0,0 +1,309 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+#include "bundler/AssetBundleBuilder.h"
+#include "core/components/MeshRendererComponent.h"
+#include "core/components/TransformComponent.h"
+#include "core/cvars/CVarScope.h"
+#include "core/displays/HeadlessDisplay.h"
+#include "core/filesystem/Filesystem.h"
+#include "core/gpu/GpuInstance.h"
+#include "core/renderer/CullPass.h"
+#include "core/renderer/MeshPass.h"
+#include "core/renderer/Renderer.h"
+#include "core/world/World.h"
+#include "lib/include/glm_headers.h"
+#include "lib/include/toml_headers.h"
+#include "log/log.h"
+#include "types/assets/SerializedAsset_generated.h"
+
+using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
+
+// Meshes are streamed in over several world updates
+static const uint32_t MAX_LOADING_FRAMES = 1000;
+
+// Enough for the depth pyramids to gain history, and for the culling
+// stats to be read back from a frame that used them
+static const uint32_t CULLING_FRAMES = 8;
+
+static const char* TEST_CONFIG = R"(
+[filesystem]
+paranoid_verification = true
+worker_threads = 0
+
+[assets]
+cpu_budget = 64
+gpu_budget = 64
+eviction_delay = 8
+
+[renderer.culling]
+enabled = true
+occlusion = true
+
+[renderer.debug]
+enabled = false
+draw_lights = false
+draw_transforms = false
+)";
+
+static AssetId addAsset(assets::AssetBundleBuilder* builder,
+                        flatbuffers::FlatBufferBuilder* fbb,
+                        flatbuffers::Offset<assets::SerializedAsset> asset) {
+  AssetId id;
+  if (builder->addAsset(&id, fbb, asset) != assets::AssetResult::Success) {
+    log_ftl("Failed to add test asset");
+  }
+
+  return id;
+}
+
+static AssetId addMaterial(assets::AssetBundleBuilder* builder) {
+  AssetId texture_id;
+
+  {
+    flatbuffers::FlatBufferBuilder fbb;
+    std::vector<uint8_t> pixel = {255, 255, 255, 255};
+    auto data_offset = fbb.CreateVector(pixel);
+
+    assets::TextureAssetBuilder texture(fbb);
+    texture.add_components(4);
+    texture.add_bit_depth(8);
+    texture.add_component_type(assets::TextureComponentType::UByte);
+    texture.add_width(1);
+    texture.add_height(1);
+    texture.add_srgb(false);
+    texture.add_data(data_offset);
+    texture.add_format(assets::TextureFormat::Uncompressed);
+    auto texture_offset = texture.Finish();
+
+    assets::SerializedAssetBuilder asset(fbb);
+    asset.add_type(assets::AssetType::TextureAsset);
+    asset.add_texture(texture_offset);
+    texture_id = addAsset(builder, &fbb, asset.Finish());
+  }
+
+  flatbuffers::FlatBufferBuilder fbb;
+  assets::Vec3 albedo_factor(1.0, 1.0, 1.0);
+
+  assets::MaterialAssetBuilder material(fbb);
+  material.add_albedo_factor(&albedo_factor);
+  material.add_albedo_texture(texture_id);
+  material.add_metallic_factor(0.0);
+  material.add_roughness_factor(1.0);
+  auto material_offset = material.Finish();
+
+  assets::SerializedAssetBuilder asset(fbb);
+  asset.add_type(assets::AssetType::MaterialAsset);
+  asset.add_material(material_offset);
+  return addAsset(builder, &fbb, asset.Finish());
+}
+
+// An axis-aligned box centered on the origin
+static AssetId addBox(assets::AssetBundleBuilder* builder,
+                      const glm::vec3& half_extent) {
+  std::vector<assets::MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    for (float sign : {-1.0f, 1.0f}) {
+      glm::vec3 normal(0.0);
+      normal[axis] = sign;
+
+      // Two tangents that wind the face counter-clockwise from outside
+      glm::vec3 u(0.0);
+      glm::vec3 v(0.0);
+      u[(axis + 1) % 3] = sign;
+      v[(axis + 2) % 3] = 1.0;
+
+      uint32_t first_vertex = vertices.size();
+
+      for (glm::vec2 corner : {glm::vec2(-1, -1), glm::vec2(1, -1),
+                               glm::vec2(1, 1), glm::vec2(-1, 1)}) {
+        glm::vec3 position = (normal + u * corner.x + v * corner.y) *
+                             half_extent;
+
+        vertices.emplace_back(
+            assets::Vec3f(position.x, position.y, position.z),
+            assets::Vec3f(normal.x, normal.y, normal.z),
+            assets::Vec3f(1.0, 1.0, 1.0),
+            assets::Vec2f(corner.x * 0.5 + 0.5, corner.y * 0.5 + 0.5));
+      }
+
+      for (uint32_t index : {0, 1, 2, 2, 3, 0}) {
+        indices.push_back(first_vertex + index);
+      }
+    }
+  }
+
+  flatbuffers::FlatBufferBuilder fbb;
+  auto vertices_offset = fbb.CreateVectorOfStructs(vertices);
+  auto indices_offset = fbb.CreateVector(indices);
+
+  assets::Vec3 bounds_min(-half_extent.x, -half_extent.y, -half_extent.z);
+  assets::Vec3 bounds_max(half_extent.x, half_extent.y, half_extent.z);
+  assets::Vec3 bounds_center(0.0, 0.0, 0.0);
+
+  assets::MeshAssetBuilder mesh(fbb);
+  mesh.add_vertices(vertices_offset);
+  mesh.add_indices(indices_offset);
+  mesh.add_bounds_min(&bounds_min);
+  mesh.add_bounds_max(&bounds_max);
+  mesh.add_bounds_center(&bounds_center);
+  mesh.add_bounds_radius(glm::length(half_extent));
+  auto mesh_offset = mesh.Finish();
+
+  assets::SerializedAssetBuilder asset(fbb);
+  asset.add_type(assets::AssetType::MeshAsset);
+  asset.add_mesh(mesh_offset);
+  return addAsset(builder, &fbb, asset.Finish());
+}
+
+static void spawnMesh(World* world, AssetId mesh, AssetId material,
+                      const glm::vec3& position) {
+  EntityId entity = world->registry.create();
+
+  protocol::TransformComponent transform(
+      static_cast<protocol::EntityId>(NullEntity),
+      protocol::Vec3(position.x, position.y, position.z),
+      protocol::Quaternion(1.0, 0.0, 0.0, 0.0));
+  world->registry.emplace<TransformComponent>(entity, transform);
+
+  auto& mesh_renderer =
+      world->registry.emplace<MeshRendererComponent>(entity, mesh, material);
+  mesh_renderer.refresh(&world->asset_pool);
+}
+
+static bool areMeshesLoaded(World* world) {
+  auto mesh_renderers = world->registry.view<MeshRendererComponent>();
+
+  for (auto e : mesh_renderers) {
+    if (!mesh_renderers.get(e).isLoaded()) return false;
+  }
+
+  return true;
+}
+
+static void runFrame(HeadlessDisplay* display, World* world,
+                     Renderer* renderer) {
+  DisplayPollEventsInfo poll_info;
+  poll_info.renderer = renderer;
+  display->pollEvents(&poll_info);
+
+  DisplayBeginFrameInfo frame_info;
+  display->beginFrame(&frame_info);
+  world->update();
+  if (frame_info.should_render) renderer->renderFrame();
+  display->endFrame(&frame_info);
+}
+
+static bool expectCount(const char* name, uint32_t count, uint32_t expected) {
+  if (count == expected) {
+    log_inf_fmt("%s: %u", name, count);
+    return true;
+  }
+
+  log_err_fmt("%s: expected %u, got %u", name, expected, count);
+  return false;
+}
+
+int main() {
+  CVarScope cvars;
+  Filesystem::initCVars(&cvars);
+  Renderer::initCVars(&cvars);
+  World::initCVars(&cvars);
+
+  {
+    std::istringstream config_stream(TEST_CONFIG);
+    cvars.loadConfig(toml::parse(config_stream, "test.toml"));
+  }
+
+  Filesystem fs(&cvars);
+
+  auto bundle_root =
+      std::filesystem::temp_directory_path() / "mondradiko-test-cull-pass";
+  std::filesystem::remove_all(bundle_root);
+  std::filesystem::create_directories(bundle_root);
+
+  AssetId material;
+  AssetId cube;
+  AssetId wall;
+
+  {
+    assets::AssetBundleBuilder builder(bundle_root);
+    builder.setWorkers(fs.getWorkers());
+
+    material = addMaterial(&builder);
+    cube = addBox(&builder, glm::vec3(0.25));
+    wall = addBox(&builder, glm::vec3(20.0, 20.0, 0.1));
+
+    if (builder.buildBundle("registry.bin") != assets::AssetResult::Success) {
+      log_ftl("Failed to build test bundle");
+    }
+  }
+
+  if (!fs.loadAssetBundle(bundle_root)) log_ftl("Failed to load test bundle");
+
+  HeadlessDisplay display(256, 256);
+  GpuInstance gpu(&display);
+  if (!display.createSession(&gpu)) log_ftl("Failed to create session");
+
+  bool passed = true;
+
+  {
+    World world(&cvars, &fs, &gpu);
+
+    Renderer renderer(&cvars, &display, &gpu);
+    MeshPass mesh_pass(&renderer, &world);
+    CullPass cull_pass(cvars.getChild("renderer"), &renderer, &mesh_pass);
+    renderer.addRenderPass(&mesh_pass);
+    renderer.addRenderPass(&cull_pass);
+
+    // The camera sits at the origin, looking down -Z. A wall fills the view
+    // five units away; two cubes sit in front of it and six behind it.
+    spawnMesh(&world, wall, material, glm::vec3(0.0, 0.0, -5.0));
+    spawnMesh(&world, cube, material, glm::vec3(-0.5, 0.0, -2.0));
+    spawnMesh(&world, cube, material, glm::vec3(0.5, 0.0, -2.0));
+
+    for (float x : {-2.0f, 0.0f, 2.0f}) {
+      for (float y : {-1.0f, 1.0f}) {
+        spawnMesh(&world, cube, material, glm::vec3(x, y, -20.0));
+      }
+    }
+
+    // Far to either side, where the MeshPass's BVH culls them on the CPU
+    spawnMesh(&world, cube, material, glm::vec3(-100.0, 0.0, -10.0));
+    spawnMesh(&world, cube, material, glm::vec3(100.0, 0.0, -10.0));
+
+    uint32_t loading_frames = 0;
+    while (!areMeshesLoaded(&world)) {
+      if (++loading_frames > MAX_LOADING_FRAMES) {
+        log_ftl("Timed out waiting for test meshes to load");
+      }
+
+      runFrame(&display, &world, &renderer);
+    }
+
+    for (uint32_t i = 0; i < CULLING_FRAMES; i++) {
+      runFrame(&display, &world, &renderer);
+    }
+
+    const CullPass::Stats& stats = cull_pass.getStats();
+
+    // Instances outside every frustum never reach the GPU, so the shader's
+    // own frustum test has nothing left to cull
+    passed &= expectCount("Drawn", stats.drawn_count, 3);
+    passed &= expectCount("Frustum culled", stats.frustum_culled_count, 0);
+    passed &= expectCount("Occluded", stats.occlusion_culled_count, 6);
+
+    renderer.destroyFrameData();
+  }
+
+  display.destroySession();
+  std::filesystem::remove_all(bundle_root);
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+// Copyright (c) 2020-2021 the Mondradiko contributors.
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "assets/common/TextureCompression.h"
+#include "core/displays/HeadlessDisplay.h"
+#include "core/gpu/GpuBuffer.h"
+#include "core/gpu/GpuImage.h"
+#include "core/gpu/GpuInstance.h"
+#include "core/gpu/GpuUploader.h"
+#include "log/log.h"
+
+using namespace mondradiko;  // NOLINT using is ok because this is an entrypoint
+
+static const uint32_t TEXTURE_SIZE = 64;
+
+// Larger than a texture, so that the buffer path copies several regions
+static const size_t BUFFER_SIZE = 1 << 20;
+
+// Per-channel error allowed between a source texel and its decoded texel
+static const int MAX_TEXEL_ERROR = 8;
+static const double MAX_MEAN_ERROR = 2.0;
+
+struct TextureLevel {
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> rgba;
+};
+
+// Ramps with some high-frequency detail, at the same slope on every level
+static TextureLevel makeLevel(uint32_t width, uint32_t height) {
+  TextureLevel level{width, height};
+  level.rgba.resize(static_cast<size_t>(width) * height * 4);
+
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      uint8_t* texel = &level.rgba[(static_cast<size_t>(y) * width + x) * 4];
+      texel[0] = 64 + 2 * x + (x * 7 + y * 13) % 8;
+      texel[1] = 64 + 2 * y;
+      texel[2] = 192 - x - y;
+      texel[3] = 255 - x;
+    }
+  }
+
+  return level;
+}
+
+static bool compareTexels(const char* name, const TextureLevel& level,
+                          const uint8_t* decoded, uint32_t channels) {
+  int max_error = 0;
+  double total_error = 0.0;
+
+  for (size_t i = 0; i < level.rgba.size(); i += 4) {
+    for (uint32_t c = 0; c < channels; c++) {
+      int error = std::abs(level.rgba[i + c] - decoded[i + c]);
+      max_error = std::max(max_error, error);
+      total_error += error;
+    }
+  }
+
+  double mean_error = total_error / (level.rgba.size() / 4 * channels);
+
+  if (max_error > MAX_TEXEL_ERROR || mean_error > MAX_MEAN_ERROR) {
+    log_err_fmt("%s %ux%u: max error %d, mean error %.3f", name, level.width,
+                level.height, max_error, mean_error);
+    return false;
+  }
+
+  return true;
+}
+
+static void submitReadback(GpuInstance* gpu, GpuImage* image,
+                           GpuBuffer* readback,
+                           const std::vector<size_t>& level_offsets) {
+  VkCommandBuffer command_buffer = gpu->beginSingleTimeCommands();
+
+  // The uploader's acquire only covers the stages that normally read uploads
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = image->layout;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image->image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = image->mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+  image->layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  std::vector<VkBufferImageCopy> regions;
+  for (uint32_t level = 0; level < level_offsets.size(); level++) {
+    VkBufferImageCopy region{};
+    region.bufferOffset = level_offsets[level];
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = std::max(image->width >> level, 1u);
+    region.imageExtent.height = std::max(image->height >> level, 1u);
+    region.imageExtent.depth = 1;
+    regions.push_back(region);
+  }
+
+  vkCmdCopyImageToBuffer(command_buffer, image->image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         readback->getBuffer(), regions.size(),
+                         regions.data());
+
+  VkMemoryBarrier host_barrier{};
+  host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0,
+                       nullptr, 0, nullptr);
+
+  gpu->endSingleTimeCommands(command_buffer);
+}
+
+// Decodes level 0 on the GPU by blitting it into an RGBA8 image
+static void decodeOnGpu(GpuInstance* gpu, GpuImage* image,
+                        GpuBuffer* readback) {
+  GpuImage decoded(gpu, VK_FORMAT_R8G8B8A8_UNORM, image->width, image->height,
+                   VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                       VK_IMAGE_USAGE_SAMPLED_BIT,
+                   VMA_MEMORY_USAGE_GPU_ONLY);
+
+  VkCommandBuffer command_buffer = gpu->beginSingleTimeCommands();
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = decoded.image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  VkImageBlit blit{};
+  blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  blit.srcSubresource.mipLevel = 0;
+  blit.srcSubresource.baseArrayLayer = 0;
+  blit.srcSubresource.layerCount = 1;
+  blit.srcOffsets[1] = {static_cast<int32_t>(image->width),
+                        static_cast<int32_t>(image->height), 1};
+  blit.dstSubresource = blit.srcSubresource;
+  blit.dstOffsets[1] = blit.srcOffsets[1];
+
+  vkCmdBlitImage(command_buffer, image->image, image->layout, decoded.image,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                 VK_FILTER_NEAREST);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  gpu->endSingleTimeCommands(command_buffer);
+
+  decoded.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  submitReadback(gpu, &decoded, readback, {0});
+}
+
+static bool testTexture(GpuInstance* gpu, assets::TextureFormat format,
+                        VkFormat vk_format) {
+  const char* name = assets::EnumNameTextureFormat(format);
+  uint32_t channels = format == assets::TextureFormat::BC4 ? 1 : 4;
+  bool passed = true;
+
+  std::vector<TextureLevel> levels;
+  std::vector<size_t> level_offsets;
+  std::vector<uint8_t> compressed;
+
+  for (uint32_t size = TEXTURE_SIZE; size > 0; size >>= 1) {
+    levels.push_back(makeLevel(size, size));
+    level_offsets.push_back(compressed.size());
+    assets::compressTextureLevel(format, levels.back().rgba.data(), size,
+                                 size, &compressed);
+  }
+
+  // Round trip through the CPU codec first, which clients fall back on
+  for (uint32_t level = 0; level < levels.size(); level++) {
+    const uint8_t* level_data = compressed.data() + level_offsets[level];
+    std::vector<uint8_t> decoded(levels[level].rgba.size());
+    assets::decompressTextureLevel(format, level_data, levels[level].width,
+                                   levels[level].height, decoded.data());
+    passed &= compareTexels(name, levels[level], decoded.data(), channels);
+  }
+
+  std::vector<VkFormat> format_options = {vk_format};
+  VkFormat supported_format;
+  if (!gpu->findSupportedFormat(&format_options, VK_IMAGE_TILING_OPTIMAL,
+                                VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
+                                &supported_format)) {
+    log_wrn_fmt("Device can't sample %s; skipping its upload", name);
+    return passed;
+  }
+
+  VkComponentMapping components = {
+      VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+  GpuImage image(gpu, vk_format, TEXTURE_SIZE, TEXTURE_SIZE, levels.size(),
+                 components,
+                 VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                     VK_IMAGE_USAGE_SAMPLED_BIT,
+                 VMA_MEMORY_USAGE_GPU_ONLY);
+
+  gpu->uploader->writeImage(&image, compressed.data(), compressed.size(),
+                            level_offsets);
+  gpu->uploader->flush();
+  gpu->uploader->waitIdle();
+
+  // Every block should arrive exactly as it was compressed
+  GpuBuffer readback(gpu, compressed.size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VMA_MEMORY_USAGE_GPU_TO_CPU);
+  submitReadback(gpu, &image, &readback, level_offsets);
+
+  if (memcmp(readback.getMappedData(), compressed.data(), compressed.size()) !=
+      0) {
+    log_err_fmt("%s blocks were corrupted by the upload", name);
+    passed = false;
+  }
+
+  format_options = {vk_format};
+  if (!gpu->findSupportedFormat(&format_options, VK_IMAGE_TILING_OPTIMAL,
+                                VK_FORMAT_FEATURE_BLIT_SRC_BIT,
+                                &supported_format)) {
+    log_wrn_fmt("Device can't blit from %s; skipping its GPU decode", name);
+    return passed;
+  }
+
+  // Blits don't apply view swizzles, so BC4 lands in red alone
+  GpuBuffer decoded(gpu, levels[0].rgba.size(),
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_GPU_TO_CPU);
+  decodeOnGpu(gpu, &image, &decoded);
+  passed &= compareTexels(name, levels[0],
+                          static_cast<uint8_t*>(decoded.getMappedData()),
+                          channels);
+
+  log_inf_fmt("%s: %s", name, passed ? "passed" : "failed");
+  return passed;
+}
+
+static bool testBuffer(GpuInstance* gpu) {
+  std::vector<uint8_t> data(BUFFER_SIZE);
+  for (size_t i = 0; i < data.size(); i++) data[i] = (i * 31 + i / 251) & 0xFF;
+
+  GpuBuffer buffer(gpu, data.size(),
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                   VMA_MEMORY_USAGE_GPU_ONLY);
+
+  // Two writes, so that the second lands at an offset
+  size_t half = data.size() / 2;
+  gpu->uploader->writeBuffer(&buffer, 0, data.data(), half);
+  gpu->uploader->writeBuffer(&buffer, half, data.data() + half,
+                             data.size() - half);
+  gpu->uploader->flush();
+  gpu->uploader->waitIdle();
+
+  GpuBuffer readback(gpu, data.size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+  VkCommandBuffer command_buffer = gpu->beginSingleTimeCommands();
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  VkBufferCopy region{};
+  region.size = data.size();
+  vkCmdCopyBuffer(command_buffer, buffer.getBuffer(), readback.getBuffer(), 1,
+                  &region);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  gpu->endSingleTimeCommands(command_buffer);
+
+  if (memcmp(readback.getMappedData(), data.data(), data.size()) != 0) {
+    log_err("Buffer was corrupted by the upload");
+    return false;
+  }
+
+  log_inf("Buffer: passed");
+  return true;
+}
+
+int main() {
+  HeadlessDisplay display(TEXTURE_SIZE, TEXTURE_SIZE);
+  GpuInstance gpu(&display);
+
+  // Devices with a single queue family, like lavapipe, only exercise the
+  // single-queue path; the ownership transfers need a transfer-only family
+  if (gpu.transfer_queue_family != gpu.graphics_queue_family) {
+    log_inf_fmt("Uploading on transfer queue family %u",
+                gpu.transfer_queue_family);
+  } else {
+    log_inf("Uploading on the graphics queue");
+  }
+
+  bool passed = true;
+  passed &= testBuffer(&gpu);
+  passed &= testTexture(&gpu, assets::TextureFormat::BC7,
+                        VK_FORMAT_BC7_UNORM_BLOCK);
+  passed &= testTexture(&gpu, assets::TextureFormat::BC4,
+                        VK_FORMAT_BC4_UNORM_BLOCK);
+
+  return passed ? 0 : 1;
+}